@@ -36,11 +36,35 @@ typedef unsigned int uint32_t;
 #else
 # include <stdint.h>
 #endif
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*-----------------------------------------------------------------------------
+ * Memory management.
+ *---------------------------------------------------------------------------*/
+
+/* All memory allocated by libsac is aligned to at least this many bytes. */
+#define SAC_DEFAULT_ALIGNMENT 64
+
+typedef void *(*sac_alloc_fn_t)(size_t size, size_t alignment, void *user);
+typedef void (*sac_free_fn_t)(void *ptr, void *user);
+
+/* Route all libsac allocations through a custom allocator. The alloc_fn must
+ * return memory aligned to (at least) the requested alignment, which is a
+ * power of two that is never smaller than SAC_DEFAULT_ALIGNMENT. Pass NULL
+ * function pointers to restore the default allocator.
+ * NOTE: The allocator must not be changed while any memory that was allocated
+ * by libsac (e.g. packed data) is still alive. */
+void sac_set_allocator(sac_alloc_fn_t alloc_fn, sac_free_fn_t free_fn, void *user);
+
+/* Allocate/free memory using the current libsac allocator. */
+void *sac_mem_alloc(size_t size);
+void sac_mem_free(void *ptr);
+
+
 /*-----------------------------------------------------------------------------
  * Packed data definitions.
  *---------------------------------------------------------------------------*/
@@ -51,15 +75,34 @@ enum sac_encoding_t {
   SAC_FORMAT_DD8A = 2
 };
 
+/* Block layout flags. */
+enum sac_layout_t {
+  SAC_LAYOUT_DEFAULT = 0,
+  SAC_LAYOUT_SUPERBLOCKS = 1, /* 64-byte aligned superblocks (SIMD friendly) */
+  SAC_LAYOUT_PLANAR = 2,      /* Channels stored one after another */
+  SAC_LAYOUT_SPARSE = 4,      /* Constant blocks stored as runs, silence trimmed */
+  SAC_LAYOUT_DEDUP = 8        /* Identical blocks stored once (indirection table) */
+};
+
 typedef void sac_packed_data_t;
 
 void sac_free(sac_packed_data_t *data);
 
-int sac_get_size(const sac_packed_data_t *data);
+int sac_get_size(const sac_packed_data_t *data);  /* Encoded size, incl. any block map/table */
 int sac_get_num_samples(const sac_packed_data_t *data);
 int sac_get_num_channels(const sac_packed_data_t *data);
 int sac_get_sample_rate(const sac_packed_data_t *data);
 sac_encoding_t sac_get_encoding(const sac_packed_data_t *data);
+int sac_get_layout(const sac_packed_data_t *data);
+int sac_get_block_size(const sac_packed_data_t *data);  /* Samples per block */
+
+/* Get the number of block rows (blocks per channel), not counting any
+ * trimmed silence (see sac_get_silence). */
+int sac_get_num_blocks(const sac_packed_data_t *data);
+
+/* Get the number of leading and trailing samples that are silent in all
+ * channels, and that are not stored (only for SAC_LAYOUT_SPARSE data). */
+void sac_get_silence(const sac_packed_data_t *data, int *leading, int *trailing);
 
 
 /*-----------------------------------------------------------------------------
@@ -67,7 +110,14 @@ sac_encoding_t sac_get_encoding(const sac_packed_data_t *data);
  *---------------------------------------------------------------------------*/
 
 sac_packed_data_t *sac_load_file(const char *file_name);
-void sac_save_file(const char *file_name, const sac_packed_data_t *data);
+
+/* Load a single channel of a file, as mono packed data. For planar layout
+ * files (without SAC_LAYOUT_SPARSE/DEDUP), only the data of the requested
+ * channel is read. */
+sac_packed_data_t *sac_load_file_channel(const char *file_name, int channel);
+
+/* Save packed data to a file. Returns non-zero on success. */
+int sac_save_file(const char *file_name, const sac_packed_data_t *data);
 
 
 /*-----------------------------------------------------------------------------
@@ -78,11 +128,300 @@ void sac_decode_channel(int16_t *out, const sac_packed_data_t *in, int start, in
 void sac_decode_interleaved(int16_t *out, const sac_packed_data_t *in, int start, int count);
 
 
+/*-----------------------------------------------------------------------------
+ * Decoded block cache.
+ *
+ * An optional cache of decoded blocks, shared by all packed data, which makes
+ * repeated decoding of the same regions (e.g. scrubbing, granular synthesis
+ * or re-triggered sounds) a copy. It is used transparently by the decode
+ * functions, except for long decodes (more than 8192 samples per channel),
+ * which bypass the cache so that they do not evict the hot blocks. The cache
+ * is sharded (for concurrent decoders) and uses CLOCK eviction.
+ *---------------------------------------------------------------------------*/
+
+typedef struct {
+  uint64_t hits;       /* Entries found in the cache */
+  uint64_t misses;     /* Entries that had to be decoded */
+  uint64_t evictions;  /* Entries that were replaced by other entries */
+  uint64_t entries;    /* Entries in use */
+  uint64_t capacity;   /* Max number of entries (of 128 samples each) */
+} sac_block_cache_stats_t;
+
+/* Set the max size of the cache, in bytes (zero disables the cache, which is
+ * the default). Any cached blocks and counters are dropped. Returns zero if
+ * the size is too small (less than about 8 KB) or if the memory could not be
+ * allocated, in which case the cache is left unchanged.
+ * NOTE: The size must not be changed while other threads are decoding. */
+int sac_set_block_cache_size(size_t size);
+
+void sac_get_block_cache_stats(sac_block_cache_stats_t *stats);
+
+
+/*-----------------------------------------------------------------------------
+ * Sound manager.
+ *
+ * A sound manager keeps each of its sounds in one of two tiers: packed only,
+ * or also fully decoded to PCM. Within a memory budget for the PCM, the sounds
+ * that are played the most (per byte of PCM) are promoted to the PCM tier,
+ * and cold sounds are demoted to packed only, so that the hottest sounds cost
+ * no decoding at all.
+ *
+ * Sounds change tier only in sac_sound_manager_update(), which decodes the
+ * promoted sounds, and which should be called periodically from a background
+ * thread (from one thread at a time). All other functions may be called from
+ * any thread, also while an update is running.
+ *---------------------------------------------------------------------------*/
+
+typedef void sac_sound_manager_t;
+
+typedef struct {
+  uint64_t resident_sounds;  /* Sounds in the PCM tier */
+  uint64_t resident_bytes;   /* Size of all PCM */
+  uint64_t promotions;       /* Sounds that were decoded to PCM */
+  uint64_t demotions;        /* Sounds whose PCM was dropped */
+  uint64_t pcm_samples;      /* Sample frames read from PCM */
+  uint64_t packed_samples;   /* Sample frames decoded from packed data */
+} sac_sound_manager_stats_t;
+
+/* Create a sound manager with a budget for the PCM tier, in bytes. */
+sac_sound_manager_t *sac_sound_manager_create(size_t pcm_budget);
+void sac_sound_manager_destroy(sac_sound_manager_t *manager);
+
+/* Add a sound. The packed data is not copied, and must be kept alive until
+ * the sound is removed. Returns the sound id, or -1 on failure. */
+int sac_sound_manager_add(sac_sound_manager_t *manager, const sac_packed_data_t *data);
+
+/* Remove a sound (waits for any update that is decoding the sound). */
+void sac_sound_manager_remove(sac_sound_manager_t *manager, int sound);
+
+/* Get interleaved samples of a sound (see sac_decode_interleaved()), from
+ * whichever tier is resident. The requested samples count towards the heat
+ * of the sound. Returns the number of sample frames that were output. */
+int sac_sound_manager_get_samples(sac_sound_manager_t *manager, int sound, int16_t *out, int start, int count);
+
+/* Promote and demote sounds based on their recent heat. Returns the number of
+ * sounds that changed tier. */
+int sac_sound_manager_update(sac_sound_manager_t *manager);
+
+void sac_sound_manager_get_stats(sac_sound_manager_t *manager, sac_sound_manager_stats_t *stats);
+
+
+/*-----------------------------------------------------------------------------
+ * Compressed domain editing.
+ *
+ * Blocks of the result that hold exactly the samples of a block of the input
+ * are copied without decoding them (i.e. without any generation loss). Only
+ * blocks that straddle an edge that is not aligned to the block grid are
+ * decoded and encoded again. The result uses the layout of the (first) input,
+ * and gets a precomputed envelope if the (first) input has one.
+ *---------------------------------------------------------------------------*/
+
+/* Extract the block rows start_block to start_block + num_blocks - 1 (see
+ * sac_get_num_blocks). The first and the last block row include any trimmed
+ * leading and trailing silence, respectively. Returns NULL on failure. */
+sac_packed_data_t *sac_slice(const sac_packed_data_t *data, int start_block, int num_blocks);
+
+/* Join two sounds, which must have the same encoding, block size, number of
+ * channels and sample rate. Returns NULL on failure. */
+sac_packed_data_t *sac_concat(const sac_packed_data_t *a, const sac_packed_data_t *b);
+
+/* Pick channels of a sound: output channel i is channel channel_map[i] of the
+ * input (channels may be dropped, reordered and repeated). Returns NULL on
+ * failure. */
+sac_packed_data_t *sac_extract_channels(const sac_packed_data_t *data, const int *channel_map, int num_channels);
+
+/* Put the channels of count sounds (which must have the same encoding, block
+ * size, number of samples and sample rate) side by side in one sound. Returns
+ * NULL on failure. */
+sac_packed_data_t *sac_merge_channels(const sac_packed_data_t *const *datas, int count);
+
+
+/*-----------------------------------------------------------------------------
+ * Envelopes.
+ *
+ * The envelope of a channel is the min, max and RMS of the samples of each
+ * bin of samples_per_bin samples (the last bin may hold fewer samples), e.g.
+ * for drawing waveform overviews or for loudness measurements. There are
+ * (num_samples + samples_per_bin - 1) / samples_per_bin bins.
+ *---------------------------------------------------------------------------*/
+
+typedef enum {
+  SAC_ENVELOPE_EXACT = 0,   /* Decode all samples (in parallel) */
+  SAC_ENVELOPE_APPROX = 1   /* Estimate from the block headers only */
+} sac_envelope_mode_t;
+
+/* Compute the envelope of a channel. Any of min, max and rms may be NULL.
+ * If the data has a precomputed envelope (see the peak_bin_size encode
+ * option) whose bin size divides samples_per_bin, it is used in both modes,
+ * and the result is exact. Returns the number of bins, or zero on failure. */
+int sac_compute_envelope(const sac_packed_data_t *data, int channel, int samples_per_bin, sac_envelope_mode_t mode, int16_t *min, int16_t *max, float *rms);
+
+/* Get the bin size of the precomputed envelope (zero if there is none). */
+int sac_get_peak_bin_size(const sac_packed_data_t *data);
+
+
 /*-----------------------------------------------------------------------------
  * Encoding.
  *---------------------------------------------------------------------------*/
 
+typedef struct {
+  sac_encoding_t format;  /* Encoding format (default: SAC_FORMAT_DD8A) */
+  int layout;             /* SAC_LAYOUT_* flags (default: SAC_LAYOUT_DEFAULT) */
+  int dither;             /* Apply TPDF dither when converting int32/float input to 16 bits (default: 0) */
+  int block_size;         /* Samples per block: 0 (format default), 64 or 128 (default: 0) */
+  int peak_bin_size;      /* Samples per bin of a precomputed envelope, or 0 for none (default: 0) */
+  int map_search;         /* Try all quantization maps and predictors for each block, and use the most accurate (much slower) (default: 0) */
+} sac_encode_options_t;
+
+void sac_init_encode_options(sac_encode_options_t *options);
+
 sac_packed_data_t *sac_encode(int num_samples, int num_channels, int sample_rate, sac_encoding_t format, int16_t **channels);
+sac_packed_data_t *sac_encode_ex(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, int16_t **channels);
+
+/* Encode 32-bit integer samples (full scale is the full 32-bit range, i.e.
+   24-bit samples should be shifted left by 8 bits). */
+sac_packed_data_t *sac_encode_int32(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, const int32_t *const *channels);
+
+/* Encode floating point samples (full scale is [-1.0, 1.0)). */
+sac_packed_data_t *sac_encode_float(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, const float *const *channels);
+
+/* Encode packed data in another format (e.g. DD8A to DD4A). The data is
+ * decoded block by block as it is encoded again (in parallel), so the sound
+ * is never decoded to PCM as a whole. sac_transcode() keeps the layout, any
+ * long block size and any precomputed envelope of the data. */
+sac_packed_data_t *sac_transcode(const sac_packed_data_t *data, sac_encoding_t format);
+sac_packed_data_t *sac_transcode_ex(const sac_packed_data_t *data, const sac_encode_options_t *options);
+
+
+/*-----------------------------------------------------------------------------
+ * Streaming.
+ *
+ * Stream writers/readers encode/decode SAC files incrementally, using a
+ * constant amount of memory, through user supplied I/O callbacks (e.g. for
+ * pipes). Streaming is not supported for the planar, sparse and dedup
+ * layouts, and stream writers do not write precomputed envelopes.
+ *---------------------------------------------------------------------------*/
+
+/* Read up to size bytes. Returns the number of bytes read (0 at the end). */
+typedef int (*sac_read_fn_t)(void *buf, int size, void *user);
+
+/* Write size bytes. Returns non-zero on success. */
+typedef int (*sac_write_fn_t)(const void *buf, int size, void *user);
+
+/* Seek to an absolute position. Returns non-zero on success. */
+typedef int (*sac_seek_fn_t)(int64_t pos, void *user);
+
+typedef void sac_stream_writer_t;
+typedef void sac_stream_reader_t;
+
+/* Start writing a SAC stream. If num_samples is unknown (-1), or if a
+ * different number of samples is written, the header is patched when the
+ * stream is closed, which requires a seek_fn (may be NULL otherwise). */
+sac_stream_writer_t *sac_stream_writer_open(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, sac_write_fn_t write_fn, sac_seek_fn_t seek_fn, void *user);
+
+/* Append samples to the stream. Returns non-zero on success. */
+int sac_stream_writer_write(sac_stream_writer_t *writer, const int16_t *const *channels, int num_samples);
+
+/* Flush and close the stream. Returns non-zero on success. */
+int sac_stream_writer_close(sac_stream_writer_t *writer);
+
+/* Start reading a SAC stream (the file header is read immediately). */
+sac_stream_reader_t *sac_stream_reader_open(sac_read_fn_t read_fn, void *user);
+
+int sac_stream_reader_get_num_samples(const sac_stream_reader_t *reader);
+int sac_stream_reader_get_num_channels(const sac_stream_reader_t *reader);
+int sac_stream_reader_get_sample_rate(const sac_stream_reader_t *reader);
+sac_encoding_t sac_stream_reader_get_encoding(const sac_stream_reader_t *reader);
+
+/* Decode up to max_samples samples per channel. Returns the number of samples
+ * that were decoded (0 at the end of the stream), or -1 on error. */
+int sac_stream_reader_read(sac_stream_reader_t *reader, int16_t **channels, int max_samples);
+
+void sac_stream_reader_close(sac_stream_reader_t *reader);
+
+
+/*-----------------------------------------------------------------------------
+ * Statistics.
+ *
+ * Statistics collection must be enabled at compile time (the CMake option
+ * LIBSAC_ENABLE_STATS) and at run time (sac_set_stats_enabled()). Counters
+ * are kept per thread and are aggregated when read, so counts from threads
+ * that are running concurrently with sac_get_stats() may be slightly stale.
+ *---------------------------------------------------------------------------*/
+
+/* Max number of quantization maps of any format (DD4A: 64, DD8A: 8). */
+#define SAC_STATS_MAX_MAPS 64
+
+/* API entry points that are timed. */
+enum sac_api_t {
+  SAC_API_LOAD_FILE = 0,
+  SAC_API_SAVE_FILE = 1,
+  SAC_API_ENCODE = 2,
+  SAC_API_DECODE_CHANNEL = 3,
+  SAC_API_DECODE_INTERLEAVED = 4,
+  SAC_API_COUNT = 5
+};
+
+typedef struct {
+  uint64_t calls;    /* Number of calls */
+  uint64_t time_ns;  /* Cumulative time spent in the calls (nanoseconds) */
+} sac_api_stats_t;
+
+/* Per format counters are indexed by sac_encoding_t. The predictor and map
+ * usage histograms are collected for encoded blocks. */
+typedef struct {
+  uint64_t blocks_decoded[3];       /* Decoded blocks (one per channel) */
+  uint64_t blocks_encoded[3];       /* Encoded blocks (one per channel) */
+  uint64_t predictor_usage[3][2];   /* Encoded blocks per predictor */
+  uint64_t map_usage[3][SAC_STATS_MAX_MAPS]; /* Encoded blocks per map */
+  uint64_t partial_block_decodes;   /* Blocks that were not fully decoded */
+  uint64_t skipped_samples;         /* Samples decoded but not output */
+  uint64_t clamp_events;            /* Clamped samples during encoding */
+  uint64_t bytes_loaded;            /* Packed data bytes loaded from files */
+  uint64_t constant_blocks;         /* Encoded blocks stored as constant runs */
+  uint64_t duplicate_blocks;        /* Encoded blocks stored as references */
+  sac_api_stats_t api[SAC_API_COUNT];
+} sac_stats_t;
+
+/* Enable or disable statistics collection (disabled by default). Returns zero
+ * if statistics support is not compiled in. */
+int sac_set_stats_enabled(int enabled);
+
+/* Get the statistics that have been collected since the last reset. */
+void sac_get_stats(sac_stats_t *stats);
+
+/* Reset all statistics counters. */
+void sac_reset_stats(void);
+
+
+/*-----------------------------------------------------------------------------
+ * CPU features.
+ *
+ * SIMD kernels are selected at run time, based on the instruction set level
+ * that is supported by the CPU. The level can be lowered (e.g. for testing
+ * all code paths on a single machine) with sac_set_cpu_level() or with the
+ * environment variable LIBSAC_CPU_LEVEL (generic, sse2, sse4.1, avx2 or
+ * avx512), which is read the first time the level is queried.
+ *---------------------------------------------------------------------------*/
+
+typedef enum {
+  SAC_CPU_DETECT = -1,  /* Use the detected level (sac_set_cpu_level() only) */
+  SAC_CPU_GENERIC = 0,  /* No SIMD (portable C++) */
+  SAC_CPU_SSE2 = 1,
+  SAC_CPU_SSE41 = 2,
+  SAC_CPU_AVX2 = 3,
+  SAC_CPU_AVX512 = 4
+} sac_cpu_level_t;
+
+/* Get the highest level that is supported by the CPU. */
+sac_cpu_level_t sac_get_detected_cpu_level(void);
+
+/* Get the level that is used for selecting kernels. */
+sac_cpu_level_t sac_get_cpu_level(void);
+
+/* Force a specific level (or SAC_CPU_DETECT). Returns zero if the level is
+ * not supported by the CPU, in which case the level is left unchanged. */
+int sac_set_cpu_level(sac_cpu_level_t level);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,99 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "allocator.h"
+
+#include <cstdlib>
+#ifdef _WIN32
+#  include <malloc.h>
+#endif
+
+namespace sac {
+
+namespace {
+
+void *default_alloc(size_t size, size_t alignment, void *user) {
+  (void)user;
+#ifdef _WIN32
+  return _aligned_malloc(size, alignment);
+#else
+  void *ptr = 0;
+  if (posix_memalign(&ptr, alignment, size) != 0) {
+    return 0;
+  }
+  return ptr;
+#endif
+}
+
+void default_free(void *ptr, void *user) {
+  (void)user;
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+sac_alloc_fn_t s_alloc_fn = default_alloc;
+sac_free_fn_t s_free_fn = default_free;
+void *s_user = 0;
+
+} // anonymous namespace
+
+void *mem_alloc(size_t size) {
+  // Never ask the allocator for zero bytes (the result is implementation
+  // defined for most allocators).
+  return s_alloc_fn(size > 0 ? size : 1, SAC_DEFAULT_ALIGNMENT, s_user);
+}
+
+void mem_free(void *ptr) {
+  if (ptr) {
+    s_free_fn(ptr, s_user);
+  }
+}
+
+} // namespace sac
+
+extern "C"
+void sac_set_allocator(sac_alloc_fn_t alloc_fn, sac_free_fn_t free_fn, void *user) {
+  if (alloc_fn && free_fn) {
+    sac::s_alloc_fn = alloc_fn;
+    sac::s_free_fn = free_fn;
+    sac::s_user = user;
+  } else {
+    sac::s_alloc_fn = sac::default_alloc;
+    sac::s_free_fn = sac::default_free;
+    sac::s_user = 0;
+  }
+}
+
+extern "C"
+void *sac_mem_alloc(size_t size) {
+  return sac::mem_alloc(size);
+}
+
+extern "C"
+void sac_mem_free(void *ptr) {
+  sac::mem_free(ptr);
+}
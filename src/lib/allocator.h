@@ -0,0 +1,141 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_ALLOCATOR_H_
+#define LIBSAC_ALLOCATOR_H_
+
+#include <cstring>
+#include <new>
+
+#include "../include/libsac.h"
+
+namespace sac {
+
+/// @brief Allocate memory using the current libsac allocator.
+/// @param size Number of bytes to allocate.
+/// @returns A pointer to the allocated memory (aligned to at least
+/// SAC_DEFAULT_ALIGNMENT bytes), or zero if the allocation failed.
+void *mem_alloc(size_t size);
+
+/// @brief Free memory that was allocated with mem_alloc().
+/// @param ptr The memory to free (may be zero).
+void mem_free(void *ptr);
+
+/// @brief Base class for library objects that are created with new, so that
+/// the objects themselves are also allocated with the libsac allocator.
+class allocated_t {
+  public:
+    static void *operator new(size_t size) {
+      void *ptr = mem_alloc(size);
+      if (!ptr) {
+        throw std::bad_alloc();
+      }
+      return ptr;
+    }
+
+    static void operator delete(void *ptr) {
+      mem_free(ptr);
+    }
+};
+
+/// @brief Scoped buffer, allocated with mem_alloc().
+/// This is a minimal std::vector replacement for temporary buffers, so that
+/// they are also allocated with the libsac allocator. The elements are not
+/// constructed (i.e. T must be a POD type).
+template <class T>
+class scoped_buffer_t {
+  public:
+    scoped_buffer_t() : m_ptr(0), m_size(0) {}
+
+    /// @param size Number of (uninitialized) elements.
+    explicit scoped_buffer_t(size_t size) : m_ptr(0), m_size(0) {
+      resize(size);
+    }
+
+    /// @param size Number of elements.
+    /// @param value The value of all elements.
+    scoped_buffer_t(size_t size, const T &value) : m_ptr(0), m_size(0) {
+      if (resize(size)) {
+        fill(value);
+      }
+    }
+
+    ~scoped_buffer_t() {
+      mem_free(m_ptr);
+    }
+
+    /// @brief Change the size of the buffer (the contents are preserved up to
+    /// the smaller of the sizes).
+    /// @returns false if the allocation failed (the buffer is unchanged).
+    bool resize(size_t size) {
+      T *ptr = 0;
+      if (size > 0) {
+        ptr = static_cast<T*>(mem_alloc(size * sizeof(T)));
+        if (!ptr) {
+          return false;
+        }
+        if (m_size > 0) {
+          std::memcpy(ptr, m_ptr, (size < m_size ? size : m_size) * sizeof(T));
+        }
+      }
+      mem_free(m_ptr);
+      m_ptr = ptr;
+      m_size = size;
+      return true;
+    }
+
+    void fill(const T &value) {
+      for (size_t i = 0; i < m_size; ++i) {
+        m_ptr[i] = value;
+      }
+    }
+
+    /// @returns Zero if the buffer is empty (e.g. if the allocation failed).
+    T *get() const {
+      return m_ptr;
+    }
+
+    T &operator[](size_t i) const {
+      return m_ptr[i];
+    }
+
+    size_t size() const {
+      return m_size;
+    }
+
+    bool empty() const {
+      return m_size == 0;
+    }
+
+  private:
+    scoped_buffer_t(const scoped_buffer_t& other);
+    scoped_buffer_t& operator=(const scoped_buffer_t& other);
+
+    T *m_ptr;
+    size_t m_size;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_ALLOCATOR_H_
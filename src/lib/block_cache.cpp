@@ -0,0 +1,277 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+#include "block_cache.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#endif
+
+#include "spin_lock.h"
+#include "util.h"
+
+namespace sac {
+
+namespace {
+
+// Number of shards (a power of two).
+const int kNumShards = 16;
+
+volatile long long s_next_data_id = 0;
+
+uint64_t hash_key(uint64_t data_id, int channel, int entry_no) {
+  uint64_t h = data_id * 0x9e3779b97f4a7c15ULL;
+  h ^= (static_cast<uint64_t>(static_cast<uint32_t>(channel)) << 32) | static_cast<uint32_t>(entry_no);
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+} // anonymous namespace
+
+struct block_cache_t::entry_t {
+  uint64_t data_id;
+  int channel;
+  int entry_no;
+  int next;        ///< The next entry of the hash chain (-1 = none).
+  int referenced;  ///< The CLOCK reference bit (-1 = unused entry).
+  int16_t samples[kCacheEntrySamples];
+};
+
+struct block_cache_t::shard_t {
+  spin_lock_t lock;
+  entry_t *entries;
+  int *buckets;     ///< The first entry of each hash chain (-1 = none).
+  int hand;         ///< The CLOCK hand.
+  int num_used;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+
+  // Keep the locks of neighbouring shards in different cache lines.
+  uint8_t padding[64];
+
+  /// @returns The entry that holds a key, or -1 if there is none.
+  int find(uint64_t data_id, int channel, int entry_no, int bucket) const {
+    for (int e = buckets[bucket]; e >= 0; e = entries[e].next) {
+      const entry_t &entry = entries[e];
+      if (entry.data_id == data_id && entry.channel == channel && entry.entry_no == entry_no) {
+        return e;
+      }
+    }
+    return -1;
+  }
+
+  /// @brief Remove an entry from its hash chain.
+  void unlink(int e, int bucket) {
+    int *link = &buckets[bucket];
+    while (*link != e) {
+      link = &entries[*link].next;
+    }
+    *link = entries[e].next;
+  }
+};
+
+block_cache_t *volatile g_block_cache = 0;
+
+uint64_t new_data_id() {
+#ifdef _WIN32
+  return static_cast<uint64_t>(InterlockedIncrement64(&s_next_data_id));
+#else
+  return static_cast<uint64_t>(__sync_add_and_fetch(&s_next_data_id, 1));
+#endif
+}
+
+block_cache_t::block_cache_t()
+    : m_memory(0),
+      m_shards(0),
+      m_entries_per_shard(0),
+      m_buckets_per_shard(0) {
+}
+
+block_cache_t::~block_cache_t() {
+  mem_free(m_memory);
+}
+
+block_cache_t *block_cache_t::create(size_t size) {
+  // Each entry needs at most two buckets (the number of buckets is the
+  // smallest power of two that is not less than the number of entries).
+  const size_t fixed_size = kNumShards * sizeof(shard_t);
+  const size_t entry_size = sizeof(entry_t) + 2 * sizeof(int);
+  if (size < fixed_size + kNumShards * entry_size) {
+    return 0;
+  }
+  const size_t max_entries = (size - fixed_size) / (kNumShards * entry_size);
+  const int entries_per_shard = static_cast<int>(max_entries < 0x1000000 ? max_entries : 0x1000000);
+  int buckets_per_shard = 1;
+  while (buckets_per_shard < entries_per_shard) {
+    buckets_per_shard *= 2;
+  }
+
+  scoped_ptr<block_cache_t> cache(new block_cache_t());
+  const size_t shard_size = static_cast<size_t>(entries_per_shard) * sizeof(entry_t) + static_cast<size_t>(buckets_per_shard) * sizeof(int);
+  cache->m_memory = mem_alloc(fixed_size + kNumShards * shard_size);
+  if (!cache->m_memory) {
+    return 0;
+  }
+  cache->m_entries_per_shard = entries_per_shard;
+  cache->m_buckets_per_shard = buckets_per_shard;
+
+  // The shards are followed by the entries and the buckets of each shard.
+  uint8_t *ptr = static_cast<uint8_t*>(cache->m_memory);
+  cache->m_shards = reinterpret_cast<shard_t*>(ptr);
+  ptr += fixed_size;
+  for (int s = 0; s < kNumShards; ++s) {
+    shard_t &shard = cache->m_shards[s];
+    new (&shard) shard_t();
+    shard.entries = reinterpret_cast<entry_t*>(ptr);
+    ptr += static_cast<size_t>(entries_per_shard) * sizeof(entry_t);
+    shard.buckets = reinterpret_cast<int*>(ptr);
+    ptr += static_cast<size_t>(buckets_per_shard) * sizeof(int);
+    for (int e = 0; e < entries_per_shard; ++e) {
+      shard.entries[e].referenced = -1;
+      shard.entries[e].next = -1;
+    }
+    for (int b = 0; b < buckets_per_shard; ++b) {
+      shard.buckets[b] = -1;
+    }
+  }
+  return cache.release();
+}
+
+block_cache_t::shard_t &block_cache_t::shard_of(uint64_t hash) {
+  return m_shards[hash & (kNumShards - 1)];
+}
+
+bool block_cache_t::lookup(uint64_t data_id, int channel, int entry_no, int16_t *out) {
+  const uint64_t hash = hash_key(data_id, channel, entry_no);
+  const int bucket = static_cast<int>((hash / kNumShards) & static_cast<uint64_t>(m_buckets_per_shard - 1));
+  shard_t &shard = shard_of(hash);
+
+  shard.lock.lock();
+  const int e = shard.find(data_id, channel, entry_no, bucket);
+  if (e >= 0) {
+    entry_t &entry = shard.entries[e];
+    entry.referenced = 1;
+    std::memcpy(out, entry.samples, sizeof(entry.samples));
+    ++shard.hits;
+  } else {
+    ++shard.misses;
+  }
+  shard.lock.unlock();
+  return e >= 0;
+}
+
+void block_cache_t::insert(uint64_t data_id, int channel, int entry_no, const int16_t *samples) {
+  const uint64_t hash = hash_key(data_id, channel, entry_no);
+  const int bucket = static_cast<int>((hash / kNumShards) & static_cast<uint64_t>(m_buckets_per_shard - 1));
+  shard_t &shard = shard_of(hash);
+
+  shard.lock.lock();
+
+  // Another thread may have inserted the entry in the meantime.
+  if (shard.find(data_id, channel, entry_no, bucket) >= 0) {
+    shard.lock.unlock();
+    return;
+  }
+
+  // Advance the CLOCK hand to an unused or unreferenced entry (clearing the
+  // reference bits along the way).
+  while (shard.entries[shard.hand].referenced > 0) {
+    shard.entries[shard.hand].referenced = 0;
+    shard.hand = shard.hand + 1 < m_entries_per_shard ? shard.hand + 1 : 0;
+  }
+  const int e = shard.hand;
+  shard.hand = shard.hand + 1 < m_entries_per_shard ? shard.hand + 1 : 0;
+
+  entry_t &entry = shard.entries[e];
+  if (entry.referenced < 0) {
+    ++shard.num_used;
+  } else {
+    const uint64_t old_hash = hash_key(entry.data_id, entry.channel, entry.entry_no);
+    shard.unlink(e, static_cast<int>((old_hash / kNumShards) & static_cast<uint64_t>(m_buckets_per_shard - 1)));
+    ++shard.evictions;
+  }
+
+  entry.data_id = data_id;
+  entry.channel = channel;
+  entry.entry_no = entry_no;
+  entry.referenced = 0;
+  std::memcpy(entry.samples, samples, sizeof(entry.samples));
+  entry.next = shard.buckets[bucket];
+  shard.buckets[bucket] = e;
+
+  shard.lock.unlock();
+}
+
+void block_cache_t::get_stats(sac_block_cache_stats_t *stats) {
+  std::memset(stats, 0, sizeof(sac_block_cache_stats_t));
+  for (int s = 0; s < kNumShards; ++s) {
+    shard_t &shard = m_shards[s];
+    shard.lock.lock();
+    stats->hits += shard.hits;
+    stats->misses += shard.misses;
+    stats->evictions += shard.evictions;
+    stats->entries += shard.num_used;
+    shard.lock.unlock();
+  }
+  stats->capacity = static_cast<uint64_t>(m_entries_per_shard) * kNumShards;
+}
+
+} // namespace sac
+
+using namespace sac;
+
+extern "C"
+int sac_set_block_cache_size(size_t size) {
+  block_cache_t *cache = 0;
+  if (size > 0) {
+    cache = block_cache_t::create(size);
+    if (!cache) {
+      return 0;
+    }
+  }
+  block_cache_t *old_cache = g_block_cache;
+  g_block_cache = cache;
+  delete old_cache;
+  return 1;
+}
+
+extern "C"
+void sac_get_block_cache_stats(sac_block_cache_stats_t *stats) {
+  if (!stats) {
+    return;
+  }
+  block_cache_t *cache = g_block_cache;
+  if (cache) {
+    cache->get_stats(stats);
+  } else {
+    std::memset(stats, 0, sizeof(sac_block_cache_stats_t));
+  }
+}
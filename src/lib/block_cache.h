@@ -0,0 +1,101 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Decoded block cache:
+//
+// An optional cache of decoded samples, shared by all packed data. Each entry
+// holds kCacheEntrySamples decoded samples of a channel, i.e. one block or a
+// few consecutive short blocks (every block size divides the entry size), and
+// is keyed by (packed data, channel, entry number). Packed data is identified
+// by a unique id rather than by its address, so entries of freed data are
+// never hit (they are simply evicted over time).
+//
+// The cache is split into shards (selected by the hash of the key), each with
+// its own lock, hash chains and CLOCK eviction, so that concurrent decoders
+// rarely contend for a lock.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_BLOCK_CACHE_H_
+#define LIBSAC_BLOCK_CACHE_H_
+
+#include "../include/libsac.h"
+#include "allocator.h"
+
+namespace sac {
+
+/// @brief Number of samples per cache entry (the largest block size).
+const int kCacheEntrySamples = 128;
+
+/// @returns A new unique packed data id.
+uint64_t new_data_id();
+
+class block_cache_t : public allocated_t {
+  public:
+    ~block_cache_t();
+
+    /// @brief Create a cache.
+    /// @param size The max size of the cache (entries and index), in bytes.
+    /// @returns The cache, or zero if the size is too small or if the memory
+    /// could not be allocated.
+    static block_cache_t *create(size_t size);
+
+    /// @brief Look up an entry.
+    /// @param data_id The packed data id.
+    /// @param channel The channel.
+    /// @param entry_no The entry number (first sample / kCacheEntrySamples).
+    /// @param out Set to the samples of the entry (kCacheEntrySamples samples).
+    /// @returns true if the entry was found.
+    bool lookup(uint64_t data_id, int channel, int entry_no, int16_t *out);
+
+    /// @brief Insert an entry (possibly evicting another entry).
+    /// @param data_id The packed data id.
+    /// @param channel The channel.
+    /// @param entry_no The entry number.
+    /// @param samples The samples of the entry (kCacheEntrySamples samples).
+    void insert(uint64_t data_id, int channel, int entry_no, const int16_t *samples);
+
+    /// @brief Get the cache counters.
+    void get_stats(sac_block_cache_stats_t *stats);
+
+  private:
+    struct entry_t;
+    struct shard_t;
+
+    block_cache_t();
+    block_cache_t(const block_cache_t& other);
+    block_cache_t& operator=(const block_cache_t& other);
+
+    shard_t &shard_of(uint64_t hash);
+
+    void *m_memory;
+    shard_t *m_shards;
+    int m_entries_per_shard;
+    int m_buckets_per_shard;
+};
+
+/// @brief The current cache (zero if the cache is disabled).
+extern block_cache_t *volatile g_block_cache;
+
+} // namespace sac
+
+#endif // LIBSAC_BLOCK_CACHE_H_
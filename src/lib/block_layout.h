@@ -0,0 +1,315 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Block layouts:
+//
+// Every encoded block consists of a two byte header (the starting sample,
+// which also carries the map/predictor bits) followed by the delta codes.
+//
+// - Default layout: The blocks are stored as block rows, i.e. block k of all
+//   channels is stored before block k+1 of any channel. The header and the
+//   codes of each block are stored together.
+//
+// - Superblock layout (SAC_LAYOUT_SUPERBLOCKS): kBlocksPerSuperblock
+//   consecutive blocks of a channel are grouped into a superblock, in which
+//   all the block headers come first, followed by the codes of all the blocks.
+//   Superblocks are stored as superblock rows (in the same way as block rows
+//   for the default layout). Since kBlocksPerSuperblock is a multiple of 64,
+//   every full superblock is a multiple of 64 bytes in size, and the
+//   superblocks of the final row (which may hold fewer blocks, and a partial
+//   final block) are zero padded to a multiple of 64 bytes. Thus all
+//   superblocks (and their header arrays) are cache line aligned, and the
+//   decoder loads the headers of a superblock from its header array up front.
+//
+// - Planar layout (SAC_LAYOUT_PLANAR): All the (super)blocks of a channel are
+//   stored contiguously, one channel after the other, so that a single
+//   channel can be accessed without touching the data of the other channels.
+//   This flag can be combined with SAC_LAYOUT_SUPERBLOCKS.
+//
+// The default layout is identical to a superblock layout with one block per
+// superblock, which is how it is handled internally.
+//
+// - Block list layouts (SAC_LAYOUT_SPARSE and/or SAC_LAYOUT_DEDUP): Like the
+//   default (or planar) layout, except that the final block also occupies a
+//   full block, so that block i in storage order is at i * full_block_size().
+//   This list of blocks is then thinned out: constant blocks are removed by
+//   the sparse block map (see sparse_map.h), and duplicate blocks are removed
+//   by the deduplication table (see dedup_table.h). These flags can be
+//   combined with SAC_LAYOUT_PLANAR, but not with SAC_LAYOUT_SUPERBLOCKS.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_BLOCK_LAYOUT_H_
+#define LIBSAC_BLOCK_LAYOUT_H_
+
+#include <climits>
+#include <cstring>
+
+#include "../include/libsac.h"
+#include "format_traits.h"
+
+namespace sac {
+
+/// @brief A contiguous range of bytes in the encoded data.
+struct byte_range_t {
+  int offset;
+  int size;
+};
+
+/// @brief Byte offsets to the different parts of an encoded block.
+struct block_offsets_t {
+  /// Offset to the block header (two bytes).
+  int header;
+
+  /// Offset to the block codes.
+  int codes;
+};
+
+class block_layout_t {
+  public:
+    static const int kBlocksPerSuperblock = 64;
+
+    /// Superblocks are aligned to (and padded to) this many bytes.
+    static const int kSuperblockAlignment = 64;
+
+    block_layout_t(sac_encoding_t encoding, int block_size, int layout, int num_samples, int num_channels) {
+      m_block_size = is_valid_block_size(encoding, block_size) ? block_size : 0;
+      m_num_channels = num_channels;
+      m_blocks_per_sb = (layout & SAC_LAYOUT_SUPERBLOCKS) ? kBlocksPerSuperblock : 1;
+      m_planar = (layout & SAC_LAYOUT_PLANAR) != 0;
+      m_num_blocks = m_block_size > 0 && num_samples > 0 ? (num_samples - 1) / m_block_size + 1 : 0;
+      m_num_full_sb_rows = m_num_blocks > 0 ? (m_num_blocks - 1) / m_blocks_per_sb : 0;
+      m_bytes_per_block = bytes_per_block(encoding, m_block_size);
+      const int final_samples = num_samples - (m_num_blocks - 1) * m_block_size;
+      m_final_bytes_per_block = is_block_list(layout) ? m_bytes_per_block : bytes_per_block(encoding, final_samples);
+      m_final_sb_blocks = m_num_blocks - m_num_full_sb_rows * m_blocks_per_sb;
+
+      // The sizes are calculated with 64-bit integers, so that sizes that do
+      // not fit in an int (e.g. from a malformed file) can be detected.
+      const int64_t channel_size = m_num_blocks > 0 ? static_cast<int64_t>(m_num_full_sb_rows) * m_blocks_per_sb * m_bytes_per_block + final_sb_size() : 0;
+      m_valid_size = num_samples >= 0 && num_channels >= 0 && static_cast<int64_t>(num_channels) * channel_size <= INT_MAX;
+      m_channel_size = m_valid_size ? static_cast<int>(channel_size) : 0;
+    }
+
+    /// @brief Check if a combination of layout flags is supported.
+    static bool is_valid_layout(int layout) {
+      if (is_block_list(layout) && (layout & SAC_LAYOUT_SUPERBLOCKS)) {
+        return false;
+      }
+      return (layout & ~(SAC_LAYOUT_SUPERBLOCKS | SAC_LAYOUT_PLANAR | SAC_LAYOUT_SPARSE | SAC_LAYOUT_DEDUP)) == 0;
+    }
+
+    /// @brief Check if the layout flags give a block list layout.
+    static bool is_block_list(int layout) {
+      return (layout & (SAC_LAYOUT_SPARSE | SAC_LAYOUT_DEDUP)) != 0;
+    }
+
+    /// @brief Get the default block size (in samples) for the given encoding.
+    static int default_block_size(sac_encoding_t encoding) {
+      switch (encoding) {
+        case SAC_FORMAT_DD4A:
+          return format_traits<SAC_FORMAT_DD4A>::kDefaultBlockSize;
+        case SAC_FORMAT_DD8A:
+          return format_traits<SAC_FORMAT_DD8A>::kDefaultBlockSize;
+        default:
+          return 0;
+      }
+    }
+
+    /// @brief Check if a block size is supported for the given encoding.
+    static bool is_valid_block_size(sac_encoding_t encoding, int block_size) {
+      if (block_size == default_block_size(encoding)) {
+        return block_size > 0;
+      }
+      for (int i = 0; i < static_cast<int>(sizeof(kLongBlockSizes) / sizeof(kLongBlockSizes[0])); ++i) {
+        if (block_size == kLongBlockSizes[i]) {
+          return default_block_size(encoding) > 0;
+        }
+      }
+      return false;
+    }
+
+    /// @brief Get the size (in bytes) of an encoded block.
+    /// @param encoding The encoding format.
+    /// @param num_samples Number of samples in the block.
+    static int bytes_per_block(sac_encoding_t encoding, int num_samples) {
+      if (num_samples < 1) {
+        return 0;
+      }
+      switch (encoding) {
+        case SAC_FORMAT_DD4A:
+          return format_bytes_per_block<format_traits<SAC_FORMAT_DD4A> >(num_samples);
+        case SAC_FORMAT_DD8A:
+          return format_bytes_per_block<format_traits<SAC_FORMAT_DD8A> >(num_samples);
+        default:
+          return 0;
+      }
+    }
+
+    /// @returns false if the size of the encoded data does not fit in an int
+    /// (all sizes and offsets are invalid in that case).
+    bool has_valid_size() const {
+      return m_valid_size;
+    }
+
+    /// @returns The number of samples per block.
+    int block_size() const {
+      return m_block_size;
+    }
+
+    /// @returns The number of blocks per channel.
+    int num_blocks() const {
+      return m_num_blocks;
+    }
+
+    /// @returns The size of a full block, in bytes.
+    int full_block_size() const {
+      return m_bytes_per_block;
+    }
+
+    /// @returns The total size of the encoded data, in bytes.
+    int data_size() const {
+      return m_num_channels * channel_size();
+    }
+
+    /// @returns The number of bytes that are used for a single channel.
+    int channel_size() const {
+      return m_channel_size;
+    }
+
+    /// @returns The offset to the first byte of the given channel (only valid
+    /// for the planar layout).
+    int channel_offset(int channel) const {
+      return channel * m_channel_size;
+    }
+
+    /// @returns The storage order index of a block (for the default and
+    /// planar layouts).
+    int block_index(int block_no, int channel) const {
+      return m_planar ? channel * m_num_blocks + block_no : block_no * m_num_channels + channel;
+    }
+
+    /// @returns The number of superblock rows.
+    int num_sb_rows() const {
+      return m_num_blocks > 0 ? m_num_full_sb_rows + 1 : 0;
+    }
+
+    /// @returns The number of blocks per superblock (one for layouts without
+    /// superblocks).
+    int blocks_per_sb() const {
+      return m_blocks_per_sb;
+    }
+
+    /// @returns The number of blocks in a superblock of the given row.
+    int sb_blocks(int sb_row) const {
+      return sb_row == m_num_full_sb_rows ? m_final_sb_blocks : m_blocks_per_sb;
+    }
+
+    /// @brief Clear the padding at the end of the final superblocks.
+    /// @param data The encoded data.
+    void clear_padding(uint8_t *data) const {
+      if (m_num_blocks < 1) {
+        return;
+      }
+      const int padding = final_sb_size() - unpadded_final_sb_size();
+      for (int ch = 0; ch < m_num_channels && padding > 0; ++ch) {
+        const byte_range_t sb = superblock(m_num_full_sb_rows, ch);
+        std::memset(data + sb.offset + sb.size - padding, 0, padding);
+      }
+    }
+
+    /// @brief Locate a superblock.
+    /// @param sb_row The superblock row.
+    /// @param channel The channel.
+    /// @returns The byte range of the superblock.
+    /// @note A superblock has the same size and internal layout regardless of
+    /// the number of channels and the planar flag, so superblocks can be
+    /// copied verbatim between packed data with different channel counts.
+    byte_range_t superblock(int sb_row, int channel) const {
+      byte_range_t result;
+      result.size = m_blocks_per_sb * m_bytes_per_block;
+      if (sb_row == m_num_full_sb_rows) {
+        result.size = final_sb_size();
+      }
+      if (m_planar) {
+        result.offset = channel_offset(channel) + sb_row * m_blocks_per_sb * m_bytes_per_block;
+      } else {
+        result.offset = sb_row * m_blocks_per_sb * m_bytes_per_block * m_num_channels +
+                        channel * result.size;
+      }
+      return result;
+    }
+
+    /// @brief Locate an encoded block.
+    /// @param block_no The block number (within the channel).
+    /// @param channel The channel.
+    /// @returns The byte offsets to the block header and the block codes.
+    block_offsets_t block(int block_no, int channel) const {
+      const int sb_row = block_no / m_blocks_per_sb;
+      const int sb_block = block_no - sb_row * m_blocks_per_sb;
+
+      const byte_range_t sb = superblock(sb_row, channel);
+
+      block_offsets_t result;
+      result.header = sb.offset + 2 * sb_block;
+      result.codes = sb_codes(sb.offset, sb_row, sb_block);
+      return result;
+    }
+
+    /// @returns The byte offset to the codes of a block of a superblock.
+    /// @param sb_offset The offset to the superblock.
+    /// @param sb_row The superblock row.
+    /// @param sb_block The block number within the superblock.
+    int sb_codes(int sb_offset, int sb_row, int sb_block) const {
+      // The final superblock row may hold fewer blocks.
+      return sb_offset + 2 * sb_blocks(sb_row) + sb_block * (m_bytes_per_block - 2);
+    }
+
+  private:
+    int unpadded_final_sb_size() const {
+      return (m_final_sb_blocks - 1) * m_bytes_per_block + m_final_bytes_per_block;
+    }
+
+    int final_sb_size() const {
+      const int size = unpadded_final_sb_size();
+      if (m_blocks_per_sb == 1) {
+        return size;
+      }
+      return (size + kSuperblockAlignment - 1) & ~(kSuperblockAlignment - 1);
+    }
+
+    int m_block_size;
+    int m_num_channels;
+    int m_blocks_per_sb;
+    bool m_planar;
+    int m_num_blocks;
+    int m_num_full_sb_rows;
+    int m_bytes_per_block;
+    int m_final_bytes_per_block;
+    int m_final_sb_blocks;
+    bool m_valid_size;
+    int m_channel_size;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_BLOCK_LAYOUT_H_
@@ -0,0 +1,137 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+#include "clamp_map.h"
+
+#include <cstring>
+
+#include "file_format.h"
+
+namespace sac {
+
+clamp_map_t::clamp_map_t(int num_blocks)
+    : m_num_blocks(num_blocks),
+      m_num_clamped(0),
+      m_bits(0) {
+}
+
+clamp_map_t::~clamp_map_t() {
+  mem_free(m_bits);
+}
+
+bool clamp_map_t::allocate() {
+  const size_t size = static_cast<size_t>((m_num_blocks + 63) / 64) * sizeof(uint64_t);
+  m_bits = static_cast<uint64_t*>(mem_alloc(size));
+  if (!m_bits) {
+    return false;
+  }
+  std::memset(m_bits, 0, size);
+  return true;
+}
+
+bool clamp_map_t::build(const uint8_t *clamped) {
+  int num_clamped = 0;
+  for (int index = 0; index < m_num_blocks; ++index) {
+    num_clamped += clamped[index] ? 1 : 0;
+  }
+  if (num_clamped == 0) {
+    return true;
+  }
+  if (!allocate()) {
+    return false;
+  }
+  for (int index = 0; index < m_num_blocks; ++index) {
+    if (clamped[index]) {
+      set(index);
+    }
+  }
+  m_num_clamped = num_clamped;
+  return true;
+}
+
+clamp_map_t *clamp_map_t::parse(const uint8_t *in, int size, int num_blocks) {
+  if (size < 4 || num_blocks < 0) {
+    return 0;
+  }
+  const uint32_t num_clamped = get_uint32(in);
+  if (num_clamped > static_cast<uint32_t>(num_blocks) || size != 4 + static_cast<int>(num_clamped) * 4) {
+    return 0;
+  }
+  scoped_ptr<clamp_map_t> map(new clamp_map_t(num_blocks));
+  if (num_clamped == 0) {
+    return map.release();
+  }
+  if (!map->allocate()) {
+    return 0;
+  }
+
+  // The block indices must be in increasing order.
+  uint32_t next = 0;
+  for (uint32_t i = 0; i < num_clamped; ++i) {
+    const uint32_t index = get_uint32(in + 4 + i * 4);
+    if (index < next || index >= static_cast<uint32_t>(num_blocks)) {
+      return 0;
+    }
+    map->set(static_cast<int>(index));
+    next = index + 1;
+  }
+  map->m_num_clamped = static_cast<int>(num_clamped);
+  return map.release();
+}
+
+clamp_map_t *clamp_map_t::extract_channel(int channel, int num_channels) const {
+  const int num_blocks = m_num_blocks / num_channels;
+  scoped_ptr<clamp_map_t> map(new clamp_map_t(num_blocks));
+  if (m_num_clamped == 0) {
+    return map.release();
+  }
+  int num_clamped = 0;
+  for (int k = 0; k < num_blocks; ++k) {
+    if (is_clamped(k * num_channels + channel)) {
+      if (num_clamped == 0 && !map->allocate()) {
+        return 0;
+      }
+      map->set(k);
+      ++num_clamped;
+    }
+  }
+  map->m_num_clamped = num_clamped;
+  return map.release();
+}
+
+int clamp_map_t::serialized_size() const {
+  return 4 + m_num_clamped * 4;
+}
+
+void clamp_map_t::serialize(uint8_t *out) const {
+  put_uint32(out, static_cast<uint32_t>(m_num_clamped));
+  uint8_t *dst = out + 4;
+  for (int index = 0; index < m_num_blocks && m_num_clamped > 0; ++index) {
+    if (is_clamped(index)) {
+      put_uint32(dst, static_cast<uint32_t>(index));
+      dst += 4;
+    }
+  }
+}
+
+} // namespace sac
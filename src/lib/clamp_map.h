@@ -0,0 +1,108 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Clamp map:
+//
+// The decoder clamps every reconstructed sample to the 16-bit range, but in
+// practice only blocks of near full scale material ever need to be clamped.
+// The encoder reconstructs every sample too, so it records which blocks were
+// clamped. All other blocks can be decoded with a kernel that does not clamp
+// (and gives the same result).
+//
+// Blocks are numbered by block row and channel (block_no * num_channels +
+// channel), independent of the block layout. When a file has no clamp map,
+// all blocks must be decoded with clamping.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_CLAMP_MAP_H_
+#define LIBSAC_CLAMP_MAP_H_
+
+#include "../include/libsac.h"
+#include "allocator.h"
+#include "util.h"
+
+namespace sac {
+
+class clamp_map_t : public allocated_t {
+  public:
+    /// @brief Create an empty map (no blocks are clamped).
+    /// @param num_blocks Number of blocks (of all channels).
+    explicit clamp_map_t(int num_blocks);
+
+    ~clamp_map_t();
+
+    /// @brief Build the map from per block flags.
+    /// @param clamped Non-zero for each block that was clamped.
+    /// @returns false if the memory for the map could not be allocated.
+    bool build(const uint8_t *clamped);
+
+    /// @brief Parse a serialized map (the payload of a CLMP chunk).
+    /// @param in The serialized map.
+    /// @param size Size of the serialized map, in bytes.
+    /// @param num_blocks Number of blocks (of all channels).
+    /// @returns The map, or zero if the serialized map is malformed.
+    static clamp_map_t *parse(const uint8_t *in, int size, int num_blocks);
+
+    /// @brief Extract the map of a single channel.
+    /// @param channel The channel.
+    /// @param num_channels Number of channels.
+    /// @returns The mono map, or zero on failure.
+    clamp_map_t *extract_channel(int channel, int num_channels) const;
+
+    /// @returns The size of the serialized map, in bytes.
+    int serialized_size() const;
+
+    /// @brief Serialize the map (see file_format.h).
+    /// @param out The output buffer (serialized_size() bytes).
+    void serialize(uint8_t *out) const;
+
+    /// @returns The number of clamped blocks.
+    int num_clamped() const {
+      return m_num_clamped;
+    }
+
+    /// @param index The block index (block_no * num_channels + channel).
+    bool is_clamped(int index) const {
+      return m_bits && (m_bits[index >> 6] & (uint64_t(1) << (index & 63))) != 0;
+    }
+
+  private:
+    clamp_map_t();
+    clamp_map_t(const clamp_map_t& other);
+    clamp_map_t& operator=(const clamp_map_t& other);
+
+    bool allocate();
+    void set(int index) {
+      m_bits[index >> 6] |= uint64_t(1) << (index & 63);
+    }
+
+    const int m_num_blocks;
+    int m_num_clamped;
+
+    // The bitmap is only allocated when at least one block is clamped.
+    uint64_t *m_bits;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_CLAMP_MAP_H_
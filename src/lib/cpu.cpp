@@ -0,0 +1,214 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// CPU feature detection.
+//-----------------------------------------------------------------------------
+
+#include "cpu.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "spin_lock.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define LIBSAC_X86
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+
+namespace sac {
+
+namespace {
+
+// The current level (-1 = not yet determined).
+long s_level = -1;
+long s_detected_level = -1;
+
+// The kernel tables that have been selected (protected by the lock).
+kernel_table_t *s_tables = 0;
+spin_lock_t s_tables_lock;
+
+long compare_and_swap(volatile long *ptr, long old_value, long new_value) {
+#ifdef _WIN32
+  return InterlockedCompareExchange(ptr, new_value, old_value);
+#else
+  return __sync_val_compare_and_swap(ptr, old_value, new_value);
+#endif
+}
+
+#ifdef LIBSAC_X86
+void cpuid(int leaf, uint32_t *regs) {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, leaf, 0);
+  for (int i = 0; i < 4; ++i) {
+    regs[i] = static_cast<uint32_t>(r[i]);
+  }
+#else
+  __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/// @returns The OS supported register state (XCR0).
+uint32_t xgetbv() {
+#ifdef _MSC_VER
+  return static_cast<uint32_t>(_xgetbv(0));
+#else
+  uint32_t eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+  return eax;
+#endif
+}
+#endif // LIBSAC_X86
+
+sac_cpu_level_t detect() {
+#ifdef LIBSAC_X86
+  uint32_t regs[4];
+  cpuid(0, regs);
+  const uint32_t max_leaf = regs[0];
+  cpuid(1, regs);
+  const uint32_t ecx1 = regs[2], edx1 = regs[3];
+  if ((edx1 & (1u << 26)) == 0) {
+    return SAC_CPU_GENERIC;
+  }
+  if ((ecx1 & (1u << 19)) == 0) {
+    return SAC_CPU_SSE2;
+  }
+
+  // AVX requires that the OS saves the YMM registers (and ZMM for AVX-512).
+  if ((ecx1 & (1u << 27)) == 0 || max_leaf < 7) {
+    return SAC_CPU_SSE41;
+  }
+  const uint32_t xcr0 = xgetbv();
+  cpuid(7, regs);
+  const uint32_t ebx7 = regs[1];
+  if ((xcr0 & 0x06) != 0x06 || (ebx7 & (1u << 5)) == 0) {
+    return SAC_CPU_SSE41;
+  }
+
+  // AVX-512 F + BW.
+  if ((xcr0 & 0xe6) != 0xe6 || (ebx7 & (1u << 16)) == 0 || (ebx7 & (1u << 30)) == 0) {
+    return SAC_CPU_AVX2;
+  }
+  return SAC_CPU_AVX512;
+#else
+  return SAC_CPU_GENERIC;
+#endif
+}
+
+sac_cpu_level_t detected_level() {
+  long level = load_acquire(s_detected_level);
+  if (level < 0) {
+    // Detection has no side effects, so concurrent first calls are harmless.
+    level = static_cast<long>(detect());
+    compare_and_swap(&s_detected_level, -1, level);
+  }
+  return static_cast<sac_cpu_level_t>(level);
+}
+
+/// @returns The level requested by the LIBSAC_CPU_LEVEL environment variable,
+/// or SAC_CPU_DETECT.
+sac_cpu_level_t env_level() {
+  const char *env = std::getenv("LIBSAC_CPU_LEVEL");
+  if (!env) {
+    return SAC_CPU_DETECT;
+  }
+  static const char *const kNames[] = {"generic", "sse2", "sse4.1", "avx2", "avx512"};
+  for (int i = 0; i < static_cast<int>(sizeof(kNames) / sizeof(kNames[0])); ++i) {
+    if (std::strcmp(env, kNames[i]) == 0) {
+      return static_cast<sac_cpu_level_t>(i);
+    }
+  }
+  return SAC_CPU_DETECT;
+}
+
+} // anonymous namespace
+
+sac_cpu_level_t cpu_level() {
+  long level = load_acquire(s_level);
+  if (level < 0) {
+    // Use the detected level, unless the environment asks for a lower level.
+    level = static_cast<long>(detected_level());
+    const sac_cpu_level_t requested = env_level();
+    if (requested != SAC_CPU_DETECT && requested < level) {
+      level = static_cast<long>(requested);
+    }
+    const long old_level = compare_and_swap(&s_level, -1, level);
+    if (old_level >= 0) {
+      level = old_level;
+    }
+  }
+  return static_cast<sac_cpu_level_t>(level);
+}
+
+void select_kernels(kernel_table_t *table) {
+  scoped_lock_t lock(s_tables_lock);
+  if (!load_acquire(table->ready)) {
+    table->select(cpu_level());
+    table->next = s_tables;
+    s_tables = table;
+    store_release(table->ready, 1);
+  }
+}
+
+} // namespace sac
+
+using namespace sac;
+
+extern "C"
+sac_cpu_level_t sac_get_detected_cpu_level(void) {
+  return detected_level();
+}
+
+extern "C"
+sac_cpu_level_t sac_get_cpu_level(void) {
+  return cpu_level();
+}
+
+extern "C"
+int sac_set_cpu_level(sac_cpu_level_t level) {
+  if (level == SAC_CPU_DETECT) {
+    level = detected_level();
+  } else if (level < SAC_CPU_GENERIC || level > detected_level()) {
+    return 0;
+  }
+  // Select the kernels of all tables that are in use for the new level. Any
+  // kernel of a level up to the detected level works, so callers that race
+  // with the update are unaffected.
+  scoped_lock_t lock(s_tables_lock);
+  long old_level = load_acquire(s_level);
+  while (compare_and_swap(&s_level, old_level, static_cast<long>(level)) != old_level) {
+    old_level = load_acquire(s_level);
+  }
+  for (kernel_table_t *table = s_tables; table; table = table->next) {
+    table->select(level);
+  }
+  return 1;
+}
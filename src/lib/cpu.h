@@ -0,0 +1,108 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_CPU_H_
+#define LIBSAC_CPU_H_
+
+#include "libsac.h"
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace sac {
+
+/// @brief Load a value that another thread may store concurrently (with
+/// store_release), with acquire ordering.
+/// The value must be a long or a pointer (e.g. a kernel function pointer).
+template <typename T>
+inline T load_acquire(const T &x) {
+#ifdef _MSC_VER
+  // Volatile loads have acquire semantics with /volatile:ms (the default for
+  // x86 and x64).
+  const T value = *static_cast<const volatile T*>(&x);
+  _ReadWriteBarrier();
+  return value;
+#else
+  return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/// @brief Store a value that other threads may load concurrently (with
+/// load_acquire), with release ordering.
+inline void store_release(long &x, long value) {
+#ifdef _MSC_VER
+  _InterlockedExchange(&x, value);
+#else
+  __atomic_store_n(&x, value, __ATOMIC_RELEASE);
+#endif
+}
+
+// The stored value does not take part in the deduction of T, so that zero (or
+// a function) can be stored in a function pointer.
+template <typename T>
+struct non_deduced_t {
+  typedef T type;
+};
+
+template <typename T>
+inline void store_release(T *&x, typename non_deduced_t<T>::type *value) {
+#ifdef _MSC_VER
+  _InterlockedExchangePointer(reinterpret_cast<void *volatile *>(&x), reinterpret_cast<void*>(value));
+#else
+  __atomic_store_n(&x, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/// @brief Get the CPU level to use when selecting SIMD kernels.
+/// The level is determined the first time this function is called (which is
+/// thread safe), and is cheap to query after that.
+sac_cpu_level_t cpu_level();
+
+/// @brief A table of SIMD kernels.
+/// The select function stores the kernels of a module for a given CPU level
+/// (e.g. in global function pointers, with store_release). It is called the
+/// first time that the table is used (see use_kernels), and again whenever the
+/// CPU level is changed, so that the kernels can be called without checking
+/// the level (they are read with load_acquire).
+/// Tables must be global objects, initialized as {select_fn, 0, 0}.
+struct kernel_table_t {
+  void (*select)(sac_cpu_level_t level);
+  long ready;
+  kernel_table_t *next;
+};
+
+/// @brief Select the kernels of a table for the current CPU level (unless
+/// they have been selected already).
+void select_kernels(kernel_table_t *table);
+
+inline void use_kernels(kernel_table_t &table) {
+  if (!load_acquire(table.ready)) {
+    select_kernels(&table);
+  }
+}
+
+} // namespace sac
+
+#endif // LIBSAC_CPU_H_
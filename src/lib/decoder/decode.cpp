@@ -25,17 +25,144 @@
 #include "libsac.h"
 
 #include <algorithm>
+#include <cstring>
 
+#include "block_cache.h"
+#include "decoder/decode.h"
 #include "decoder/decode_dd4a.h"
 #include "decoder/decode_dd8a.h"
 #include "packed_data.h"
+#include "stats.h"
+#include "trace.h"
 
 using namespace sac;
 
-extern "C"
-void sac_decode_channel(int16_t *out, const sac_packed_data_t *in_, int start, int count, int channel) {
-  const packed_data_t *in = reinterpret_cast<const packed_data_t*>(in_);
+namespace {
+
+// Decodes of at most this many samples (per channel) go through the block
+// cache. Longer decodes (e.g. of whole sounds) bypass it, so that they do not
+// evict the hot blocks.
+const int kMaxCachedSamples = 8192;
+
+/// @brief Output the trimmed silence (sparse layout only).
+/// Zeros are written for the part of the range that is outside of the coded
+/// samples, and the range is narrowed down to the coded samples.
+/// @param out The output buffer (updated to the first coded sample).
+/// @param in The packed data.
+/// @param start First sample to decode (updated to the first coded sample,
+/// relative to the start of the coded samples).
+/// @param count Number of samples to decode (updated).
+/// @param frame_size Number of output values per sample.
+void output_silence(int16_t *&out, const packed_data_t *in, int &start, int &count, int frame_size) {
+  const int leading = in->leading_silence();
+  if (start < leading) {
+    const int n = std::min(leading - start, count);
+    std::memset(out, 0, n * frame_size * sizeof(int16_t));
+    out += n * frame_size;
+    start += n;
+    count -= n;
+  }
+  const int coded_end = leading + in->coded_samples();
+  if (start + count > coded_end) {
+    const int n = start + count - std::max(start, coded_end);
+    std::memset(out + (count - n) * frame_size, 0, n * frame_size * sizeof(int16_t));
+    count -= n;
+  }
+  start -= leading;
+}
+
+/// @brief Update the statistics for a decode operation.
+/// The counters are derived from the decoded range, so that there is no per
+/// block overhead in the decoders.
+/// @param in The packed data.
+/// @param start First sample to decode.
+/// @param count Number of samples to decode.
+/// @param num_channels Number of channels to decode.
+void count_decode(const packed_data_t *in, int start, int count, int num_channels) {
+  sac_stats_t *stats = thread_stats();
+  if (!stats) {
+    return;
+  }
+
+  const int block_size = in->block_size();
+  const int first_block = start / block_size;
+  const int last_block = (start + count - 1) / block_size;
+  const int end = start + count;
+  const int skipped = start - first_block * block_size;
+
+  // The first and the last blocks may be partially decoded.
+  int num_partial = 0;
+  if (skipped > 0 || (first_block == last_block && end < std::min((first_block + 1) * block_size, in->coded_samples()))) {
+    ++num_partial;
+  }
+  if (last_block != first_block && end < std::min((last_block + 1) * block_size, in->coded_samples())) {
+    ++num_partial;
+  }
+
+  stats_add(stats->blocks_decoded[in->encoding()], static_cast<uint64_t>(last_block - first_block + 1) * num_channels);
+  stats_add(stats->partial_block_decodes, num_partial * num_channels);
+  stats_add(stats->skipped_samples, skipped * num_channels);
+}
+
+/// @brief Decode coded samples of a channel.
+/// @param out The output buffer.
+/// @param in The packed data.
+/// @param start First sample to decode (relative to the first coded sample).
+/// @param count Number of samples to decode.
+/// @param channel The channel to decode.
+void decode_coded(int16_t *out, const packed_data_t *in, int start, int count, int channel) {
+  switch (in->encoding()) {
+    case SAC_FORMAT_DD4A:
+      dd4a::decode_channel(out, in, start, count, channel);
+      break;
+    case SAC_FORMAT_DD8A:
+      dd8a::decode_channel(out, in, start, count, channel);
+      break;
+    case SAC_FORMAT_UNDEFINED:
+    default:
+      break;
+  }
+}
 
+/// @brief Decode coded samples of a channel through the block cache.
+/// Cache entries that are missing are decoded as a whole, and are inserted
+/// into the cache.
+/// @param cache The block cache.
+/// @param out The output buffer.
+/// @param in The packed data.
+/// @param start First sample to decode (relative to the first coded sample).
+/// @param count Number of samples to decode.
+/// @param channel The channel to decode.
+/// @param stride The output sample stride.
+void decode_cached(block_cache_t *cache, int16_t *out, const packed_data_t *in, int start, int count, int channel, int stride) {
+  int16_t samples[kCacheEntrySamples];
+  const int end = start + count;
+  for (int entry_no = start / kCacheEntrySamples; entry_no * kCacheEntrySamples < end; ++entry_no) {
+    const int entry_start = entry_no * kCacheEntrySamples;
+    if (!cache->lookup(in->data_id(), channel, entry_no, samples)) {
+      const int n = std::min(kCacheEntrySamples, in->coded_samples() - entry_start);
+      count_decode(in, entry_start, n, 1);
+      decode_coded(samples, in, entry_start, n, channel);
+      std::fill(samples + n, samples + kCacheEntrySamples, 0);
+      cache->insert(in->data_id(), channel, entry_no, samples);
+    }
+
+    const int first = std::max(start, entry_start);
+    const int last = std::min(end, entry_start + kCacheEntrySamples);
+    const int16_t *src = samples + (first - entry_start);
+    if (stride == 1) {
+      std::copy(src, src + (last - first), out);
+      out += last - first;
+    } else {
+      for (int k = first; k < last; ++k, out += stride) {
+        *out = *src++;
+      }
+    }
+  }
+}
+
+// The block cache is bypassed if cache is zero.
+void decode_channel(int16_t *out, const packed_data_t *in, int start, int count, int channel, block_cache_t *cache) {
   // Missing input/output buffers?
   if (!in || !out) {
     return;
@@ -58,24 +185,25 @@ void sac_decode_channel(int16_t *out, const sac_packed_data_t *in_, int start, i
     return;
   }
 
-  // Perform format dependent decoding.
-  switch (in->encoding()) {
-    case SAC_FORMAT_DD4A:
-      dd4a::decode_channel(out, in, start, count, channel);
-      break;
-    case SAC_FORMAT_DD8A:
-      dd8a::decode_channel(out, in, start, count, channel);
-      break;
-    case SAC_FORMAT_UNDEFINED:
-    default:
-      break;
+  // Skip the trimmed silence.
+  output_silence(out, in, start, count, 1);
+  if (count < 1) {
+    return;
   }
-}
 
-extern "C"
-void sac_decode_interleaved(int16_t *out, const sac_packed_data_t *in_, int start, int count) {
-  const packed_data_t *in = reinterpret_cast<const packed_data_t*>(in_);
+  if (cache && count <= kMaxCachedSamples) {
+    decode_cached(cache, out, in, start, count, channel, 1);
+    return;
+  }
 
+  count_decode(in, start, count, 1);
+
+  // Perform format dependent decoding.
+  decode_coded(out, in, start, count, channel);
+}
+
+// The block cache is bypassed if cache is zero.
+void decode_interleaved(int16_t *out, const packed_data_t *in, int start, int count, block_cache_t *cache) {
   // Missing input/output buffers?
   if (!in || !out) {
     return;
@@ -93,6 +221,21 @@ void sac_decode_interleaved(int16_t *out, const sac_packed_data_t *in_, int star
     return;
   }
 
+  // Skip the trimmed silence.
+  output_silence(out, in, start, count, in->num_channels());
+  if (count < 1) {
+    return;
+  }
+
+  if (cache && count <= kMaxCachedSamples) {
+    for (int ch = 0; ch < in->num_channels(); ++ch) {
+      decode_cached(cache, out + ch, in, start, count, ch, in->num_channels());
+    }
+    return;
+  }
+
+  count_decode(in, start, count, in->num_channels());
+
   // Perform format dependent decoding.
   switch (in->encoding()) {
     case SAC_FORMAT_DD4A:
@@ -106,3 +249,40 @@ void sac_decode_interleaved(int16_t *out, const sac_packed_data_t *in_, int star
       break;
   }
 }
+
+/// @returns The encoding of the packed data, or zero if there is no data.
+inline int encoding_of(const packed_data_t *data) {
+  return data ? data->encoding() : SAC_FORMAT_UNDEFINED;
+}
+
+} // anonymous namespace
+
+namespace sac {
+
+void decode_uncached(int16_t *out, const packed_data_t *in, int start, int count, int channel) {
+  decode_channel(out, in, start, count, channel, 0);
+}
+
+void decode_interleaved_uncached(int16_t *out, const packed_data_t *in, int start, int count) {
+  decode_interleaved(out, in, start, count, 0);
+}
+
+} // namespace sac
+
+extern "C"
+void sac_decode_channel(int16_t *out, const sac_packed_data_t *in_, int start, int count, int channel) {
+  api_timer_t timer(SAC_API_DECODE_CHANNEL);
+  const packed_data_t *in = reinterpret_cast<const packed_data_t*>(in_);
+  LIBSAC_PROBE5(decode_channel__entry, in_, start, count, channel, encoding_of(in));
+  decode_channel(out, in, start, count, channel, g_block_cache);
+  LIBSAC_PROBE5(decode_channel__return, in_, start, count, channel, encoding_of(in));
+}
+
+extern "C"
+void sac_decode_interleaved(int16_t *out, const sac_packed_data_t *in_, int start, int count) {
+  api_timer_t timer(SAC_API_DECODE_INTERLEAVED);
+  const packed_data_t *in = reinterpret_cast<const packed_data_t*>(in_);
+  LIBSAC_PROBE5(decode_interleaved__entry, in_, start, count, in ? in->num_channels() : 0, encoding_of(in));
+  decode_interleaved(out, in, start, count, g_block_cache);
+  LIBSAC_PROBE5(decode_interleaved__return, in_, start, count, in ? in->num_channels() : 0, encoding_of(in));
+}
@@ -21,155 +21,161 @@
 //     3. This notice may not be removed or altered from any source
 //     distribution.
 //-----------------------------------------------------------------------------
-// 4-bit DDPCM:
-// - 32 samples per block
-// - 18 bytes / block (28.1% of original size)
-// - 64 quantization maps (16 entries per map)
-// - Block format (bit layout):
-//   [ssss|ssss][ssss|smmm][mmmp|D1..][D2..|D3..][D4..|D5..] ... [D30.|D31.]
-//    s: Starting point (13 bits)
-//    m: Map-selection (6 bits)
-//    p: Predictor-selection (1 bit)
-//   Dx: Delta samples (4 bits / delta)
-//-----------------------------------------------------------------------------
-// This decoder is fairly generic, and not very optimized. When performance is
-// critical, and the configuraiton is known, it is recommended that a
-// specialized decoder is written (e.g. if all decoding operations will be
-// block aligned, and only interleaved / non-interleaved output is to be used).
+// 4-bit DDPCM decoder (see format_traits.h for the block format).
+//
+// The decoder is the generic decoder (decoder/decoder.h), instantiated for
+// the DD4A format. Whole blocks are decoded with SIMD kernels, which look up
+// the deltas of 32 codes at a time with byte shuffles, and integrate them
+// with prefix sums (see prefix_sum.h).
 //-----------------------------------------------------------------------------
 
 #include "decoder/decode_dd4a.h"
 
-#include <algorithm>
-
-#include "packed_data.h"
-#include "util.h"
+#include "cpu.h"
+#include "decoder/decoder.h"
 
 namespace sac {
 
-namespace dd4a {
-
-// Defined in quant_lut_dd4a.cpp
-extern const short kQuantLut[64][16];
+typedef decoder_t<format_traits<SAC_FORMAT_DD4A> > dd4a_decoder;
 
 namespace {
 
-int block_size_in_bytes(const int num_samples) {
-  return 2 + (num_samples + 1) / 2;
+#ifdef LIBSAC_USE_X86_SIMD
+/// @brief Split a decoding map (16 entries) into low and high bytes, for use
+/// as byte shuffle tables.
+LIBSAC_TARGET("sse4.1")
+inline void split_map(const short *decode_map, __m128i *table_lo, __m128i *table_hi) {
+  const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(decode_map));
+  const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(decode_map + 8));
+  const __m128i low_byte = _mm_set1_epi16(0xff);
+  *table_lo = _mm_packus_epi16(_mm_and_si128(a, low_byte), _mm_and_si128(b, low_byte));
+  *table_hi = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
 }
 
-const int kBlockSize = 32;
-const int kBytesPerBlock = block_size_in_bytes(kBlockSize);
-
-/// @brief Decode a single block.
-/// @param in Block of data to be decoded.
-/// @param out Decoded output samples.
-/// @param offset First sample in the encoded block to output.
-/// @param count Number of samples to output.
-/// @param stride The output sample stride.
-void decode_block(const uint8_t *in, int16_t *out, int offset, int count, int stride) {
-  // Get the starting sample (16 bits).
-  int16_t s16 = static_cast<int16_t>(in[0]) |
-      (static_cast<int16_t>(in[1]) << 8);
-  int s1 = static_cast<int>(s16);
-  in += 2;
-
-  // Get the first byte.
-  uint8_t byte = *in++;
-
-  // Get the predictor for this block.
-  const int predictor_no = (byte >> 4) & 1;
-
-  // Get the decoding map for this block.
-  const short *decode_map = kQuantLut[((s1 << 3) & 0x38) | (byte >> 5)];
-
-  // Write the first sample to the output stream.
-  if (--offset < 0) {
-    *out = s1;
-    out += stride;
+/// @brief Look up the deltas of the 32 codes in 16 code bytes.
+/// @param deltas The deltas (four vectors of eight 16-bit deltas).
+LIBSAC_TARGET("sse4.1")
+inline void lookup_deltas(const uint8_t *in, __m128i table_lo, __m128i table_hi, __m128i *deltas) {
+  const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  const __m128i nibble = _mm_set1_epi8(15);
+  const __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+  const __m128i lo = _mm_and_si128(bytes, nibble);
+
+  // The codes are packed MSB first.
+  const __m128i codes[2] = {_mm_unpacklo_epi8(hi, lo), _mm_unpackhi_epi8(hi, lo)};
+  for (int i = 0; i < 2; ++i) {
+    const __m128i delta_lo = _mm_shuffle_epi8(table_lo, codes[i]);
+    const __m128i delta_hi = _mm_shuffle_epi8(table_hi, codes[i]);
+    deltas[2 * i] = _mm_unpacklo_epi8(delta_lo, delta_hi);
+    deltas[2 * i + 1] = _mm_unpackhi_epi8(delta_lo, delta_hi);
   }
+}
 
-  // Unroll the loop modulo 2 in order to make the handling of nibbles
-  // efficient.
-  int s2 = s1;
-  int nibbles_left = count - 1;
-  for (; nibbles_left >= 2; nibbles_left -= 2) {
-    // Decode and clamp.
-    int predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
-    s2 = s1;
-    s1 = clamp(predicted + decode_map[byte & 15]);
-
-    // Write sample to the output stream.
-    if (--offset < 0) {
-      *out = s1;
-      out += stride;
+template <int PREDICTOR>
+LIBSAC_TARGET("sse4.1")
+bool decode_block_sse41(int start, const short *decode_map, const uint8_t *in, int num_samples, int16_t *out) {
+  __m128i table_lo, table_hi;
+  split_map(decode_map, &table_lo, &table_hi);
+  integration4_t state;
+  init_integration(&state, start);
+  for (int k = 0; k < num_samples; k += 32) {
+    __m128i deltas[4];
+    lookup_deltas(in + k / 2, table_lo, table_hi, deltas);
+    if (k == 0) {
+      // The first code is the header code (the delta of the first sample is
+      // zero).
+      deltas[0] = _mm_blend_epi16(deltas[0], _mm_setzero_si128(), 1);
     }
+    for (int i = 0; i < 4; ++i) {
+      const __m128i x0 = integrate<PREDICTOR>(&state, _mm_cvtepi16_epi32(deltas[i]));
+      const __m128i x1 = integrate<PREDICTOR>(&state, _mm_cvtepi16_epi32(_mm_srli_si128(deltas[i], 8)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[k + 8 * i]), _mm_packs_epi32(x0, x1));
+    }
+  }
+  return in_range(state);
+}
 
-    // Get the next encoded byte from the input stream.
-    byte = *in++;
+template <int PREDICTOR>
+LIBSAC_TARGET("avx2")
+bool decode_block_avx2(int start, const short *decode_map, const uint8_t *in, int num_samples, int16_t *out) {
+  __m128i table_lo, table_hi;
+  split_map(decode_map, &table_lo, &table_hi);
+  integration8_t state;
+  init_integration(&state, start);
+  for (int k = 0; k < num_samples; k += 32) {
+    __m128i deltas[4];
+    lookup_deltas(in + k / 2, table_lo, table_hi, deltas);
+    if (k == 0) {
+      // The first code is the header code (the delta of the first sample is
+      // zero).
+      deltas[0] = _mm_blend_epi16(deltas[0], _mm_setzero_si128(), 1);
+    }
+    for (int i = 0; i < 4; ++i) {
+      const __m256i x = integrate<PREDICTOR>(&state, _mm256_cvtepi16_epi32(deltas[i]));
+      const __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[k + 8 * i]), packed);
+    }
+  }
+  return in_range(state);
+}
+#endif // LIBSAC_USE_X86_SIMD
 
-    // Decode and clamp.
-    predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
-    s2 = s1;
-    s1 = clamp(predicted + decode_map[byte >> 4]);
+// The block kernels for the current CPU level (per predictor).
+block_kernel_t s_block_kernels[2];
 
-    // Write sample to the output stream.
-    if (--offset < 0) {
-      *out = s1;
-      out += stride;
-    }
+void select_block_kernels(sac_cpu_level_t level) {
+#ifdef LIBSAC_USE_X86_SIMD
+  if (level >= SAC_CPU_AVX2) {
+    store_release(s_block_kernels[0], decode_block_avx2<0>);
+    store_release(s_block_kernels[1], decode_block_avx2<1>);
+    return;
   }
-  if (nibbles_left && --offset < 0) {
-    // Decode, clamp and write sample to the output stream.
-    int predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
-    *out = clamp(predicted + decode_map[byte & 15]);
+  if (level >= SAC_CPU_SSE41) {
+    store_release(s_block_kernels[0], decode_block_sse41<0>);
+    store_release(s_block_kernels[1], decode_block_sse41<1>);
+    return;
   }
+#else
+  (void)level;
+#endif
+  store_release(s_block_kernels[0], 0);
+  store_release(s_block_kernels[1], 0);
 }
 
+kernel_table_t s_kernel_table = {select_block_kernels, 0, 0};
+
 } // anonymous namespace
 
-void decode_channel(int16_t *out, const packed_data_t *in, int start, int count, int channel) {
-  int start_block = start / kBlockSize;
-  int offset = start - start_block * kBlockSize;
-
-  // src points to the first block.
-  uint8_t *src = in->data() + (start_block * in->num_channels() + channel) * kBytesPerBlock;
-
-  // Decode as many blocks as required.
-  while (count > 0) {
-    int local_count = std::min(kBlockSize - offset, count);
-    decode_block(src, out, offset, local_count, 1);
-    src += kBytesPerBlock * in->num_channels();
-    out += local_count;
-    count -= local_count;
-
-    // After the first pass, we are block aligned.
-    offset = 0;
+template <>
+block_kernel_t dd4a_decoder::block_kernel(int predictor_no, int num_samples, bool clamp_free) {
+  // The kernels decode 32 samples (16 code bytes) at a time, and never read
+  // past the codes of the last decoded sample.
+  (void)clamp_free;
+  if (num_samples % 32 != 0) {
+    return 0;
   }
+  use_kernels(s_kernel_table);
+  return load_acquire(s_block_kernels[predictor_no]);
 }
 
-void decode_interleaved(int16_t *out, const packed_data_t *in, int start, int count) {
-  const int start_block = start / kBlockSize;
-  int offset = start - start_block * kBlockSize;
-
-  // src points to the first block.
-  uint8_t *src = in->data() + (start_block * in->num_channels()) * kBytesPerBlock;
-
-  // Decode as many blocks as required.
-  while (count > 0) {
-    int local_count = std::min(kBlockSize - offset, count);
-    int16_t *out2 = out;
-    for (int ch = 0; ch < in->num_channels(); ch++) {
-      decode_block(src, out2, offset, local_count, in->num_channels());
-      src += kBytesPerBlock;
-      out2++;
-    }
-    out += local_count * in->num_channels();
-    count -= local_count;
+namespace dd4a {
 
-    // After the first pass, we are block aligned.
-    offset = 0;
-  }
+namespace {
+
+typedef dd4a_decoder decoder;
+
+} // anonymous namespace
+
+void decode_block(const uint8_t *header, const uint8_t *in, int16_t *out, int offset, int count, int stride, bool clamp_free) {
+  decoder::decode_block(header, in, out, offset, count, stride, clamp_free);
+}
+
+void decode_channel(int16_t *out, const packed_data_t *in, int start, int count, int channel) {
+  decoder::decode_channel(out, in, start, count, channel);
+}
+
+void decode_interleaved(int16_t *out, const packed_data_t *in, int start, int count) {
+  decoder::decode_interleaved(out, in, start, count);
 }
 
 } // namespace dd4a
@@ -21,136 +21,125 @@
 //     3. This notice may not be removed or altered from any source
 //     distribution.
 //-----------------------------------------------------------------------------
-// 8-bit DDPCM:
-// - 16 samples per block
-// - 17 bytes / block (53.1% of original size)
-// - 8 quantization maps (256 entires per map)
-// - Block format (bit layout):
-//   [ssss|ssss][ssss|mmmp][D1......][D2......][D3......] ... [D15......]
-//    s: Starting point (12 bits)
-//    m: Map-selection (3 bits)
-//    p: Predictor-selection (1 bit)
-//   Dx: Delta samples (8 bits / delta)
-//-----------------------------------------------------------------------------
-// This decoder is fairly generic, and not very optimized. When performance is
-// critical, and the configuraiton is known, it is recommended that a
-// specialized decoder is written (e.g. if all decoding operations will be
-// block aligned, and only interleaved / non-interleaved output is to be used).
+// 8-bit DDPCM decoder (see format_traits.h for the block format).
+//
+// The decoder is the generic decoder (decoder/decoder.h), instantiated for
+// the DD8A format. Whole blocks are decoded with SIMD kernels, which look up
+// the deltas one code at a time (the maps are too large for byte shuffles),
+// and integrate them with prefix sums (see prefix_sum.h).
 //-----------------------------------------------------------------------------
 
 #include "decoder/decode_dd8a.h"
 
-#include <algorithm>
-
-#include "packed_data.h"
-#include "util.h"
+#include "cpu.h"
+#include "decoder/decoder.h"
 
 namespace sac {
 
-namespace dd8a {
-
-// Defined in quant_lut_dd8a.cpp
-extern const short kQuantLut[8][256];
+typedef decoder_t<format_traits<SAC_FORMAT_DD8A> > dd8a_decoder;
 
 namespace {
 
-int block_size_in_bytes(int num_samples) {
-  return num_samples + 1;
+#ifdef LIBSAC_USE_X86_SIMD
+// Note: The code of sample k (k >= 1) is in[k - 1], and the delta of the
+// first sample is zero.
+
+template <int PREDICTOR>
+LIBSAC_TARGET("sse2")
+bool decode_block_sse2(int start, const short *decode_map, const uint8_t *in, int num_samples, int16_t *out) {
+  integration4_t state;
+  init_integration(&state, start);
+  __m128i x0 = integrate<PREDICTOR>(&state, _mm_set_epi32(decode_map[in[2]], decode_map[in[1]], decode_map[in[0]], 0));
+  for (int k = 4; k < num_samples; k += 8) {
+    const uint8_t *c = in + k - 1;
+    const __m128i x1 = integrate<PREDICTOR>(&state, _mm_set_epi32(decode_map[c[3]], decode_map[c[2]], decode_map[c[1]], decode_map[c[0]]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[k - 4]), _mm_packs_epi32(x0, x1));
+    if (k + 4 < num_samples) {
+      x0 = integrate<PREDICTOR>(&state, _mm_set_epi32(decode_map[c[7]], decode_map[c[6]], decode_map[c[5]], decode_map[c[4]]));
+    }
+  }
+  return in_range(state);
 }
 
-const int kBlockSize = 16;
-const int kBytesPerBlock = block_size_in_bytes(kBlockSize);
-
-/// @brief Decode a single block.
-/// @param in Block of data to be decoded.
-/// @param out Decoded output samples.
-/// @param offset First sample in the encoded block to output.
-/// @param count Number of samples to output.
-/// @param stride The output sample stride.
-void decode_block(const uint8_t *in, int16_t *out, int offset, int count, int stride) {
-  // Get the starting sample (16 bits).
-  int16_t s16 = static_cast<int16_t>(in[0]) |
-      (static_cast<int16_t>(in[1]) << 8);
-  int s1 = static_cast<int>(s16);
-  in += 2;
-
-  // Get the predictor for this block.
-  const int predictor_no = s1 & 1;
-
-  // Get the decoding map for this block.
-  const short *decode_map = kQuantLut[(s1 >> 1) & 7];
-
-  int s2 = s1;
-
-  // Decode but don't output offset samples.
-  for (int i = 0; i < offset; ++i) {
-    int predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
-    s2 = s1;
-    s1 = clamp(predicted + decode_map[*in++]);
+template <int PREDICTOR>
+LIBSAC_TARGET("avx2")
+bool decode_block_avx2(int start, const short *decode_map, const uint8_t *in, int num_samples, int16_t *out) {
+  integration8_t state;
+  init_integration(&state, start);
+  for (int k = 0; k < num_samples; k += 8) {
+    __m256i deltas;
+    if (k == 0) {
+      deltas = _mm256_set_epi32(decode_map[in[6]], decode_map[in[5]], decode_map[in[4]], decode_map[in[3]],
+                                decode_map[in[2]], decode_map[in[1]], decode_map[in[0]], 0);
+    } else {
+      const uint8_t *c = in + k - 1;
+      deltas = _mm256_set_epi32(decode_map[c[7]], decode_map[c[6]], decode_map[c[5]], decode_map[c[4]],
+                                decode_map[c[3]], decode_map[c[2]], decode_map[c[1]], decode_map[c[0]]);
+    }
+    const __m256i x = integrate<PREDICTOR>(&state, deltas);
+    const __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[k]), packed);
   }
+  return in_range(state);
+}
+#endif // LIBSAC_USE_X86_SIMD
 
-  // Write the first sample to the output stream.
-  *out = s1;
-  out += stride;
+// The block kernels for the current CPU level (per predictor).
+block_kernel_t s_block_kernels[2];
 
-  for (int i = 1; i < count; ++i) {
-    // Predict the next sample.
-    int predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
+void select_block_kernels(sac_cpu_level_t level) {
+#ifdef LIBSAC_USE_X86_SIMD
+  if (level >= SAC_CPU_AVX2) {
+    store_release(s_block_kernels[0], decode_block_avx2<0>);
+    store_release(s_block_kernels[1], decode_block_avx2<1>);
+    return;
+  }
+  if (level >= SAC_CPU_SSE2) {
+    store_release(s_block_kernels[0], decode_block_sse2<0>);
+    store_release(s_block_kernels[1], decode_block_sse2<1>);
+    return;
+  }
+#else
+  (void)level;
+#endif
+  store_release(s_block_kernels[0], 0);
+  store_release(s_block_kernels[1], 0);
+}
 
-    // Decode and clamp.
-    s2 = s1;
-    s1 = clamp(predicted + decode_map[*in++]);
+kernel_table_t s_kernel_table = {select_block_kernels, 0, 0};
 
-    // Write sample to the output stream.
-    *out = s1;
-    out += stride;
+} // anonymous namespace
+
+template <>
+block_kernel_t dd8a_decoder::block_kernel(int predictor_no, int num_samples, bool clamp_free) {
+  // The kernels decode eight samples at a time, and never read past the code
+  // of the last decoded sample. They only pay off for blocks that may need
+  // clamping, since the table lookups are not vectorized.
+  if (clamp_free || num_samples % 8 != 0) {
+    return 0;
   }
+  use_kernels(s_kernel_table);
+  return load_acquire(s_block_kernels[predictor_no]);
 }
 
+namespace dd8a {
+
+namespace {
+
+typedef dd8a_decoder decoder;
+
 } // anonymous namespace
 
+void decode_block(const uint8_t *header, const uint8_t *in, int16_t *out, int offset, int count, int stride, bool clamp_free) {
+  decoder::decode_block(header, in, out, offset, count, stride, clamp_free);
+}
+
 void decode_channel(int16_t *out, const packed_data_t *in, int start, int count, int channel) {
-  int start_block = start / kBlockSize;
-  int offset = start - start_block * kBlockSize;
-
-  // src points to the first block.
-  uint8_t *src = in->data() + (start_block * in->num_channels() + channel) * kBytesPerBlock;
-
-  // Decode as many blocks as required.
-  while (count > 0) {
-    int local_count = std::min(kBlockSize - offset, count);
-    decode_block(src, out, offset, local_count, 1);
-    src += kBytesPerBlock * in->num_channels();
-    out += local_count;
-    count -= local_count;
-
-    // After the first pass, we are block aligned.
-    offset = 0;
-  }
+  decoder::decode_channel(out, in, start, count, channel);
 }
 
 void decode_interleaved(int16_t *out, const packed_data_t *in, int start, int count) {
-  const int start_block = start / kBlockSize;
-  int offset = start - start_block * kBlockSize;
-
-  // src points to the first block.
-  uint8_t *src = in->data() + (start_block * in->num_channels()) * kBytesPerBlock;
-
-  // Decode as many blocks as required.
-  while (count > 0) {
-    int local_count = std::min(kBlockSize - offset, count);
-    int16_t *out2 = out;
-    for (int ch = 0; ch < in->num_channels(); ch++) {
-      decode_block(src, out2, offset, local_count, in->num_channels());
-      src += kBytesPerBlock;
-      out2++;
-    }
-    out += local_count * in->num_channels();
-    count -= local_count;
-
-    // After the first pass, we are block aligned.
-    offset = 0;
-  }
+  decoder::decode_interleaved(out, in, start, count);
 }
 
 } // namespace dd8a
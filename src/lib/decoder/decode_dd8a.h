@@ -32,6 +32,15 @@ namespace sac {
 
 namespace dd8a {
 
+/// @brief Decode a single block.
+/// @param header The block header.
+/// @param in The block codes.
+/// @param out Decoded output samples.
+/// @param offset First sample in the encoded block to output.
+/// @param count Number of samples to output.
+/// @param stride The output sample stride.
+void decode_block(const uint8_t *header, const uint8_t *in, int16_t *out, int offset, int count, int stride, bool clamp_free = false);
+
 void decode_channel(int16_t *out, const packed_data_t *in, int start, int count, int channel);
 
 void decode_interleaved(int16_t *out, const packed_data_t *in, int start, int count);
@@ -0,0 +1,457 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Generic DDPCM decoder, instantiated for each format from its format traits
+// (see format_traits.h).
+//-----------------------------------------------------------------------------
+// This decoder is fairly generic, and not very optimized. When performance is
+// critical, and the configuraiton is known, it is recommended that a
+// specialized decoder is written (e.g. if all decoding operations will be
+// block aligned, and only interleaved / non-interleaved output is to be used).
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_DECODER_H_
+#define LIBSAC_DECODER_H_
+
+#include <algorithm>
+
+#include "decoder/interleave.h"
+#include "decoder/prefix_sum.h"
+#include "format_traits.h"
+#include "packed_data.h"
+#include "util.h"
+
+namespace sac {
+
+template <class FORMAT>
+struct decoder_t {
+  typedef typename FORMAT::codes codes;
+
+  /// @brief Decode a single sample.
+  /// @param s1 The previous sample (updated to the decoded sample).
+  /// @param s2 The sample before the previous sample (updated to s1).
+  /// @param predictor_no The predictor to use.
+  /// @param decode_map The decoding map.
+  /// @param code The code to decode.
+  /// The sample is only clamped if CLAMP is true (for blocks that are known to
+  /// be clamp free, clamping would not change the result).
+  template <bool CLAMP>
+  static void decode_sample(int &s1, int &s2, int predictor_no, const short *decode_map, int code) {
+    // Predict the next sample.
+    const int predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
+
+    // Decode and clamp.
+    s2 = s1;
+    s1 = CLAMP ? clamp(predicted + decode_map[code]) : predicted + decode_map[code];
+  }
+
+  /// @brief Decode a range of codes.
+  /// The codes are read one byte at a time where possible, which lets the
+  /// compiler resolve the position of each code within the byte.
+  /// @param in The block codes.
+  /// @param i The first code to decode (updated to end).
+  /// @param end One past the last code to decode.
+  /// @param out Decoded output samples (only written if OUTPUT is true).
+  template <bool OUTPUT, bool CLAMP>
+  static void decode_codes(const uint8_t *in, int &i, int end, int &s1, int &s2, int predictor_no, const short *decode_map, int16_t *&out, int stride) {
+    // Decode codes one at a time up to a byte boundary...
+    const int kCodesPerByte = codes::kCodesPerByte;
+    for (; i < end && (i % kCodesPerByte) != 0; ++i) {
+      decode_sample<CLAMP>(s1, s2, predictor_no, decode_map, codes::get(in, i));
+      if (OUTPUT) {
+        *out = s1;
+        out += stride;
+      }
+    }
+
+    // ...then one byte at a time (the inner loop is unrolled by the compiler)...
+    for (; i + kCodesPerByte <= end; i += kCodesPerByte) {
+      const int byte = in[i / kCodesPerByte];
+      for (int n = 0; n < kCodesPerByte; ++n) {
+        decode_sample<CLAMP>(s1, s2, predictor_no, decode_map, codes::unpack(byte, n));
+        if (OUTPUT) {
+          *out = s1;
+          out += stride;
+        }
+      }
+    }
+
+    // ...and finally the remaining codes of a partial byte.
+    for (; i < end; ++i) {
+      decode_sample<CLAMP>(s1, s2, predictor_no, decode_map, codes::get(in, i));
+      if (OUTPUT) {
+        *out = s1;
+        out += stride;
+      }
+    }
+  }
+
+  /// @brief Get a SIMD block decoder kernel (see prefix_sum.h).
+  /// This is defined for each format (in decode_dd4a.cpp and decode_dd8a.cpp).
+  /// @param predictor_no The predictor of the block.
+  /// @param num_samples Number of samples to decode.
+  /// @param clamp_free true if the block is known to decode without clamping.
+  /// @returns The kernel, or zero if the scalar decoder should be used (e.g.
+  /// if there is no kernel for the current CPU level).
+  static block_kernel_t block_kernel(int predictor_no, int num_samples, bool clamp_free);
+
+  /// @brief Get the starting sample from the block header (16 bits).
+  static int block_start(const uint8_t *header) {
+    return static_cast<int16_t>(header[0] | (header[1] << 8));
+  }
+
+  /// @brief Load the starting samples of the blocks of a superblock from its
+  /// (cache line aligned) header array.
+  /// @param headers The header array.
+  /// @param count Number of blocks in the superblock.
+  /// @param starts Set to the starting sample of each block.
+  static void load_block_starts(const uint8_t *headers, int count, int16_t *starts) {
+    for (int i = 0; i < count; ++i) {
+      starts[i] = static_cast<int16_t>(headers[2 * i] | (headers[2 * i + 1] << 8));
+    }
+  }
+
+  /// @brief Get the block parameters from the starting sample of the block.
+  /// @param start The starting sample.
+  /// @param in The block codes.
+  /// @param predictor_no Set to the predictor.
+  /// @returns The decoding map.
+  static const short *unpack_block(int start, const uint8_t *in, int *predictor_no) {
+    // Get the predictor and the decoding map for this block.
+    int map_no;
+    FORMAT::unpack_header(start, in, &map_no, predictor_no);
+    return FORMAT::lut()[map_no];
+  }
+
+  /// @brief Decode a single block.
+  /// @param header The block header.
+  /// @param in The block codes.
+  /// @param out Decoded output samples.
+  /// @param offset First sample in the encoded block to output.
+  /// @param count Number of samples to output.
+  /// @param stride The output sample stride.
+  /// @param clamp_free true if the block is known to decode without clamping.
+  static void decode_block(const uint8_t *header, const uint8_t *in, int16_t *out, int offset, int count, int stride, bool clamp_free = false) {
+    decode_block(block_start(header), in, out, offset, count, stride, clamp_free);
+  }
+
+  /// @brief Decode a single block (see above), given the starting sample of
+  /// the block rather than the block header.
+  static void decode_block(int start, const uint8_t *in, int16_t *out, int offset, int count, int stride, bool clamp_free) {
+    if (decode_block_simd(start, in, out, offset, count, stride, clamp_free)) {
+      return;
+    }
+    if (clamp_free) {
+      decode_block_impl<false>(start, in, out, offset, count, stride);
+    } else {
+      decode_block_impl<true>(start, in, out, offset, count, stride);
+    }
+  }
+
+  /// @brief Decode a single block (see decode_block) with a SIMD block
+  /// kernel.
+  /// @returns false if there is no kernel for the block, or if the block
+  /// needs clamping (nothing is output in that case).
+  static bool decode_block_simd(int start, const uint8_t *in, int16_t *out, int offset, int count, int stride, bool clamp_free) {
+    int predictor_no;
+    const short *decode_map = unpack_block(start, in, &predictor_no);
+    const int num_samples = offset + count;
+    const block_kernel_t kernel = block_kernel(predictor_no, num_samples, clamp_free);
+    int16_t samples[kMaxBlockSize + 16];
+    if (!kernel || !kernel(start, decode_map, in, num_samples, samples)) {
+      return false;
+    }
+
+    const int16_t *src = samples + offset;
+    if (stride == 1) {
+      std::copy(src, src + count, out);
+      return true;
+    }
+    for (int k = 0; k < count; ++k, out += stride) {
+      *out = src[k];
+    }
+    return true;
+  }
+
+  /// @brief Decode a single block (see decode_block) with the scalar decoder,
+  /// with or without clamping.
+  template <bool CLAMP>
+  static void decode_block_impl(int start, const uint8_t *in, int16_t *out, int offset, int count, int stride) {
+    int predictor_no;
+    const short *decode_map = unpack_block(start, in, &predictor_no);
+    int s1 = start;
+    int s2 = s1;
+
+    // Code index of the next sample, and the end of the codes to decode.
+    int i = FORMAT::kHeaderCodes;
+    const int skip_end = i + offset;
+    const int end = skip_end + count - 1;
+
+    // Decode but don't output offset samples.
+    decode_codes<false, CLAMP>(in, i, skip_end, s1, s2, predictor_no, decode_map, out, stride);
+
+    // Write the first sample to the output stream.
+    *out = s1;
+    out += stride;
+
+    // Decode and output the remaining samples.
+    decode_codes<true, CLAMP>(in, i, end, s1, s2, predictor_no, decode_map, out, stride);
+  }
+
+  /// @brief Output the samples of a constant block.
+  static void fill_block(int16_t *out, int16_t value, int count, int stride) {
+    if (stride == 1) {
+      std::fill(out, out + count, value);
+      return;
+    }
+    for (int i = 0; i < count; ++i, out += stride) {
+      *out = value;
+    }
+  }
+
+  static void decode_channel(int16_t *out, const packed_data_t *in, int start, int count, int channel) {
+    if (in->blocks().blocks_per_sb() > 1) {
+      decode_channel_superblocks(out, in, start, count, channel);
+      return;
+    }
+
+    const int block_size = in->block_size();
+    int start_block = start / block_size;
+    int offset = start - start_block * block_size;
+
+    // Decode as many blocks as required.
+    int block_no = start_block;
+    while (count > 0) {
+      int local_count = std::min(block_size - offset, count);
+      block_offsets_t block;
+      int16_t value;
+      if (in->locate_block(block_no, channel, &block, &value)) {
+        decode_block(in->data() + block.header, in->data() + block.codes, out, offset, local_count, 1, in->is_clamp_free(block_no, channel));
+      } else {
+        fill_block(out, value, local_count, 1);
+      }
+      ++block_no;
+      out += local_count;
+      count -= local_count;
+
+      // After the first pass, we are block aligned.
+      offset = 0;
+    }
+  }
+
+  /// @brief Decode the samples of a channel of a superblock layout.
+  /// The block headers of each superblock are loaded from its header array
+  /// up front, and the blocks are then decoded from its codes.
+  static void decode_channel_superblocks(int16_t *out, const packed_data_t *in, int start, int count, int channel) {
+    const block_layout_t &blocks = in->blocks();
+    const int block_size = blocks.block_size();
+    const int blocks_per_sb = blocks.blocks_per_sb();
+    int block_no = start / block_size;
+    int offset = start - block_no * block_size;
+    int16_t starts[block_layout_t::kBlocksPerSuperblock];
+
+    // Decode as many superblocks as required.
+    while (count > 0) {
+      const int sb_row = block_no / blocks_per_sb;
+      const int sb_first = sb_row * blocks_per_sb;
+      const int sb_blocks = blocks.sb_blocks(sb_row);
+      const int sb_offset = blocks.superblock(sb_row, channel).offset;
+      load_block_starts(in->data() + sb_offset, sb_blocks, starts);
+      for (; count > 0 && block_no < sb_first + sb_blocks; ++block_no) {
+        const int local_count = std::min(block_size - offset, count);
+        const int sb_block = block_no - sb_first;
+        decode_block(starts[sb_block], in->data() + blocks.sb_codes(sb_offset, sb_row, sb_block), out, offset, local_count, 1, in->is_clamp_free(block_no, channel));
+        out += local_count;
+        count -= local_count;
+
+        // After the first pass, we are block aligned.
+        offset = 0;
+      }
+    }
+  }
+
+  /// @brief Decode a single block into a row of a tile.
+  /// Unlike decode_block, the samples are output at row + offset, which lets
+  /// the SIMD block kernels decode directly into the row.
+  /// @param start The starting sample of the block.
+  /// @param row The tile row (kMaxBlockSize samples).
+  static void decode_tile_row(int start, const uint8_t *in, int16_t *row, int offset, int count, bool clamp_free) {
+    int predictor_no;
+    const short *decode_map = unpack_block(start, in, &predictor_no);
+    const block_kernel_t kernel = block_kernel(predictor_no, offset + count, clamp_free);
+    if (kernel && kernel(start, decode_map, in, offset + count, row)) {
+      return;
+    }
+    if (clamp_free) {
+      decode_block_impl<false>(start, in, row + offset, offset, count, 1);
+    } else {
+      decode_block_impl<true>(start, in, row + offset, offset, count, 1);
+    }
+  }
+
+  /// @brief Decode interleaved samples.
+  /// When whole blocks are decoded with SIMD block kernels, each block row is
+  /// decoded into a small planar tile, kTileChannels channels at a time, and
+  /// the tile is then interleaved into whole frames with SIMD transposes.
+  /// This keeps the kernels on their contiguous path, and writes the output
+  /// sequentially. The scalar decoder writes each sample separately anyway,
+  /// so it writes directly to the output, with a stride.
+  static void decode_interleaved(int16_t *out, const packed_data_t *in, int start, int count) {
+    const int num_channels = in->num_channels();
+    if (num_channels == 1) {
+      decode_channel(out, in, start, count, 0);
+    } else if (in->blocks().blocks_per_sb() > 1) {
+      decode_interleaved_superblocks(out, in, start, count);
+    } else if (block_kernel(0, in->block_size(), in->clamp_map() != 0)) {
+      decode_interleaved_tiled(out, in, start, count);
+    } else {
+      decode_interleaved_strided(out, in, start, count);
+    }
+  }
+
+  static void decode_interleaved_tiled(int16_t *out, const packed_data_t *in, int start, int count) {
+    const int num_channels = in->num_channels();
+    const int block_size = in->block_size();
+    const int start_block = start / block_size;
+    int offset = start - start_block * block_size;
+
+    // The tile (8 KB) stays in the L1 cache.
+    const int kTileChannels = 32;
+    int16_t tile[kTileChannels * kMaxBlockSize];
+
+    // Decode as many blocks as required.
+    int block_no = start_block;
+    while (count > 0) {
+      int local_count = std::min(block_size - offset, count);
+      for (int first_ch = 0; first_ch < num_channels; first_ch += kTileChannels) {
+        const int tile_channels = std::min(kTileChannels, num_channels - first_ch);
+        for (int i = 0; i < tile_channels; ++i) {
+          const int ch = first_ch + i;
+          int16_t *row = tile + i * kMaxBlockSize;
+          block_offsets_t block;
+          int16_t value;
+          if (in->locate_block(block_no, ch, &block, &value)) {
+            decode_tile_row(block_start(in->data() + block.header), in->data() + block.codes, row, offset, local_count, in->is_clamp_free(block_no, ch));
+          } else {
+            fill_block(row + offset, value, local_count, 1);
+          }
+        }
+        interleave_tile(tile + offset, kMaxBlockSize, tile_channels, out + first_ch, num_channels, local_count);
+      }
+      ++block_no;
+      out += local_count * num_channels;
+      count -= local_count;
+
+      // After the first pass, we are block aligned.
+      offset = 0;
+    }
+  }
+
+  /// @brief Decode interleaved samples of a superblock layout.
+  /// Like decode_interleaved_tiled (also for the scalar decoder), but one
+  /// superblock row at a time: the block headers of the superblocks of a
+  /// tile are loaded from their header arrays up front, and all the blocks of
+  /// the superblocks are then decoded through the tile.
+  static void decode_interleaved_superblocks(int16_t *out, const packed_data_t *in, int start, int count) {
+    const block_layout_t &blocks = in->blocks();
+    const int num_channels = in->num_channels();
+    const int block_size = blocks.block_size();
+    const int blocks_per_sb = blocks.blocks_per_sb();
+    int block_no = start / block_size;
+    int offset = start - block_no * block_size;
+    // The tile (8 KB) stays in the L1 cache.
+    const int kTileChannels = 32;
+    int16_t tile[kTileChannels * kMaxBlockSize];
+    int16_t starts[kTileChannels * block_layout_t::kBlocksPerSuperblock];
+    int sb_offsets[kTileChannels];
+
+    // Decode as many superblock rows as required.
+    while (count > 0) {
+      const int sb_row = block_no / blocks_per_sb;
+      const int sb_first = sb_row * blocks_per_sb;
+      const int sb_blocks = blocks.sb_blocks(sb_row);
+      const int row_count = std::min((sb_first + sb_blocks - block_no) * block_size - offset, count);
+      for (int first_ch = 0; first_ch < num_channels; first_ch += kTileChannels) {
+        const int tile_channels = std::min(kTileChannels, num_channels - first_ch);
+        for (int i = 0; i < tile_channels; ++i) {
+          sb_offsets[i] = blocks.superblock(sb_row, first_ch + i).offset;
+          load_block_starts(in->data() + sb_offsets[i], sb_blocks, starts + i * block_layout_t::kBlocksPerSuperblock);
+        }
+
+        int16_t *tile_out = out + first_ch;
+        int block_offset = offset;
+        for (int k = block_no, done = 0; done < row_count; ++k) {
+          const int local_count = std::min(block_size - block_offset, row_count - done);
+          const int sb_block = k - sb_first;
+          for (int i = 0; i < tile_channels; ++i) {
+            const uint8_t *codes = in->data() + blocks.sb_codes(sb_offsets[i], sb_row, sb_block);
+            decode_tile_row(starts[i * block_layout_t::kBlocksPerSuperblock + sb_block], codes, tile + i * kMaxBlockSize, block_offset, local_count, in->is_clamp_free(k, first_ch + i));
+          }
+          interleave_tile(tile + block_offset, kMaxBlockSize, tile_channels, tile_out, num_channels, local_count);
+          tile_out += local_count * num_channels;
+          done += local_count;
+
+          // After the first block, we are block aligned.
+          block_offset = 0;
+        }
+      }
+      block_no = sb_first + sb_blocks;
+      out += row_count * num_channels;
+      count -= row_count;
+      offset = 0;
+    }
+  }
+
+  static void decode_interleaved_strided(int16_t *out, const packed_data_t *in, int start, int count) {
+    const int block_size = in->block_size();
+    const int start_block = start / block_size;
+    int offset = start - start_block * block_size;
+
+    // Decode as many blocks as required.
+    int block_no = start_block;
+    while (count > 0) {
+      int local_count = std::min(block_size - offset, count);
+      int16_t *out2 = out;
+      for (int ch = 0; ch < in->num_channels(); ch++) {
+        block_offsets_t block;
+        int16_t value;
+        if (in->locate_block(block_no, ch, &block, &value)) {
+          decode_block(in->data() + block.header, in->data() + block.codes, out2, offset, local_count, in->num_channels(), in->is_clamp_free(block_no, ch));
+        } else {
+          fill_block(out2, value, local_count, in->num_channels());
+        }
+        out2++;
+      }
+      ++block_no;
+      out += local_count * in->num_channels();
+      count -= local_count;
+
+      // After the first pass, we are block aligned.
+      offset = 0;
+    }
+  }
+};
+
+} // namespace sac
+
+#endif // LIBSAC_DECODER_H_
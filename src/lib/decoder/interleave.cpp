@@ -0,0 +1,289 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+#include "decoder/interleave.h"
+
+#include <algorithm>
+
+#include "cpu.h"
+#include "decoder/prefix_sum.h"
+
+namespace sac {
+
+namespace {
+
+/// @brief Interleave the frames first_frame..num_frames-1 of a tile with
+/// NUM_CHANNELS channels (the channel loop is unrolled by the compiler).
+template <int NUM_CHANNELS>
+void interleave_fixed(const int16_t *tile, int tile_stride, int16_t *out, int frame_size, int first_frame, int num_frames) {
+  for (int k = first_frame; k < num_frames; ++k) {
+    int16_t *dst = out + k * frame_size;
+    for (int ch = 0; ch < NUM_CHANNELS; ++ch) {
+      dst[ch] = tile[ch * tile_stride + k];
+    }
+  }
+}
+
+/// @brief Interleave the frames first_frame..num_frames-1 of a tile.
+void interleave_generic(const int16_t *tile, int tile_stride, int num_channels, int16_t *out, int frame_size, int first_frame, int num_frames) {
+  switch (num_channels) {
+    case 0:
+      return;
+    case 1:
+      interleave_fixed<1>(tile, tile_stride, out, frame_size, first_frame, num_frames);
+      return;
+    case 2:
+      interleave_fixed<2>(tile, tile_stride, out, frame_size, first_frame, num_frames);
+      return;
+    case 3:
+      interleave_fixed<3>(tile, tile_stride, out, frame_size, first_frame, num_frames);
+      return;
+    case 4:
+      interleave_fixed<4>(tile, tile_stride, out, frame_size, first_frame, num_frames);
+      return;
+    case 5:
+      interleave_fixed<5>(tile, tile_stride, out, frame_size, first_frame, num_frames);
+      return;
+    case 6:
+      interleave_fixed<6>(tile, tile_stride, out, frame_size, first_frame, num_frames);
+      return;
+    case 7:
+      interleave_fixed<7>(tile, tile_stride, out, frame_size, first_frame, num_frames);
+      return;
+    default:
+      break;
+  }
+
+  // Many channels: Write each frame in groups of eight channels.
+  const int num_groups = num_channels & ~7;
+  for (int ch = 0; ch < num_groups; ch += 8) {
+    interleave_fixed<8>(tile + ch * tile_stride, tile_stride, out + ch, frame_size, first_frame, num_frames);
+  }
+  interleave_generic(tile + num_groups * tile_stride, tile_stride, num_channels - num_groups, out + num_groups, frame_size, first_frame, num_frames);
+}
+
+#ifdef LIBSAC_USE_X86_SIMD
+/// @brief Transpose 8x8 16-bit samples (eight channel vectors to eight frame
+/// vectors, or vice versa).
+LIBSAC_TARGET("sse2")
+inline void transpose_8x8(__m128i *v) {
+  const __m128i b0 = _mm_unpacklo_epi16(v[0], v[1]);
+  const __m128i b1 = _mm_unpackhi_epi16(v[0], v[1]);
+  const __m128i b2 = _mm_unpacklo_epi16(v[2], v[3]);
+  const __m128i b3 = _mm_unpackhi_epi16(v[2], v[3]);
+  const __m128i b4 = _mm_unpacklo_epi16(v[4], v[5]);
+  const __m128i b5 = _mm_unpackhi_epi16(v[4], v[5]);
+  const __m128i b6 = _mm_unpacklo_epi16(v[6], v[7]);
+  const __m128i b7 = _mm_unpackhi_epi16(v[6], v[7]);
+  const __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+  const __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+  const __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+  const __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+  const __m128i c4 = _mm_unpacklo_epi32(b4, b6);
+  const __m128i c5 = _mm_unpackhi_epi32(b4, b6);
+  const __m128i c6 = _mm_unpacklo_epi32(b5, b7);
+  const __m128i c7 = _mm_unpackhi_epi32(b5, b7);
+  v[0] = _mm_unpacklo_epi64(c0, c4);
+  v[1] = _mm_unpackhi_epi64(c0, c4);
+  v[2] = _mm_unpacklo_epi64(c1, c5);
+  v[3] = _mm_unpackhi_epi64(c1, c5);
+  v[4] = _mm_unpacklo_epi64(c2, c6);
+  v[5] = _mm_unpackhi_epi64(c2, c6);
+  v[6] = _mm_unpacklo_epi64(c3, c7);
+  v[7] = _mm_unpackhi_epi64(c3, c7);
+}
+
+/// @brief Interleave a stereo tile into stereo frames.
+LIBSAC_TARGET("sse2")
+void interleave_2_sse2(const int16_t *tile, int tile_stride, int16_t *out, int num_frames) {
+  const int16_t *left = tile;
+  const int16_t *right = tile + tile_stride;
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    const __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&left[k]));
+    const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&right[k]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[2 * k]), _mm_unpacklo_epi16(l, r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[2 * k + 8]), _mm_unpackhi_epi16(l, r));
+  }
+  interleave_generic(tile, tile_stride, 2, out, 2, k, num_frames);
+}
+
+/// @brief Interleave a four channel tile into four channel frames.
+LIBSAC_TARGET("sse2")
+void interleave_4_sse2(const int16_t *tile, int tile_stride, int16_t *out, int num_frames) {
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tile[k]));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tile[tile_stride + k]));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tile[2 * tile_stride + k]));
+    const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tile[3 * tile_stride + k]));
+    const __m128i ab_lo = _mm_unpacklo_epi16(a, b);
+    const __m128i ab_hi = _mm_unpackhi_epi16(a, b);
+    const __m128i cd_lo = _mm_unpacklo_epi16(c, d);
+    const __m128i cd_hi = _mm_unpackhi_epi16(c, d);
+    __m128i *dst = reinterpret_cast<__m128i*>(&out[4 * k]);
+    _mm_storeu_si128(dst, _mm_unpacklo_epi32(ab_lo, cd_lo));
+    _mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(ab_lo, cd_lo));
+    _mm_storeu_si128(dst + 2, _mm_unpacklo_epi32(ab_hi, cd_hi));
+    _mm_storeu_si128(dst + 3, _mm_unpackhi_epi32(ab_hi, cd_hi));
+  }
+  interleave_generic(tile, tile_stride, 4, out, 4, k, num_frames);
+}
+
+/// @brief Interleave a tile of a multiple of eight channels, eight channels
+/// and eight frames at a time.
+LIBSAC_TARGET("sse2")
+void interleave_8n_sse2(const int16_t *tile, int tile_stride, int num_channels, int16_t *out, int frame_size, int num_frames) {
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    for (int ch = 0; ch < num_channels; ch += 8) {
+      // Each vector is a channel: transpose to get one vector per frame.
+      __m128i v[8];
+      for (int i = 0; i < 8; ++i) {
+        v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tile[(ch + i) * tile_stride + k]));
+      }
+      transpose_8x8(v);
+      for (int i = 0; i < 8; ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[(k + i) * frame_size + ch]), v[i]);
+      }
+    }
+  }
+  interleave_generic(tile, tile_stride, num_channels, out, frame_size, k, num_frames);
+}
+
+/// @brief Interleave a tile of three to seven channels into frames of the
+/// same size.
+/// The channels are transposed as if there were eight of them (the last
+/// channel is repeated), and the frames are stored in order, so that the
+/// extra lanes of each frame are overwritten by the next frame.
+LIBSAC_TARGET("sse2")
+void interleave_padded_sse2(const int16_t *tile, int tile_stride, int num_channels, int16_t *out, int num_frames) {
+  const int16_t *rows[8];
+  for (int i = 0; i < 8; ++i) {
+    rows[i] = tile + std::min(i, num_channels - 1) * tile_stride;
+  }
+
+  // The extra lanes of the last frame spill into the following frames, which
+  // must be within the output.
+  int k = 0;
+  for (; (k + 7) * num_channels + 8 <= num_frames * num_channels; k += 8) {
+    __m128i v[8];
+    for (int i = 0; i < 8; ++i) {
+      v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&rows[i][k]));
+    }
+    transpose_8x8(v);
+    for (int i = 0; i < 8; ++i) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[(k + i) * num_channels]), v[i]);
+    }
+  }
+  interleave_generic(tile, tile_stride, num_channels, out, num_channels, k, num_frames);
+}
+
+/// @brief Interleave a stereo tile into stereo frames.
+LIBSAC_TARGET("avx2")
+void interleave_2_avx2(const int16_t *tile, int tile_stride, int16_t *out, int num_frames) {
+  const int16_t *left = tile;
+  const int16_t *right = tile + tile_stride;
+  int k = 0;
+  for (; k + 16 <= num_frames; k += 16) {
+    const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&left[k]));
+    const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&right[k]));
+    const __m256i lo = _mm256_unpacklo_epi16(l, r);
+    const __m256i hi = _mm256_unpackhi_epi16(l, r);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[2 * k]), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[2 * k + 16]), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  interleave_generic(tile, tile_stride, 2, out, 2, k, num_frames);
+}
+#endif // LIBSAC_USE_X86_SIMD
+
+typedef void (*interleave_fixed_t)(const int16_t *tile, int tile_stride, int16_t *out, int num_frames);
+typedef void (*interleave_padded_t)(const int16_t *tile, int tile_stride, int num_channels, int16_t *out, int num_frames);
+typedef void (*interleave_8n_t)(const int16_t *tile, int tile_stride, int num_channels, int16_t *out, int frame_size, int num_frames);
+
+// The kernels for the current CPU level (zero if there is none).
+interleave_fixed_t s_interleave_2;
+interleave_fixed_t s_interleave_4;
+interleave_padded_t s_interleave_padded;
+interleave_8n_t s_interleave_8n;
+
+void select_interleave_kernels(sac_cpu_level_t level) {
+#ifdef LIBSAC_USE_X86_SIMD
+  if (level >= SAC_CPU_SSE2) {
+    store_release(s_interleave_2, level >= SAC_CPU_AVX2 ? interleave_2_avx2 : interleave_2_sse2);
+    store_release(s_interleave_4, interleave_4_sse2);
+    store_release(s_interleave_padded, interleave_padded_sse2);
+    store_release(s_interleave_8n, interleave_8n_sse2);
+    return;
+  }
+#else
+  (void)level;
+#endif
+  store_release(s_interleave_2, 0);
+  store_release(s_interleave_4, 0);
+  store_release(s_interleave_padded, 0);
+  store_release(s_interleave_8n, 0);
+}
+
+kernel_table_t s_kernel_table = {select_interleave_kernels, 0, 0};
+
+} // anonymous namespace
+
+void interleave_tile(const int16_t *tile, int tile_stride, int num_channels, int16_t *out, int frame_size, int num_frames) {
+  use_kernels(s_kernel_table);
+  if (num_channels == 2 && frame_size == 2) {
+    const interleave_fixed_t kernel = load_acquire(s_interleave_2);
+    if (kernel) {
+      kernel(tile, tile_stride, out, num_frames);
+      return;
+    }
+  }
+  if (num_channels == 4 && frame_size == 4) {
+    const interleave_fixed_t kernel = load_acquire(s_interleave_4);
+    if (kernel) {
+      kernel(tile, tile_stride, out, num_frames);
+      return;
+    }
+  }
+  if (num_channels > 2 && num_channels < 8 && frame_size == num_channels) {
+    const interleave_padded_t kernel = load_acquire(s_interleave_padded);
+    if (kernel) {
+      kernel(tile, tile_stride, num_channels, out, num_frames);
+      return;
+    }
+  }
+
+  // Any other tile is split into groups of eight channels (which may be a
+  // part of each frame), and the remaining channels.
+  const int num_vector_channels = num_channels & ~7;
+  const interleave_8n_t kernel_8n = load_acquire(s_interleave_8n);
+  if (num_vector_channels > 0 && kernel_8n) {
+    kernel_8n(tile, tile_stride, num_vector_channels, out, frame_size, num_frames);
+    tile += num_vector_channels * tile_stride;
+    out += num_vector_channels;
+    num_channels -= num_vector_channels;
+  }
+  interleave_generic(tile, tile_stride, num_channels, out, frame_size, 0, num_frames);
+}
+
+} // namespace sac
@@ -0,0 +1,52 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Interleaving of decoded tiles.
+//
+// The interleaved decoder decodes all channels of a block row into a small
+// planar tile (which stays in L1), and then writes whole frames to the output
+// with these kernels, rather than writing each channel with a stride.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_DECODER_INTERLEAVE_H_
+#define LIBSAC_DECODER_INTERLEAVE_H_
+
+#include "libsac.h"
+
+namespace sac {
+
+/// @brief Interleave a planar tile of samples into frames.
+/// @param tile The samples of the first channel of the tile (the samples of
+/// the following channels are tile_stride samples apart).
+/// @param tile_stride The distance between the channels of the tile.
+/// @param num_channels Number of channels in the tile.
+/// @param out The output sample of the first channel of the tile in the first
+/// frame.
+/// @param frame_size Number of samples per output frame (at least
+/// num_channels, if the tile is only a part of each frame).
+/// @param num_frames Number of frames to output.
+void interleave_tile(const int16_t *tile, int tile_stride, int num_channels, int16_t *out, int frame_size, int num_frames);
+
+} // namespace sac
+
+#endif // LIBSAC_DECODER_INTERLEAVE_H_
@@ -0,0 +1,164 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// SIMD prefix sum helpers for the block decoders.
+//
+// With predictor 0 the samples of a block are the running sum of the decoded
+// deltas, and with predictor 1 they are the running sum of the running sum.
+// Both can be computed for a whole block with log-step prefix sums, rather
+// than one sample at a time. The sums are computed in 32-bit lanes without
+// clamping, and any sample outside of the 16-bit range is reported, in which
+// case the block has to be decoded with the (clamping) scalar decoder. If no
+// sample needs clamping, the result is exactly that of the scalar decoder.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_DECODER_PREFIX_SUM_H_
+#define LIBSAC_DECODER_PREFIX_SUM_H_
+
+#include "libsac.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  include <immintrin.h>
+#  define LIBSAC_USE_X86_SIMD
+#  if defined(__GNUC__) || defined(__clang__)
+// Allow the use of instructions that are not enabled for the entire library.
+#    define LIBSAC_TARGET(x) __attribute__((target(x)))
+#  else
+#    define LIBSAC_TARGET(x)
+#  endif
+#endif
+
+namespace sac {
+
+/// @brief A SIMD block decoder kernel.
+/// @param start The starting sample of the block.
+/// @param decode_map The decoding map of the block.
+/// @param in The block codes.
+/// @param num_samples Number of samples to decode (from the start of the
+/// block).
+/// @param out The decoded samples (the buffer must be writable up to the next
+/// multiple of 16 samples).
+/// @returns false if any sample needs clamping (the output is undefined).
+typedef bool (*block_kernel_t)(int start, const short *decode_map, const uint8_t *in, int num_samples, int16_t *out);
+
+#ifdef LIBSAC_USE_X86_SIMD
+/// @brief Integration state of the four lane kernels (the last sample and
+/// slope in all lanes, and the lanes that have been out of range).
+struct integration4_t {
+  __m128i sample;
+  __m128i slope;
+  __m128i out_of_range;
+};
+
+/// @brief Integration state of the eight lane kernels.
+struct integration8_t {
+  __m256i sample;
+  __m256i slope;
+  __m256i out_of_range;
+};
+
+/// @brief Inclusive prefix sum of four 32-bit lanes.
+LIBSAC_TARGET("sse2")
+inline __m128i prefix_sum(__m128i x) {
+  x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+  return _mm_add_epi32(x, _mm_slli_si128(x, 8));
+}
+
+/// @brief Inclusive prefix sum of eight 32-bit lanes.
+LIBSAC_TARGET("avx2")
+inline __m256i prefix_sum(__m256i x) {
+  // Prefix sums of the two 128-bit lanes...
+  x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+  x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+
+  // ...and add the last element of the low lane to the high lane.
+  const __m256i low = _mm256_permute2x128_si256(x, x, 0x08);
+  return _mm256_add_epi32(x, _mm256_shuffle_epi32(low, 0xff));
+}
+
+LIBSAC_TARGET("sse2")
+inline void init_integration(integration4_t *state, int start) {
+  state->sample = _mm_set1_epi32(start);
+  state->slope = _mm_setzero_si128();
+  state->out_of_range = _mm_setzero_si128();
+}
+
+LIBSAC_TARGET("avx2")
+inline void init_integration(integration8_t *state, int start) {
+  state->sample = _mm256_set1_epi32(start);
+  state->slope = _mm256_setzero_si256();
+  state->out_of_range = _mm256_setzero_si256();
+}
+
+/// @brief Integrate the deltas of four consecutive samples.
+/// @returns The samples (32 bits each).
+template <int PREDICTOR>
+LIBSAC_TARGET("sse2")
+inline __m128i integrate(integration4_t *state, __m128i deltas) {
+  __m128i x = prefix_sum(deltas);
+  if (PREDICTOR == 1) {
+    x = _mm_add_epi32(x, state->slope);
+    state->slope = _mm_shuffle_epi32(x, 0xff);
+    x = prefix_sum(x);
+  }
+  x = _mm_add_epi32(x, state->sample);
+  state->sample = _mm_shuffle_epi32(x, 0xff);
+  const __m128i bad = _mm_or_si128(_mm_cmpgt_epi32(x, _mm_set1_epi32(32767)), _mm_cmplt_epi32(x, _mm_set1_epi32(-32768)));
+  state->out_of_range = _mm_or_si128(state->out_of_range, bad);
+  return x;
+}
+
+/// @brief Integrate the deltas of eight consecutive samples.
+/// @returns The samples (32 bits each).
+template <int PREDICTOR>
+LIBSAC_TARGET("avx2")
+inline __m256i integrate(integration8_t *state, __m256i deltas) {
+  const __m256i last_lane = _mm256_set1_epi32(7);
+  __m256i x = prefix_sum(deltas);
+  if (PREDICTOR == 1) {
+    x = _mm256_add_epi32(x, state->slope);
+    state->slope = _mm256_permutevar8x32_epi32(x, last_lane);
+    x = prefix_sum(x);
+  }
+  x = _mm256_add_epi32(x, state->sample);
+  state->sample = _mm256_permutevar8x32_epi32(x, last_lane);
+  const __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(x, _mm256_set1_epi32(32767)), _mm256_cmpgt_epi32(_mm256_set1_epi32(-32768), x));
+  state->out_of_range = _mm256_or_si256(state->out_of_range, bad);
+  return x;
+}
+
+/// @returns true if no integrated sample was outside of the 16-bit range.
+LIBSAC_TARGET("sse2")
+inline bool in_range(const integration4_t &state) {
+  return _mm_movemask_epi8(state.out_of_range) == 0;
+}
+
+LIBSAC_TARGET("avx2")
+inline bool in_range(const integration8_t &state) {
+  return _mm256_movemask_epi8(state.out_of_range) == 0;
+}
+#endif // LIBSAC_USE_X86_SIMD
+
+} // namespace sac
+
+#endif // LIBSAC_DECODER_PREFIX_SUM_H_
@@ -0,0 +1,211 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "dedup_table.h"
+
+#include <cstring>
+
+#include "allocator.h"
+#include "file_format.h"
+#include "util.h"
+
+namespace sac {
+
+namespace {
+
+// Size of the fixed part of a serialized table (num_unique).
+const int kFixedSize = 4;
+
+// Tables with more unique blocks than this use 32-bit entries.
+const int kMaxNarrowUnique = 65536;
+
+/// @brief Calculate a 64-bit hash of a block.
+uint64_t hash_block(const uint8_t *block, int size) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>(size);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, block + i, 8);
+    h = (h ^ word) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  for (; i < size; ++i) {
+    h = (h ^ block[i]) * 0x100000001b3ULL;
+  }
+
+  // Final avalanche (from MurmurHash3).
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+} // anonymous namespace
+
+dedup_table_t::dedup_table_t(int num_blocks, int num_unique)
+    : m_num_blocks(num_blocks),
+      m_num_unique(num_unique),
+      m_wide(num_unique > kMaxNarrowUnique),
+      m_entries16(0),
+      m_entries32(0) {
+}
+
+dedup_table_t::~dedup_table_t() {
+  mem_free(m_entries16);
+  mem_free(m_entries32);
+}
+
+bool dedup_table_t::allocate() {
+  if (m_wide) {
+    m_entries32 = static_cast<uint32_t*>(mem_alloc(m_num_blocks * sizeof(uint32_t)));
+    return m_entries32 != 0;
+  }
+  m_entries16 = static_cast<uint16_t*>(mem_alloc(m_num_blocks * sizeof(uint16_t)));
+  return m_entries16 != 0;
+}
+
+dedup_table_t *dedup_table_t::build(const uint8_t *blocks, int num_blocks, int block_bytes) {
+  // Find the unique blocks, using an open addressing hash table (with a load
+  // factor of at most 50%) that maps hashes to the first occurrence of each
+  // unique block.
+  int capacity = 16;
+  while (capacity < 2 * num_blocks) {
+    capacity *= 2;
+  }
+  scoped_buffer_t<uint64_t> hashes(num_blocks + 1);
+  scoped_buffer_t<int> slots(capacity, -1);
+  scoped_buffer_t<int> entries(num_blocks + 1);
+  if (!hashes.get() || !slots.get() || !entries.get()) {
+    return 0;
+  }
+
+  // Hash all the blocks.
+#ifdef LIBSAC_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num_blocks; ++i) {
+    hashes[i] = hash_block(blocks + static_cast<size_t>(i) * block_bytes, block_bytes);
+  }
+
+  // Unique blocks are numbered in the order of their first occurrence.
+  int num_unique = 0;
+  for (int i = 0; i < num_blocks; ++i) {
+    const uint8_t *block = blocks + static_cast<size_t>(i) * block_bytes;
+    const uint64_t h = hashes[i];
+    int pos = static_cast<int>(h & static_cast<uint64_t>(capacity - 1));
+    while (true) {
+      const int first = slots[pos];
+      if (first < 0) {
+        // A new unique block.
+        slots[pos] = i;
+        entries[i] = num_unique++;
+        break;
+      }
+      if (hashes[first] == h && std::memcmp(blocks + static_cast<size_t>(first) * block_bytes, block, block_bytes) == 0) {
+        // A duplicate of an earlier block.
+        entries[i] = entries[first];
+        break;
+      }
+      pos = (pos + 1) & (capacity - 1);
+    }
+  }
+
+  scoped_ptr<dedup_table_t> table(new dedup_table_t(num_blocks, num_unique));
+  if (!table->allocate()) {
+    return 0;
+  }
+  for (int i = 0; i < num_blocks; ++i) {
+    if (table->m_wide) {
+      table->m_entries32[i] = static_cast<uint32_t>(entries[i]);
+    } else {
+      table->m_entries16[i] = static_cast<uint16_t>(entries[i]);
+    }
+  }
+  return table.release();
+}
+
+void dedup_table_t::compact(uint8_t *blocks, int block_bytes) const {
+  // Block i is the first occurrence of unique block u if its entry is the next
+  // unique block number. Since u <= i, no block is overwritten before it has
+  // been moved.
+  int num_moved = 0;
+  for (int i = 0; i < m_num_blocks && num_moved < m_num_unique; ++i) {
+    if (entry(i) == num_moved) {
+      if (num_moved != i) {
+        std::memcpy(blocks + static_cast<size_t>(num_moved) * block_bytes, blocks + static_cast<size_t>(i) * block_bytes, block_bytes);
+      }
+      ++num_moved;
+    }
+  }
+}
+
+dedup_table_t *dedup_table_t::parse(const uint8_t *in, int size, int num_blocks) {
+  if (size < kFixedSize) {
+    return 0;
+  }
+  const uint32_t num_unique = get_uint32(in);
+  if (num_unique > static_cast<uint32_t>(num_blocks)) {
+    return 0;
+  }
+  scoped_ptr<dedup_table_t> table(new dedup_table_t(num_blocks, static_cast<int>(num_unique)));
+  if (size != table->serialized_size() || !table->allocate()) {
+    return 0;
+  }
+
+  // All entries must refer to a unique block.
+  const uint8_t *src = in + kFixedSize;
+  for (int i = 0; i < num_blocks; ++i) {
+    uint32_t u;
+    if (table->m_wide) {
+      u = get_uint32(src + i * 4);
+      table->m_entries32[i] = u;
+    } else {
+      u = get_uint16(src + i * 2);
+      table->m_entries16[i] = static_cast<uint16_t>(u);
+    }
+    if (u >= num_unique) {
+      return 0;
+    }
+  }
+  return table.release();
+}
+
+int dedup_table_t::serialized_size() const {
+  return kFixedSize + m_num_blocks * (m_wide ? 4 : 2);
+}
+
+void dedup_table_t::serialize(uint8_t *out) const {
+  put_uint32(out, static_cast<uint32_t>(m_num_unique));
+  uint8_t *dst = out + kFixedSize;
+  for (int i = 0; i < m_num_blocks; ++i) {
+    if (m_wide) {
+      put_uint32(dst + i * 4, m_entries32[i]);
+    } else {
+      dst[i * 2] = static_cast<uint8_t>(m_entries16[i]);
+      dst[i * 2 + 1] = static_cast<uint8_t>(m_entries16[i] >> 8);
+    }
+  }
+}
+
+} // namespace sac
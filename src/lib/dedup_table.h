@@ -0,0 +1,103 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Block deduplication table (SAC_LAYOUT_DEDUP):
+//
+// Byte-identical encoded blocks (e.g. from loops, repeated sounds or digital
+// silence) are only stored once. The data chunk holds the unique blocks, in
+// order of first occurrence, and the table holds the unique block number of
+// every block in the block list (see block_layout.h; for the sparse layout,
+// only the coded blocks are listed). The table entries are 16 bits wide if
+// there are at most 65536 unique blocks, and 32 bits wide otherwise.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_DEDUP_TABLE_H_
+#define LIBSAC_DEDUP_TABLE_H_
+
+#include "../include/libsac.h"
+#include "allocator.h"
+
+namespace sac {
+
+class dedup_table_t : public allocated_t {
+  public:
+    ~dedup_table_t();
+
+    /// @brief Find the unique blocks of a list of blocks.
+    /// The blocks are compared using a 64-bit hash of their bytes (and then
+    /// byte by byte). The blocks are not modified (see compact).
+    /// @param blocks The blocks.
+    /// @param num_blocks Number of blocks.
+    /// @param block_bytes Size of a block, in bytes.
+    /// @returns The deduplication table, or zero on failure.
+    static dedup_table_t *build(const uint8_t *blocks, int num_blocks, int block_bytes);
+
+    /// @brief Move the unique blocks to the start of the list of blocks that
+    /// the table was built from.
+    /// @param blocks The blocks.
+    /// @param block_bytes Size of a block, in bytes.
+    void compact(uint8_t *blocks, int block_bytes) const;
+
+    /// @brief Parse a serialized table (the payload of a BIDX chunk).
+    /// @param in The serialized table.
+    /// @param size Size of the serialized table, in bytes.
+    /// @param num_blocks Number of blocks in the block list.
+    /// @returns The table, or zero if the serialized table is malformed.
+    static dedup_table_t *parse(const uint8_t *in, int size, int num_blocks);
+
+    /// @returns The size of the serialized table, in bytes.
+    int serialized_size() const;
+
+    /// @brief Serialize the table (see file_format.h).
+    /// @param out The output buffer (serialized_size() bytes).
+    void serialize(uint8_t *out) const;
+
+    /// @returns The number of unique blocks.
+    int num_unique() const {
+      return m_num_unique;
+    }
+
+    /// @returns The unique block number of a block in the block list.
+    int entry(int index) const {
+      return m_wide ? static_cast<int>(m_entries32[index]) : static_cast<int>(m_entries16[index]);
+    }
+
+  private:
+    dedup_table_t(int num_blocks, int num_unique);
+    dedup_table_t(const dedup_table_t& other);
+    dedup_table_t& operator=(const dedup_table_t& other);
+
+    /// @returns false if the memory for the table could not be allocated.
+    bool allocate();
+
+    const int m_num_blocks;
+    const int m_num_unique;
+    const bool m_wide;
+
+    uint16_t *m_entries16;
+    uint32_t *m_entries32;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_DEDUP_TABLE_H_
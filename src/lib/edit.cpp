@@ -0,0 +1,589 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Compressed domain editing.
+//
+// Since every block is coded independently, an edited sound (a slice of a
+// sound, several sounds joined together, or channels picked from several
+// sounds) can be assembled block by block from the encoded data. Every block
+// of the output that holds exactly the samples of a block of a source is
+// copied as is (without generation loss). Only blocks that straddle an edge
+// that is not aligned to the block grid are decoded and encoded again.
+//-----------------------------------------------------------------------------
+
+#include "libsac.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "allocator.h"
+#include "encoder/encode_dd4a.h"
+#include "encoder/encode_dd8a.h"
+#include "decoder/decode.h"
+#include "envelope.h"
+#include "packed_data.h"
+
+using namespace sac;
+
+namespace {
+
+// The file format stores the number of channels in 16 bits.
+const int kMaxChannels = 65535;
+
+/// @brief A range of samples of a source channel, which makes up a part of
+/// an output channel.
+struct segment_t {
+  const packed_data_t *data;
+  int channel; ///< Channel (of the source).
+  int start;   ///< First sample (of the source).
+  int end;     ///< End of the range (of the source).
+  int offset;  ///< Position of the first sample in the output.
+};
+
+/// @brief The segments of an edited sound.
+/// Every output channel is made up of the same number of segments, and
+/// segments[ch * num_segments + i] is segment i of output channel ch.
+class assembly_t {
+  public:
+    assembly_t(const segment_t *segments, int num_segments)
+        : m_segments(segments), m_num_segments(num_segments) {
+      const segment_t &last = segments[num_segments - 1];
+      m_num_samples = last.offset + (last.end - last.start);
+    }
+
+    int num_samples() const {
+      return m_num_samples;
+    }
+
+    /// @brief Find the source block that holds exactly the given output
+    /// samples.
+    /// @param start First output sample.
+    /// @param end End of the output samples.
+    /// @param channel Output channel.
+    /// @param data Set to the source.
+    /// @param src_channel Set to the channel (within the source).
+    /// @param block_no Set to the block number (within the source).
+    /// @returns false if the samples are not an entire block of a source (in
+    /// which case they have to be encoded again).
+    bool find_block(int start, int end, int channel, const packed_data_t **data, int *src_channel, int *block_no) const {
+      const segment_t &seg = segment_at(start, channel);
+      if (end > seg.offset + (seg.end - seg.start)) {
+        return false;
+      }
+      const packed_data_t *src = seg.data;
+      const int pos = seg.start + (start - seg.offset) - src->leading_silence();
+      if (pos < 0 || pos % src->block_size() != 0 || pos >= src->coded_samples()) {
+        return false;
+      }
+      if (end - start != std::min(src->block_size(), src->coded_samples() - pos)) {
+        return false;
+      }
+      *data = src;
+      *src_channel = seg.channel;
+      *block_no = pos / src->block_size();
+      return true;
+    }
+
+    /// @brief Decode output samples of a channel.
+    void decode(int16_t *out, int start, int end, int channel) const {
+      for (int i = 0; i < m_num_segments && start < end; ++i) {
+        const segment_t &seg = m_segments[channel * m_num_segments + i];
+        const int seg_end = seg.offset + (seg.end - seg.start);
+        if (start >= seg_end) {
+          continue;
+        }
+        const int count = std::min(end, seg_end) - start;
+        decode_uncached(out, seg.data, seg.start + (start - seg.offset), count, seg.channel);
+        out += count;
+        start += count;
+      }
+    }
+
+    /// @brief Find the source bin that holds exactly the given output samples.
+    /// @returns The bin, or zero if there is no such precomputed bin.
+    const peak_table_t::bin_t *find_bin(int start, int end, int channel, int samples_per_bin) const {
+      const segment_t &seg = segment_at(start, channel);
+      const peak_table_t *table = seg.data->peak_table();
+      if (end > seg.offset + (seg.end - seg.start) || !table || table->samples_per_bin() != samples_per_bin) {
+        return 0;
+      }
+      const int pos = seg.start + (start - seg.offset);
+      if (pos % samples_per_bin != 0 || end - start != std::min(samples_per_bin, seg.data->num_samples() - pos)) {
+        return 0;
+      }
+      return table->bins(seg.channel) + pos / samples_per_bin;
+    }
+
+  private:
+    const segment_t &segment_at(int pos, int channel) const {
+      const segment_t *segments = m_segments + channel * m_num_segments;
+      int i = 0;
+      while (i < m_num_segments - 1 && pos >= segments[i + 1].offset) {
+        ++i;
+      }
+      return segments[i];
+    }
+
+    const segment_t *m_segments;
+    const int m_num_segments;
+    int m_num_samples;
+};
+
+/// @returns The number of reconstructed samples that had to be clamped.
+int encode_block(sac_encoding_t encoding, const int16_t *in, uint8_t *header, uint8_t *out, int count) {
+  switch (encoding) {
+    case SAC_FORMAT_DD4A:
+      return dd4a::encode_block(in, header, out, count, 1);
+    case SAC_FORMAT_DD8A:
+      return dd8a::encode_block(in, header, out, count, 1);
+    default:
+      return count;
+  }
+}
+
+/// @returns true if all samples have the same value.
+bool is_constant(const int16_t *samples, int count) {
+  for (int k = 1; k < count; ++k) {
+    if (samples[k] != samples[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// @returns The number of samples at the start of a segment that are trimmed
+/// silence of the source.
+int silent_head(const segment_t &segment) {
+  const packed_data_t *src = segment.data;
+  int pos = segment.start;
+  if (pos < src->leading_silence()) {
+    pos = std::min(src->leading_silence(), segment.end);
+  }
+  if (pos >= src->leading_silence() + src->coded_samples()) {
+    pos = segment.end;
+  }
+  return pos - segment.start;
+}
+
+/// @returns The number of samples at the end of a segment that are trimmed
+/// silence of the source.
+int silent_tail(const segment_t &segment) {
+  const packed_data_t *src = segment.data;
+  int pos = segment.end;
+  if (pos > src->leading_silence() + src->coded_samples()) {
+    pos = std::max(src->leading_silence() + src->coded_samples(), segment.start);
+  }
+  if (pos <= src->leading_silence()) {
+    pos = segment.start;
+  }
+  return segment.end - pos;
+}
+
+bool is_planar(int layout) {
+  return (layout & SAC_LAYOUT_PLANAR) != 0;
+}
+
+/// @brief Check if an output channel is an entire source channel, with the
+/// same block grid and the same superblocks as the output.
+/// @returns The segment that holds the source channel, or zero.
+const segment_t *whole_channel(const segment_t *segments, int num_segments, int layout) {
+  const segment_t *segment = 0;
+  for (int i = 0; i < num_segments; ++i) {
+    if (segments[i].start < segments[i].end) {
+      if (segment) {
+        return 0;
+      }
+      segment = &segments[i];
+    }
+  }
+  if (!segment || segment->start != 0 || segment->end != segment->data->num_samples()) {
+    return 0;
+  }
+  const int src_layout = segment->data->layout();
+  if (block_layout_t::is_block_list(layout) || block_layout_t::is_block_list(src_layout) ||
+      (layout & SAC_LAYOUT_SUPERBLOCKS) != (src_layout & SAC_LAYOUT_SUPERBLOCKS)) {
+    return 0;
+  }
+  return segment;
+}
+
+/// @brief Find the value of each block of a sparse output.
+/// @returns The sparse block map, or zero on failure.
+sparse_map_t *build_sparse_map(const assembly_t &assembly, const block_layout_t &blocks, int num_channels, int leading, int trailing) {
+  const int num_blocks = blocks.num_blocks();
+  const int block_size = blocks.block_size();
+  const int coded_end = assembly.num_samples() - trailing;
+  scoped_buffer_t<int> values(static_cast<size_t>(num_blocks) * num_channels + 1);
+  if (!values.get()) {
+    return 0;
+  }
+#ifdef LIBSAC_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int k = 0; k < num_blocks; ++k) {
+    const int start = leading + k * block_size;
+    const int end = std::min(start + block_size, coded_end);
+    int16_t samples[kMaxBlockSize];
+    for (int ch = 0; ch < num_channels; ++ch) {
+      int &value = values[blocks.block_index(k, ch)];
+      const packed_data_t *src;
+      int src_channel, src_block;
+      if (assembly.find_block(start, end, ch, &src, &src_channel, &src_block)) {
+        // Copied blocks keep their kind.
+        block_offsets_t offsets;
+        int16_t src_value;
+        value = src->locate_block(src_block, src_channel, &offsets, &src_value) ? sparse_map_t::kNotConstant : src_value;
+        continue;
+      }
+      assembly.decode(samples, start, end, ch);
+      value = is_constant(samples, end - start) ? samples[0] : sparse_map_t::kNotConstant;
+    }
+  }
+
+  scoped_ptr<sparse_map_t> map(new sparse_map_t(num_blocks * num_channels, leading, trailing));
+  if (!map->build(values.get())) {
+    return 0;
+  }
+  return map.release();
+}
+
+/// @brief Build the precomputed envelope of the output, from the bins of the
+/// sources where they line up, and by decoding the output elsewhere.
+/// @param exact Flags that tell which blocks decode to exactly the samples of
+/// the sources, i.e. that were not encoded again (per block and channel).
+peak_table_t *build_peak_table(const assembly_t &assembly, const packed_data_t *out, const uint8_t *exact, int samples_per_bin) {
+  scoped_ptr<peak_table_t> table(new peak_table_t(samples_per_bin, out->num_samples(), out->num_channels()));
+  if (!table->is_valid()) {
+    return 0;
+  }
+  const int num_bins = table->num_bins();
+  for (int ch = 0; ch < out->num_channels(); ++ch) {
+    peak_table_t::bin_t *bins = table->bins(ch);
+#ifdef LIBSAC_USE_OPENMP
+    #pragma omp parallel for
+#endif
+    for (int b = 0; b < num_bins; ++b) {
+      const int start = b * samples_per_bin;
+      const int end = std::min(start + samples_per_bin, out->num_samples());
+      const peak_table_t::bin_t *src = assembly.find_bin(start, end, ch, samples_per_bin);
+      // Bins that overlap blocks that were encoded again can not be copied.
+      const int first_block = std::max(start - out->leading_silence(), 0) / out->block_size();
+      const int end_block = std::min((end - out->leading_silence() + out->block_size() - 1) / out->block_size(), out->blocks().num_blocks());
+      for (int k = first_block; k < end_block && src; ++k) {
+        if (!exact[k * out->num_channels() + ch]) {
+          src = 0;
+        }
+      }
+      if (src) {
+        bins[b] = *src;
+      } else {
+        compute_peak_bins(out, ch, samples_per_bin, b, b + 1, &bins[b]);
+      }
+    }
+  }
+  return table.release();
+}
+
+/// @brief Assemble packed data from segments of other packed data.
+/// The output gets the sample rate and the layout of the first source, and
+/// all sources must have the same encoding and block size.
+/// @param segments The segments of each output channel (see assembly_t).
+/// @param num_segments Number of segments per output channel.
+/// @param num_channels Number of output channels.
+/// @returns The packed data, or zero on failure.
+packed_data_t *assemble(const segment_t *segments, int num_segments, int num_channels) {
+  const assembly_t assembly(segments, num_segments);
+  const packed_data_t *first = segments[0].data;
+  const sac_encoding_t encoding = first->encoding();
+  const int block_size = first->block_size();
+  const int layout = first->layout();
+  const int num_samples = assembly.num_samples();
+
+  // For the sparse layout, the silence at the start and at the end (i.e. the
+  // trimmed silence of the sources) stays trimmed.
+  int leading = 0, trailing = 0;
+  if (layout & SAC_LAYOUT_SPARSE) {
+    leading = trailing = num_samples;
+    for (int ch = 0; ch < num_channels; ++ch) {
+      const segment_t *channel_segments = segments + ch * num_segments;
+      int head = 0, tail = 0;
+      for (int i = 0; i < num_segments; ++i) {
+        const int silent = silent_head(channel_segments[i]);
+        head += silent;
+        if (silent < channel_segments[i].end - channel_segments[i].start) {
+          break;
+        }
+      }
+      for (int i = num_segments - 1; i >= 0; --i) {
+        const int silent = silent_tail(channel_segments[i]);
+        tail += silent;
+        if (silent < channel_segments[i].end - channel_segments[i].start) {
+          break;
+        }
+      }
+      leading = std::min(leading, head);
+      trailing = std::min(trailing, tail);
+    }
+    trailing = std::min(trailing, num_samples - leading);
+  }
+  const int coded_samples = num_samples - leading - trailing;
+  const block_layout_t blocks(encoding, block_size, layout, coded_samples, num_channels);
+  const int num_blocks = blocks.num_blocks();
+  scoped_ptr<sparse_map_t> map;
+  if (layout & SAC_LAYOUT_SPARSE) {
+    map.reset(build_sparse_map(assembly, blocks, num_channels, leading, trailing));
+    if (!map.get()) {
+      return 0;
+    }
+  }
+
+  const int data_size = map.get() ? map->num_coded() * blocks.full_block_size() : blocks.data_size();
+  scoped_ptr<packed_data_t> data(new packed_data_t(data_size, num_samples, num_channels, first->sample_rate(), encoding, block_size, layout, map.release()));
+  if (!data->is_valid()) {
+    return 0;
+  }
+
+  // Output channels that are an entire source channel with the same
+  // superblocks are copied superblock by superblock.
+  scoped_buffer_t<const segment_t*> whole(num_channels);
+  if (!whole.get()) {
+    return 0;
+  }
+  for (int ch = 0; ch < num_channels; ++ch) {
+    whole[ch] = whole_channel(segments + ch * num_segments, num_segments, layout);
+  }
+  scoped_buffer_t<uint8_t> clamped(static_cast<size_t>(num_blocks) * num_channels + 1, 0);
+  scoped_buffer_t<uint8_t> exact(static_cast<size_t>(num_blocks) * num_channels + 1, 1);
+  if (!clamped.get() || !exact.get()) {
+    return 0;
+  }
+  const int num_sb_rows = blocks.num_sb_rows();
+  for (int ch = 0; ch < num_channels; ++ch) {
+    if (whole[ch] && is_planar(layout) && is_planar(whole[ch]->data->layout())) {
+      // Both channels are contiguous.
+      std::memcpy(data->data() + blocks.channel_offset(ch), whole[ch]->data->data() + whole[ch]->data->blocks().channel_offset(whole[ch]->channel), blocks.channel_size());
+    }
+  }
+#ifdef LIBSAC_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int sb_row = 0; sb_row < num_sb_rows; ++sb_row) {
+    for (int ch = 0; ch < num_channels; ++ch) {
+      if (whole[ch] && !(is_planar(layout) && is_planar(whole[ch]->data->layout()))) {
+        const byte_range_t dst = blocks.superblock(sb_row, ch);
+        const byte_range_t src = whole[ch]->data->blocks().superblock(sb_row, whole[ch]->channel);
+        std::memcpy(data->data() + dst.offset, whole[ch]->data->data() + src.offset, dst.size);
+      }
+    }
+  }
+
+  // Copy or encode the remaining blocks, one block row at a time.
+#ifdef LIBSAC_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int k = 0; k < num_blocks; ++k) {
+    const int start = leading + k * block_size;
+    const int count = std::min(block_size, coded_samples - k * block_size);
+    const int block_bytes = block_layout_t::bytes_per_block(encoding, count);
+    int16_t samples[kMaxBlockSize];
+    for (int ch = 0; ch < num_channels; ++ch) {
+      if (whole[ch]) {
+        clamped[k * num_channels + ch] = whole[ch]->data->is_clamp_free(k, whole[ch]->channel) ? 0 : 1;
+        continue;
+      }
+      block_offsets_t dst;
+      int16_t value;
+      const packed_data_t *src;
+      int src_channel, src_block;
+      if (!data->locate_block(k, ch, &dst, &value)) {
+        // Constant block.
+        continue;
+      }
+      uint8_t *header = data->data() + dst.header;
+      uint8_t *codes = data->data() + dst.codes;
+      if (count < block_size && block_layout_t::is_block_list(layout)) {
+        // Listed blocks always occupy a full block (clear the padding).
+        std::memset(header, 0, blocks.full_block_size());
+      }
+
+      block_offsets_t src_offsets;
+      if (assembly.find_block(start, start + count, ch, &src, &src_channel, &src_block)) {
+        if (src->locate_block(src_block, src_channel, &src_offsets, &value)) {
+          header[0] = src->data()[src_offsets.header];
+          header[1] = src->data()[src_offsets.header + 1];
+          std::memcpy(codes, src->data() + src_offsets.codes, block_bytes - 2);
+          clamped[k * num_channels + ch] = src->is_clamp_free(src_block, src_channel) ? 0 : 1;
+          continue;
+        }
+
+        // A constant block, which has to be coded in this layout.
+        std::fill(samples, samples + count, value);
+      } else {
+        assembly.decode(samples, start, start + count, ch);
+      }
+      exact[k * num_channels + ch] = 0;
+      clamped[k * num_channels + ch] = encode_block(encoding, samples, header, codes, count) > 0 ? 1 : 0;
+    }
+  }
+
+  // Zero the padding of the final superblocks.
+  blocks.clear_padding(data->data());
+
+  scoped_ptr<clamp_map_t> clamp_map(new clamp_map_t(num_blocks * num_channels));
+  if (!clamp_map->build(clamped.get())) {
+    return 0;
+  }
+  data->set_clamp_map(clamp_map.release());
+
+  // Store identical blocks only once.
+  if ((layout & SAC_LAYOUT_DEDUP) && !data->deduplicate()) {
+    return 0;
+  }
+
+  if (first->peak_table()) {
+    peak_table_t *peak_table = build_peak_table(assembly, data.get(), exact.get(), first->peak_table()->samples_per_bin());
+    if (!peak_table) {
+      return 0;
+    }
+    data->set_peak_table(peak_table);
+  }
+
+  return data.release();
+}
+
+} // anonymous namespace
+
+extern "C"
+sac_packed_data_t *sac_slice(const sac_packed_data_t *data_, int start_block, int num_blocks) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data || start_block < 0 || num_blocks < 1 || start_block >= data->blocks().num_blocks()) {
+    return 0;
+  }
+  const int end_block = std::min(start_block + num_blocks, data->blocks().num_blocks());
+
+  // The first and the last block include any trimmed silence.
+  scoped_buffer_t<segment_t> segments(data->num_channels());
+  if (!segments.get()) {
+    return 0;
+  }
+  for (int ch = 0; ch < data->num_channels(); ++ch) {
+    segment_t &segment = segments[ch];
+    segment.data = data;
+    segment.channel = ch;
+    segment.start = start_block > 0 ? data->leading_silence() + start_block * data->block_size() : 0;
+    segment.end = end_block < data->blocks().num_blocks() ? data->leading_silence() + end_block * data->block_size() : data->num_samples();
+    segment.offset = 0;
+  }
+  return reinterpret_cast<sac_packed_data_t*>(assemble(segments.get(), 1, data->num_channels()));
+}
+
+extern "C"
+sac_packed_data_t *sac_concat(const sac_packed_data_t *a_, const sac_packed_data_t *b_) {
+  const packed_data_t *a = reinterpret_cast<const packed_data_t*>(a_);
+  const packed_data_t *b = reinterpret_cast<const packed_data_t*>(b_);
+  if (!a || !b || a->encoding() != b->encoding() || a->block_size() != b->block_size() ||
+      a->num_channels() != b->num_channels() || a->sample_rate() != b->sample_rate() ||
+      static_cast<int64_t>(a->num_samples()) + b->num_samples() > 0x7fffffff) {
+    return 0;
+  }
+
+  scoped_buffer_t<segment_t> segments(2 * a->num_channels());
+  if (!segments.get()) {
+    return 0;
+  }
+  for (int ch = 0; ch < a->num_channels(); ++ch) {
+    segment_t *channel_segments = &segments[2 * ch];
+    channel_segments[0].data = a;
+    channel_segments[0].channel = ch;
+    channel_segments[0].start = 0;
+    channel_segments[0].end = a->num_samples();
+    channel_segments[0].offset = 0;
+    channel_segments[1].data = b;
+    channel_segments[1].channel = ch;
+    channel_segments[1].start = 0;
+    channel_segments[1].end = b->num_samples();
+    channel_segments[1].offset = a->num_samples();
+  }
+  return reinterpret_cast<sac_packed_data_t*>(assemble(segments.get(), 2, a->num_channels()));
+}
+
+extern "C"
+sac_packed_data_t *sac_extract_channels(const sac_packed_data_t *data_, const int *channel_map, int num_channels) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data || !channel_map || num_channels < 1 || num_channels > kMaxChannels) {
+    return 0;
+  }
+
+  scoped_buffer_t<segment_t> segments(num_channels);
+  if (!segments.get()) {
+    return 0;
+  }
+  for (int ch = 0; ch < num_channels; ++ch) {
+    if (channel_map[ch] < 0 || channel_map[ch] >= data->num_channels()) {
+      return 0;
+    }
+    segment_t &segment = segments[ch];
+    segment.data = data;
+    segment.channel = channel_map[ch];
+    segment.start = 0;
+    segment.end = data->num_samples();
+    segment.offset = 0;
+  }
+  return reinterpret_cast<sac_packed_data_t*>(assemble(segments.get(), 1, num_channels));
+}
+
+extern "C"
+sac_packed_data_t *sac_merge_channels(const sac_packed_data_t *const *datas, int count) {
+  if (!datas || count < 1 || !datas[0]) {
+    return 0;
+  }
+  const packed_data_t *first = reinterpret_cast<const packed_data_t*>(datas[0]);
+
+  int num_channels = 0;
+  for (int i = 0; i < count; ++i) {
+    const packed_data_t *data = reinterpret_cast<const packed_data_t*>(datas[i]);
+    if (!data || data->encoding() != first->encoding() || data->block_size() != first->block_size() ||
+        data->num_samples() != first->num_samples() || data->sample_rate() != first->sample_rate() ||
+        num_channels + data->num_channels() > kMaxChannels) {
+      return 0;
+    }
+    num_channels += data->num_channels();
+  }
+
+  scoped_buffer_t<segment_t> segments(num_channels);
+  if (!segments.get()) {
+    return 0;
+  }
+  segment_t *segment = segments.get();
+  for (int i = 0; i < count; ++i) {
+    const packed_data_t *data = reinterpret_cast<const packed_data_t*>(datas[i]);
+    for (int ch = 0; ch < data->num_channels(); ++ch, ++segment) {
+      segment->data = data;
+      segment->channel = ch;
+      segment->start = 0;
+      segment->end = data->num_samples();
+      segment->offset = 0;
+    }
+  }
+  return reinterpret_cast<sac_packed_data_t*>(assemble(segments.get(), 1, num_channels));
+}
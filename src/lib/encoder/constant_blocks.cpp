@@ -0,0 +1,120 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "encoder/constant_blocks.h"
+
+#include <algorithm>
+
+#include "allocator.h"
+#include "format_traits.h"
+#include "stats.h"
+#include "util.h"
+
+namespace sac {
+
+void find_silence(const sample_source_t &source, int num_samples, int num_channels, int *leading, int *trailing) {
+  int16_t scratch[kMaxBlockSize];
+
+  // The first non-zero sample of any channel ends the leading silence...
+  int start_of_sound = num_samples;
+  for (int ch = 0; ch < num_channels; ++ch) {
+    for (int start = 0; start < start_of_sound; start += kMaxBlockSize) {
+      const int count = std::min(kMaxBlockSize, start_of_sound - start);
+      const int16_t *in = source.get_block(ch, start, count, scratch);
+      for (int i = 0; i < count; ++i) {
+        if (in[i] != 0) {
+          start_of_sound = start + i;
+          break;
+        }
+      }
+    }
+  }
+
+  // ...and the last non-zero sample of any channel starts the trailing
+  // silence.
+  int end_of_sound = start_of_sound;
+  for (int ch = 0; ch < num_channels; ++ch) {
+    int end = num_samples;
+    while (end > end_of_sound) {
+      const int count = std::min(kMaxBlockSize, end - end_of_sound);
+      const int start = end - count;
+      const int16_t *in = source.get_block(ch, start, count, scratch);
+      int i = count - 1;
+      while (i >= 0 && in[i] == 0) {
+        --i;
+      }
+      if (i >= 0) {
+        end_of_sound = start + i + 1;
+        break;
+      }
+      end = start;
+    }
+  }
+
+  *leading = start_of_sound;
+  *trailing = num_samples - end_of_sound;
+}
+
+sparse_map_t *find_constant_blocks(const sample_source_t &source, const block_layout_t &blocks, int num_samples, int num_channels, int leading, int trailing) {
+  const int coded_samples = num_samples - leading - trailing;
+  const int block_size = blocks.block_size();
+  const int num_blocks = blocks.num_blocks();
+  scoped_ptr<sparse_map_t> map(new sparse_map_t(num_blocks * num_channels, leading, trailing));
+
+  // Get the value of each block (kNotConstant for blocks that must be coded).
+  scoped_buffer_t<int> values(static_cast<size_t>(num_blocks) * num_channels + 1);
+  if (!values.get()) {
+    return 0;
+  }
+#ifdef LIBSAC_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for (int k = 0; k < num_blocks; ++k) {
+    int16_t scratch[kMaxBlockSize];
+    int num_constant = 0;
+    const int count = std::min(block_size, coded_samples - k * block_size);
+    for (int ch = 0; ch < num_channels; ++ch) {
+      const int16_t *in = source.get_block(ch, leading + k * block_size, count, scratch);
+      int i = 1;
+      while (i < count && in[i] == in[0]) {
+        ++i;
+      }
+      const bool is_constant = i == count;
+      values[blocks.block_index(k, ch)] = is_constant ? in[0] : sparse_map_t::kNotConstant;
+      num_constant += is_constant ? 1 : 0;
+    }
+
+    sac_stats_t *stats = thread_stats();
+    if (stats) {
+      stats_add(stats->constant_blocks, num_constant);
+    }
+  }
+
+  if (!map->build(values.get())) {
+    return 0;
+  }
+  return map.release();
+}
+
+} // namespace sac
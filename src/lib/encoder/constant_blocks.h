@@ -0,0 +1,57 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_CONSTANT_BLOCKS_H_
+#define LIBSAC_CONSTANT_BLOCKS_H_
+
+#include "libsac.h"
+#include "block_layout.h"
+#include "encoder/sample_source.h"
+#include "sparse_map.h"
+
+namespace sac {
+
+/// @brief Find the leading and trailing samples that are zero in all channels.
+/// @param source The input samples.
+/// @param num_samples Number of samples per channel.
+/// @param num_channels Number of channels.
+/// @param leading Set to the number of silent leading samples.
+/// @param trailing Set to the number of silent trailing samples (not counting
+/// any leading samples, i.e. a completely silent sound has only leading
+/// samples).
+void find_silence(const sample_source_t &source, int num_samples, int num_channels, int *leading, int *trailing);
+
+/// @brief Find the blocks whose samples all have the same value.
+/// @param source The input samples.
+/// @param blocks The block layout of the coded samples.
+/// @param num_samples Number of samples per channel.
+/// @param num_channels Number of channels.
+/// @param leading Number of trimmed leading samples.
+/// @param trailing Number of trimmed trailing samples.
+/// @returns The sparse block map, or zero on failure.
+sparse_map_t *find_constant_blocks(const sample_source_t &source, const block_layout_t &blocks, int num_samples, int num_channels, int leading, int trailing);
+
+} // namespace sac
+
+#endif // LIBSAC_CONSTANT_BLOCKS_H_
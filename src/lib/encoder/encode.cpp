@@ -26,29 +26,139 @@
 
 #include "encoder/encode_dd4a.h"
 #include "encoder/encode_dd8a.h"
+#include "encoder/sample_source.h"
+#include "envelope.h"
 #include "packed_data.h"
+#include "stats.h"
+#include "trace.h"
 
 using namespace sac;
 
-extern "C"
-sac_packed_data_t *sac_encode(int num_samples, int num_channels, int sample_rate, sac_encoding_t format, int16_t **channels) {
+namespace {
+
+packed_data_t *encode(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, const sample_source_t &source) {
+  api_timer_t timer(SAC_API_ENCODE);
+  LIBSAC_PROBE4(encode__entry, num_samples, num_channels, sample_rate, options ? options->format : SAC_FORMAT_UNDEFINED);
+
   // Check input arguments
-  if (!channels || num_channels < 1 || num_samples < 1 || sample_rate < 1 || (format != SAC_FORMAT_DD4A && format != SAC_FORMAT_DD8A)) {
+  if (!options || num_channels < 1 || num_samples < 1 || sample_rate < 1 ||
+      (options->format != SAC_FORMAT_DD4A && options->format != SAC_FORMAT_DD8A) ||
+      !block_layout_t::is_valid_layout(options->layout) ||
+      (options->block_size != 0 && !block_layout_t::is_valid_block_size(options->format, options->block_size)) ||
+      options->peak_bin_size < 0) {
+    LIBSAC_PROBE4(encode__return, 0, num_samples, num_channels, options ? options->format : SAC_FORMAT_UNDEFINED);
     return 0;
   }
+  const int block_size = options->block_size != 0 ? options->block_size : block_layout_t::default_block_size(options->format);
 
   // Perform format dependent encoding.
   packed_data_t *out = 0;
-  switch (format) {
+  switch (options->format) {
     case SAC_FORMAT_DD4A:
-      out = dd4a::encode(num_samples, num_channels, sample_rate, channels);
+      out = dd4a::encode(num_samples, num_channels, sample_rate, block_size, options->layout, options->map_search != 0, source);
       break;
     case SAC_FORMAT_DD8A:
-      out = dd8a::encode(num_samples, num_channels, sample_rate, channels);
+      out = dd8a::encode(num_samples, num_channels, sample_rate, block_size, options->layout, options->map_search != 0, source);
       break;
     default:
       break;
   }
 
-  return reinterpret_cast<sac_packed_data_t*>(out);
+  // Precompute the envelope from the encoded data (i.e. the decoded samples).
+  if (out && options->peak_bin_size > 0) {
+    peak_table_t *peak_table = compute_peak_table(out, options->peak_bin_size);
+    if (!peak_table) {
+      delete out;
+      out = 0;
+    } else {
+      out->set_peak_table(peak_table);
+    }
+  }
+
+  LIBSAC_PROBE4(encode__return, out, num_samples, num_channels, options->format);
+  return out;
+}
+
+} // anonymous namespace
+
+extern "C"
+void sac_init_encode_options(sac_encode_options_t *options) {
+  if (!options) {
+    return;
+  }
+  options->format = SAC_FORMAT_DD8A;
+  options->layout = SAC_LAYOUT_DEFAULT;
+  options->dither = 0;
+  options->block_size = 0;
+  options->peak_bin_size = 0;
+  options->map_search = 0;
+}
+
+extern "C"
+sac_packed_data_t *sac_encode(int num_samples, int num_channels, int sample_rate, sac_encoding_t format, int16_t **channels) {
+  sac_encode_options_t options;
+  sac_init_encode_options(&options);
+  options.format = format;
+  return sac_encode_ex(num_samples, num_channels, sample_rate, &options, channels);
+}
+
+extern "C"
+sac_packed_data_t *sac_encode_ex(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, int16_t **channels) {
+  if (!channels) {
+    return 0;
+  }
+  const int16_source_t source(channels);
+  return reinterpret_cast<sac_packed_data_t*>(encode(num_samples, num_channels, sample_rate, options, source));
+}
+
+extern "C"
+sac_packed_data_t *sac_encode_int32(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, const int32_t *const *channels) {
+  if (!channels || !options) {
+    return 0;
+  }
+  const int32_source_t source(channels, options->dither != 0);
+  return reinterpret_cast<sac_packed_data_t*>(encode(num_samples, num_channels, sample_rate, options, source));
+}
+
+extern "C"
+sac_packed_data_t *sac_encode_float(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, const float *const *channels) {
+  if (!channels || !options) {
+    return 0;
+  }
+  const float_source_t source(channels, options->dither != 0);
+  return reinterpret_cast<sac_packed_data_t*>(encode(num_samples, num_channels, sample_rate, options, source));
+}
+
+extern "C"
+sac_packed_data_t *sac_transcode(const sac_packed_data_t *data_, sac_encoding_t format) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data) {
+    return 0;
+  }
+
+  // Keep the layout, any long block size and any precomputed envelope.
+  sac_encode_options_t options;
+  sac_init_encode_options(&options);
+  options.format = format;
+  options.layout = data->layout();
+  if (data->block_size() != block_layout_t::default_block_size(data->encoding())) {
+    options.block_size = data->block_size();
+  }
+  if (data->peak_table()) {
+    options.peak_bin_size = data->peak_table()->samples_per_bin();
+  }
+  return sac_transcode_ex(data_, &options);
+}
+
+extern "C"
+sac_packed_data_t *sac_transcode_ex(const sac_packed_data_t *data_, const sac_encode_options_t *options) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data) {
+    return 0;
+  }
+
+  // The source blocks are decoded as the encoder needs them, so the sound is
+  // never decoded as a whole.
+  const packed_source_t source(data);
+  return reinterpret_cast<sac_packed_data_t*>(encode(data->num_samples(), data->num_channels(), data->sample_rate(), options, source));
 }
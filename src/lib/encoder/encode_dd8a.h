@@ -26,13 +26,35 @@
 #define LIBSAC_ENCODE_DD8A_H_
 
 #include "libsac.h"
+#include "encoder/sample_source.h"
 #include "packed_data.h"
 
 namespace sac {
 
 namespace dd8a {
 
-packed_data_t *encode(int num_samples, int num_channels, int sample_rate, int16_t **channels);
+/// @brief Encode a single block.
+/// This routine will find the best encoding parameters for the given block,
+/// and encode it accordingly.
+/// @param in Samples to be encoded.
+/// @param header Encoded output block header.
+/// @param out Encoded output block codes.
+/// @param count Number of samples to encode.
+/// @param stride The input sample stride.
+/// @returns The number of reconstructed samples that had to be clamped.
+int encode_block(const int16_t *in, uint8_t *header, uint8_t *out, int count, int stride);
+
+/// @brief Encode a sound.
+/// @param num_samples Number of samples per channel.
+/// @param num_channels Number of channels.
+/// @param sample_rate The sample rate (Hz).
+/// @param block_size The block size (samples per block).
+/// @param layout The block layout (SAC_LAYOUT_* flags).
+/// @param map_search Search all maps and predictors for the smallest error
+/// of each block (much slower).
+/// @param source The input samples.
+/// @returns The packed data, or 0 on failure.
+packed_data_t *encode(int num_samples, int num_channels, int sample_rate, int block_size, int layout, bool map_search, const sample_source_t &source);
 
 } // namespace dd8a
 
@@ -0,0 +1,310 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Generic DDPCM encoder, instantiated for each format from its format traits
+// (see format_traits.h).
+//-----------------------------------------------------------------------------
+// This encoder is fairly generic, and not very optimized. There are several
+// possible optimizations that could improve encoding speeds.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_ENCODER_H_
+#define LIBSAC_ENCODER_H_
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "allocator.h"
+#include "encoder/analyzer.h"
+#include "encoder/constant_blocks.h"
+#include "encoder/mapper.h"
+#include "encoder/sample_source.h"
+#include "format_traits.h"
+#include "packed_data.h"
+#include "stats.h"
+#include "trace.h"
+#include "util.h"
+
+namespace sac {
+
+// Number of blocks per parallel work item.
+const int kBlocksPerChunk = 64;
+
+template <class FORMAT>
+class encoder_t {
+  public:
+    encoder_t() : m_mapper(FORMAT::lut()) {}
+
+    /// @brief Encode a single block.
+    /// This routine will find the best encoding parameters for the given block,
+    /// and encode it accordingly.
+    /// @param in Samples to be encoded.
+    /// @param header Encoded output block header.
+    /// @param out Encoded output block codes.
+    /// @param count Number of samples to encode.
+    /// @param stride The input sample stride.
+    /// @param map_search If true, all maps and predictors are tried, and the
+    /// ones that give the smallest error are used. Otherwise they are selected
+    /// from an analysis of the block (much faster).
+    /// @returns The number of reconstructed samples that had to be clamped.
+    int encode_block(const int16_t *in, uint8_t *header, uint8_t *out, int count, int stride, bool map_search) const {
+      if (count < 1) {
+        return 0;
+      }
+
+      int map_no, predictor_no;
+      if (map_search) {
+        search_map(in, count, stride, &map_no, &predictor_no);
+      } else {
+        // Analyze the block (select predictor etc).
+        const analysis_result_t analysis = analyze_block(in, count, stride);
+
+        // Find the map that best matches this block.
+        map_no = FORMAT::select_map(analysis, m_mapper);
+        predictor_no = analysis.predictor_no;
+      }
+
+      // Encode the block.
+      const int num_clamped = encode_block(in, header, out, count, stride, map_no, predictor_no);
+
+      // Update the statistics.
+      sac_stats_t *stats = thread_stats();
+      if (stats) {
+        count_encoded_block(stats, FORMAT::kEncoding, map_no, predictor_no, num_clamped);
+      }
+
+      return num_clamped;
+    }
+
+    /// @brief Encode a sound.
+    /// @param num_samples Number of samples per channel.
+    /// @param num_channels Number of channels.
+    /// @param sample_rate The sample rate (Hz).
+    /// @param block_size The block size (samples per block).
+    /// @param layout The block layout (SAC_LAYOUT_* flags).
+    /// @param map_search Search all maps and predictors (see encode_block).
+    /// @param source The input samples.
+    /// @returns The packed data, or 0 on failure.
+    packed_data_t *encode(int num_samples, int num_channels, int sample_rate, int block_size, int layout, bool map_search, const sample_source_t &source) const {
+      // For the sparse layout, trim the leading and trailing silence and find
+      // the constant blocks, which are not coded.
+      int leading = 0, trailing = 0;
+      if (layout & SAC_LAYOUT_SPARSE) {
+        find_silence(source, num_samples, num_channels, &leading, &trailing);
+      }
+      const int coded_samples = num_samples - leading - trailing;
+      const block_layout_t blocks(FORMAT::kEncoding, block_size, layout, coded_samples, num_channels);
+      scoped_ptr<sparse_map_t> map;
+      if (layout & SAC_LAYOUT_SPARSE) {
+        map.reset(find_constant_blocks(source, blocks, num_samples, num_channels, leading, trailing));
+        if (!map.get()) {
+          return 0;
+        }
+      }
+
+      // Create the packed data container.
+      const int data_size = map.get() ? map->num_coded() * blocks.full_block_size() : blocks.data_size();
+      scoped_ptr<packed_data_t> data(new packed_data_t(data_size, num_samples, num_channels, sample_rate, FORMAT::kEncoding, block_size, layout, map.release()));
+      if (!data->is_valid()) {
+        return 0;
+      }
+
+      // Encode all the blocks (the final block may be a partial block). The
+      // work is split into chunks of blocks that are encoded in parallel.
+      // Blocks that had to be clamped are flagged, so that the decoder can use
+      // a faster kernel for all other blocks.
+      const int num_blocks = blocks.num_blocks();
+      scoped_buffer_t<uint8_t> clamped(static_cast<size_t>(num_blocks) * num_channels + 1, 0);
+      if (!clamped.get()) {
+        return 0;
+      }
+      const int num_chunks = (num_blocks + kBlocksPerChunk - 1) / kBlocksPerChunk;
+#ifdef LIBSAC_USE_OPENMP
+      #pragma omp parallel for
+#endif
+      for (int c = 0; c < num_chunks; ++c) {
+        const int first_block = c * kBlocksPerChunk;
+        const int chunk_blocks = std::min(kBlocksPerChunk, num_blocks - first_block);
+        LIBSAC_PROBE4(encode_chunk__entry, first_block, chunk_blocks, num_channels, FORMAT::kEncoding);
+        int16_t scratch[kMaxBlockSize];
+        for (int k = first_block; k < first_block + chunk_blocks; ++k) {
+          const int count = std::min(block_size, coded_samples - k * block_size);
+          for (int ch = 0; ch < num_channels; ++ch) {
+            block_offsets_t block;
+            int16_t value;
+            if (!data->locate_block(k, ch, &block, &value)) {
+              // Constant block.
+              continue;
+            }
+            if (count < block_size && block_layout_t::is_block_list(layout)) {
+              // Listed blocks always occupy a full block (clear the padding).
+              std::memset(data->data() + block.header, 0, blocks.full_block_size());
+            }
+            const int16_t *src = source.get_block(ch, leading + k * block_size, count, scratch);
+            const int num_clamped = encode_block(src, data->data() + block.header, data->data() + block.codes, count, 1, map_search);
+            clamped[k * num_channels + ch] = num_clamped > 0 ? 1 : 0;
+          }
+        }
+        LIBSAC_PROBE4(encode_chunk__return, first_block, chunk_blocks, num_channels, FORMAT::kEncoding);
+      }
+
+      // Zero the padding of the final superblocks.
+      blocks.clear_padding(data->data());
+
+      scoped_ptr<clamp_map_t> clamp_map(new clamp_map_t(num_blocks * num_channels));
+      if (!clamp_map->build(clamped.get())) {
+        return 0;
+      }
+      data->set_clamp_map(clamp_map.release());
+
+      // Store identical blocks only once.
+      if ((layout & SAC_LAYOUT_DEDUP) && !data->deduplicate()) {
+        return 0;
+      }
+
+      return data.release();
+    }
+
+  private:
+    typedef typename FORMAT::codes codes;
+
+    // Number of predictors (selected by one bit in the block header).
+    static const int kNumPredictors = 2;
+
+    /// @brief Get the starting sample of a block, with the block parameters
+    /// encoded in the low bits.
+    static int start_sample(int s_original, int map_no, int predictor_no) {
+      int s1 = FORMAT::pack_start(s_original, map_no, predictor_no);
+
+      // Do some rounding to improve the accuracy.
+      const int rounded1 = s1 + (1 << FORMAT::kStartShift);
+      const int rounded2 = s1 - (1 << FORMAT::kStartShift);
+      if (rounded1 <= 32767 && std::abs(rounded1 - s_original) < std::abs(s1 - s_original))
+        s1 = rounded1;
+      if (rounded2 >= -32768 && std::abs(rounded2 - s_original) < std::abs(s1 - s_original))
+        s1 = rounded2;
+      return s1;
+    }
+
+    static uint64_t square_error(int a, int b) {
+      const int64_t diff = a - b;
+      return static_cast<uint64_t>(diff * diff);
+    }
+
+    /// @brief Find the map and the predictor that encode a block with the
+    /// smallest error (sum of squared differences).
+    void search_map(const int16_t *in, int count, int stride, int *map_no, int *predictor_no) const {
+      uint64_t best_error = ~static_cast<uint64_t>(0);
+      *map_no = 0;
+      *predictor_no = 0;
+      for (int p = 0; p < kNumPredictors; ++p) {
+        for (int m = 0; m < FORMAT::kNumMaps; ++m) {
+          const uint64_t error = coding_error(in, count, stride, m, p, best_error);
+          if (error < best_error) {
+            best_error = error;
+            *map_no = m;
+            *predictor_no = p;
+          }
+        }
+      }
+    }
+
+    /// @brief Get the error (sum of squared differences) of encoding a block
+    /// with the given parameters.
+    /// @param max_error The search stops when the error exceeds this value.
+    uint64_t coding_error(const int16_t *in, int count, int stride, int map_no, int predictor_no, uint64_t max_error) const {
+      const int s_original = *in;
+      int s1 = start_sample(s_original, map_no, predictor_no);
+      int s2 = s1;
+      uint64_t error = square_error(s_original, s1);
+      const map_t<FORMAT::kEntriesPerMap> &map = m_mapper[map_no];
+      for (int i = 1; i < count && error <= max_error; ++i) {
+        in += stride;
+        const int predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
+        s2 = s1;
+        s1 = clamp(predicted + map.decode_delta(map.encode_delta(*in - predicted)));
+        error += square_error(*in, s1);
+      }
+      return error;
+    }
+
+    /// @brief Encode a single block.
+    /// This is the encoder core.
+    /// @param in Samples to be encoded.
+    /// @param header Encoded output block header.
+    /// @param out Encoded output block codes.
+    /// @param count Number of samples to encode.
+    /// @param stride The input sample stride.
+    /// @param map_no The quantization map number to use.
+    /// @param predictor_no The predictor to use.
+    /// @returns The number of reconstructed samples that had to be clamped.
+    int encode_block(const int16_t *in, uint8_t *header, uint8_t *out, int count, int stride, int map_no, int predictor_no) const {
+      // Get the starting sample.
+      int s_original = *in;
+      in += stride;
+
+      // Encode the block parameters in the low bits of the starting sample.
+      int s1 = start_sample(s_original, map_no, predictor_no);
+
+      // Output the starting sample (16 bits).
+      header[0] = s1;
+      header[1] = s1 >> 8;
+
+      // Output the remaining block parameters (if any) as header codes.
+      if (FORMAT::kHeaderCodes > 0) {
+        codes::put(out, 0, FORMAT::header_code(map_no, predictor_no));
+      }
+
+      // Get the coding map for this block.
+      const map_t<FORMAT::kEntriesPerMap> &map = m_mapper[map_no];
+
+      // The code of sample i (i >= 1) is at index i + kCodeBias.
+      const int kCodeBias = FORMAT::kHeaderCodes - 1;
+      int s2 = s1;
+      int num_clamped = 0;
+      for (int i = 1; i < count; ++i) {
+        // Encode the delta.
+        const int predicted = predictor_no == 0 ? s1 : 2 * s1 - s2;
+        const uint8_t code = map.encode_delta(*in - predicted);
+        in += stride;
+
+        // Output encoded code.
+        codes::put(out, i + kCodeBias, code);
+
+        // Decode and clamp for the next pass...
+        s2 = s1;
+        const int unclamped = predicted + map.decode_delta(code);
+        s1 = clamp(unclamped);
+        num_clamped += s1 != unclamped ? 1 : 0;
+      }
+
+      return num_clamped;
+    }
+
+    typename FORMAT::mapper m_mapper;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_ENCODER_H_
@@ -0,0 +1,122 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Conversion to 16-bit samples, with optional TPDF (triangular probability
+// density function) dither of +/-1 LSB.
+//
+// The dither noise is seeded per block (from the channel and the start
+// sample), so that the result is deterministic regardless of how the blocks
+// are distributed between threads.
+//-----------------------------------------------------------------------------
+
+#include "encoder/sample_source.h"
+
+#include <cmath>
+
+#include "decoder/decode.h"
+#include "util.h"
+
+namespace sac {
+
+namespace {
+
+/// @brief Pseudo random number generator for the dither noise.
+class dither_rng_t {
+  public:
+    dither_rng_t(int channel, int start) {
+      // Hash the block position into a non-zero seed.
+      uint32_t x = static_cast<uint32_t>(start) * 0x9e3779b9u ^ static_cast<uint32_t>(channel) * 0x85ebca6bu;
+      x ^= x >> 16;
+      x *= 0x7feb352du;
+      x ^= x >> 15;
+      m_state = x | 1u;
+    }
+
+    /// @returns A uniformly distributed 16-bit random number.
+    uint32_t next() {
+      // Xorshift32.
+      m_state ^= m_state << 13;
+      m_state ^= m_state >> 17;
+      m_state ^= m_state << 5;
+      return m_state >> 16;
+    }
+
+    /// @returns TPDF noise in the range (-65536, 65536), i.e. +/-1 LSB in
+    /// 16.16 fixed point.
+    int tpdf() {
+      return static_cast<int>(next()) + static_cast<int>(next()) - 65535;
+    }
+
+  private:
+    uint32_t m_state;
+};
+
+} // anonymous namespace
+
+const int16_t *int32_source_t::get_block(int channel, int start, int count, int16_t *scratch) const {
+  const int32_t *in = &m_channels[channel][start];
+  if (m_dither) {
+    dither_rng_t rng(channel, start);
+    for (int i = 0; i < count; ++i) {
+      const int64_t x = static_cast<int64_t>(in[i]) + rng.tpdf() + 32768;
+      scratch[i] = static_cast<int16_t>(clamp(static_cast<int>(x >> 16)));
+    }
+  } else {
+    for (int i = 0; i < count; ++i) {
+      const int64_t x = static_cast<int64_t>(in[i]) + 32768;
+      scratch[i] = static_cast<int16_t>(clamp(static_cast<int>(x >> 16)));
+    }
+  }
+  return scratch;
+}
+
+const int16_t *float_source_t::get_block(int channel, int start, int count, int16_t *scratch) const {
+  const float *in = &m_channels[channel][start];
+  dither_rng_t rng(channel, start);
+  for (int i = 0; i < count; ++i) {
+    float x = in[i] * 32768.0f;
+    if (m_dither) {
+      x += static_cast<float>(rng.tpdf()) * (1.0f / 65536.0f);
+    }
+
+    // Round and clamp (NaN maps to zero).
+    x = std::floor(x + 0.5f);
+    int y = 0;
+    if (x >= 32767.0f) {
+      y = 32767;
+    } else if (x <= -32768.0f) {
+      y = -32768;
+    } else if (x == x) {
+      y = static_cast<int>(x);
+    }
+    scratch[i] = static_cast<int16_t>(y);
+  }
+  return scratch;
+}
+
+const int16_t *packed_source_t::get_block(int channel, int start, int count, int16_t *scratch) const {
+  decode_uncached(scratch, m_data, start, count, channel);
+  return scratch;
+}
+
+} // namespace sac
@@ -0,0 +1,104 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_SAMPLE_SOURCE_H_
+#define LIBSAC_SAMPLE_SOURCE_H_
+
+#include "libsac.h"
+
+namespace sac {
+
+class packed_data_t;
+
+/// @brief Input samples for the encoders.
+/// The encoders fetch their input one block at a time through this interface,
+/// so that any conversion to 16-bit samples is done block by block, without
+/// creating a 16-bit copy of the entire signal.
+class sample_source_t {
+  public:
+    virtual ~sample_source_t() {}
+
+    /// @brief Get the 16-bit samples of a block.
+    /// @param channel The channel.
+    /// @param start The first sample of the block.
+    /// @param count Number of samples in the block.
+    /// @param scratch A buffer that can hold (at least) count samples.
+    /// @returns A pointer to count samples (either into the source signal or
+    /// into the scratch buffer).
+    virtual const int16_t *get_block(int channel, int start, int count, int16_t *scratch) const = 0;
+};
+
+/// @brief 16-bit samples (no conversion).
+class int16_source_t : public sample_source_t {
+  public:
+    int16_source_t(const int16_t *const *channels) : m_channels(channels) {}
+
+    const int16_t *get_block(int channel, int start, int count, int16_t *scratch) const {
+      (void)count;
+      (void)scratch;
+      return &m_channels[channel][start];
+    }
+
+  private:
+    const int16_t *const *m_channels;
+};
+
+/// @brief 32-bit integer samples (full scale is the full 32-bit range).
+class int32_source_t : public sample_source_t {
+  public:
+    int32_source_t(const int32_t *const *channels, bool dither) : m_channels(channels), m_dither(dither) {}
+
+    const int16_t *get_block(int channel, int start, int count, int16_t *scratch) const;
+
+  private:
+    const int32_t *const *m_channels;
+    const bool m_dither;
+};
+
+/// @brief Floating point samples (full scale is [-1.0, 1.0)).
+class float_source_t : public sample_source_t {
+  public:
+    float_source_t(const float *const *channels, bool dither) : m_channels(channels), m_dither(dither) {}
+
+    const int16_t *get_block(int channel, int start, int count, int16_t *scratch) const;
+
+  private:
+    const float *const *m_channels;
+    const bool m_dither;
+};
+
+/// @brief Packed data (i.e. transcoding), which is decoded block by block.
+class packed_source_t : public sample_source_t {
+  public:
+    packed_source_t(const packed_data_t *data) : m_data(data) {}
+
+    const int16_t *get_block(int channel, int start, int count, int16_t *scratch) const;
+
+  private:
+    const packed_data_t *m_data;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_SAMPLE_SOURCE_H_
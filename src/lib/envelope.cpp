@@ -0,0 +1,276 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+#include "envelope.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "allocator.h"
+#include "decoder/decode.h"
+#include "format_traits.h"
+
+namespace sac {
+
+namespace {
+
+typedef peak_table_t::bin_t bin_t;
+
+// Number of samples that are decoded at a time (into a stack buffer).
+const int kSliceSamples = 4096;
+
+// Number of samples per parallel task (exact envelopes).
+const int kSamplesPerTask = 65536;
+
+/// @returns The number of bins per channel.
+int count_bins(int samples_per_bin, int num_samples) {
+  return num_samples / samples_per_bin + (num_samples % samples_per_bin != 0 ? 1 : 0);
+}
+
+void init_bins(bin_t *bins, int num_bins) {
+  for (int i = 0; i < num_bins; ++i) {
+    bins[i].min = 32767;
+    bins[i].max = -32768;
+    bins[i].sum_sq = 0;
+  }
+}
+
+/// @brief Add decoded samples to a bin.
+void add_samples(bin_t *bin, const int16_t *samples, int count) {
+  int lo = bin->min;
+  int hi = bin->max;
+  uint64_t sum_sq = 0;
+  for (int k = 0; k < count; ++k) {
+    const int x = samples[k];
+    lo = std::min(lo, x);
+    hi = std::max(hi, x);
+    sum_sq += static_cast<uint32_t>(x * x);
+  }
+  bin->min = static_cast<int16_t>(lo);
+  bin->max = static_cast<int16_t>(hi);
+  bin->sum_sq += sum_sq;
+}
+
+/// @brief Add a constant estimate to the bins that overlap a range of
+/// samples.
+/// @param bins The bins of the channel.
+/// @param samples_per_bin Number of samples per bin.
+/// @param start First sample of the range.
+/// @param end End of the range.
+/// @param lo The estimated min of the range.
+/// @param hi The estimated max of the range.
+/// @param value The estimated value of each sample of the range (for the sum
+/// of squares).
+void add_range(bin_t *bins, int samples_per_bin, int start, int end, int lo, int hi, int value) {
+  while (start < end) {
+    const int n = std::min(end - start, samples_per_bin - start % samples_per_bin);
+    bin_t &bin = bins[start / samples_per_bin];
+    bin.min = static_cast<int16_t>(std::min(static_cast<int>(bin.min), lo));
+    bin.max = static_cast<int16_t>(std::max(static_cast<int>(bin.max), hi));
+    bin.sum_sq += static_cast<uint64_t>(static_cast<uint32_t>(value * value)) * n;
+    start += n;
+  }
+}
+
+/// @brief Decode the samples of a range of bins of a channel.
+/// @param data The packed data.
+/// @param channel The channel.
+/// @param samples_per_bin Number of samples per bin.
+/// @param first_bin The first bin.
+/// @param end_bin The end of the range of bins.
+/// @param bins The bins (starting at first_bin).
+void decode_bins(const packed_data_t *data, int channel, int samples_per_bin, int first_bin, int end_bin, bin_t *bins) {
+  const int end = static_cast<int>(std::min(static_cast<int64_t>(end_bin) * samples_per_bin, static_cast<int64_t>(data->num_samples())));
+  int16_t samples[kSliceSamples];
+  for (int pos = first_bin * samples_per_bin; pos < end; pos += kSliceSamples) {
+    const int count = std::min(kSliceSamples, end - pos);
+    decode_uncached(samples, data, pos, count, channel);
+
+    // Split the slice at the bin boundaries.
+    for (int k = 0; k < count;) {
+      const int n = std::min(count - k, samples_per_bin - (pos + k) % samples_per_bin);
+      add_samples(&bins[(pos + k) / samples_per_bin - first_bin], samples + k, n);
+      k += n;
+    }
+  }
+}
+
+/// @brief Compute the exact envelope of a channel.
+/// The samples are decoded (with the SIMD block decoders, where available) in
+/// parallel tasks of whole bins.
+void compute_exact(const packed_data_t *data, int channel, int samples_per_bin, int num_bins, bin_t *bins) {
+  init_bins(bins, num_bins);
+  const int bins_per_task = std::max(1, kSamplesPerTask / samples_per_bin);
+  const int num_tasks = (num_bins + bins_per_task - 1) / bins_per_task;
+  #pragma omp parallel for schedule(dynamic)
+  for (int t = 0; t < num_tasks; ++t) {
+    const int first_bin = t * bins_per_task;
+    const int end_bin = std::min(first_bin + bins_per_task, num_bins);
+    decode_bins(data, channel, samples_per_bin, first_bin, end_bin, bins + first_bin);
+  }
+}
+
+/// @brief Estimate the envelope of a channel from the block headers.
+/// Each coded block is represented by its starting sample. For the min/max,
+/// it is widened by half the largest delta of its quantization map, which is
+/// an estimate (not a bound) of how far the block strays from its starting
+/// sample. Constant blocks and trimmed silence are exact.
+template <sac_encoding_t ENCODING>
+void estimate_blocks(const packed_data_t *data, int channel, int samples_per_bin, bin_t *bins) {
+  typedef format_traits<ENCODING> format;
+
+  // Half the largest delta of each map.
+  int spread[format::kNumMaps];
+  for (int m = 0; m < format::kNumMaps; ++m) {
+    spread[m] = 0;
+    for (int e = 0; e < format::kEntriesPerMap; ++e) {
+      spread[m] = std::max(spread[m], std::abs(static_cast<int>(format::lut()[m][e])));
+    }
+    spread[m] /= 2;
+  }
+
+  const int block_size = data->block_size();
+  const int leading = data->leading_silence();
+  const int coded_end = leading + data->coded_samples();
+  const int num_blocks = data->blocks().num_blocks();
+  for (int k = 0; k < num_blocks; ++k) {
+    const int start = leading + k * block_size;
+    const int end = std::min(start + block_size, coded_end);
+    block_offsets_t block;
+    int16_t value;
+    if (!data->locate_block(k, channel, &block, &value)) {
+      add_range(bins, samples_per_bin, start, end, value, value, value);
+      continue;
+    }
+    const uint8_t *header = data->data() + block.header;
+    const int s = static_cast<int16_t>(header[0] | (header[1] << 8));
+    int map_no, predictor_no;
+    format::unpack_header(s, data->data() + block.codes, &map_no, &predictor_no);
+    add_range(bins, samples_per_bin, start, end, std::max(s - spread[map_no], -32768), std::min(s + spread[map_no], 32767), s);
+  }
+
+  // Trimmed silence.
+  add_range(bins, samples_per_bin, 0, leading, 0, 0, 0);
+  add_range(bins, samples_per_bin, coded_end, data->num_samples(), 0, 0, 0);
+}
+
+/// @brief Merge the bins of a precomputed envelope into larger bins.
+/// @param table The precomputed envelope.
+/// @param channel The channel.
+/// @param factor Number of precomputed bins per bin.
+/// @param num_bins Number of bins.
+/// @param bins The bins.
+void merge_bins(const peak_table_t *table, int channel, int factor, int num_bins, bin_t *bins) {
+  init_bins(bins, num_bins);
+  const bin_t *src = table->bins(channel);
+  for (int i = 0; i < table->num_bins(); ++i) {
+    bin_t &bin = bins[i / factor];
+    bin.min = std::min(bin.min, src[i].min);
+    bin.max = std::max(bin.max, src[i].max);
+    bin.sum_sq += src[i].sum_sq;
+  }
+}
+
+int compute_envelope(const packed_data_t *data, int channel, int samples_per_bin, sac_envelope_mode_t mode, int16_t *min, int16_t *max, float *rms) {
+  if (!data || channel < 0 || channel >= data->num_channels() || samples_per_bin < 1 ||
+      (mode != SAC_ENVELOPE_EXACT && mode != SAC_ENVELOPE_APPROX) || data->num_samples() < 1) {
+    return 0;
+  }
+  const int num_samples = data->num_samples();
+  const int num_bins = count_bins(samples_per_bin, num_samples);
+  scoped_buffer_t<bin_t> bins(num_bins);
+  if (!bins.get()) {
+    return 0;
+  }
+
+  const peak_table_t *table = data->peak_table();
+  if (table && samples_per_bin % table->samples_per_bin() == 0) {
+    merge_bins(table, channel, samples_per_bin / table->samples_per_bin(), num_bins, bins.get());
+  } else if (mode == SAC_ENVELOPE_EXACT) {
+    compute_exact(data, channel, samples_per_bin, num_bins, bins.get());
+  } else {
+    init_bins(bins.get(), num_bins);
+    switch (data->encoding()) {
+      case SAC_FORMAT_DD4A:
+        estimate_blocks<SAC_FORMAT_DD4A>(data, channel, samples_per_bin, bins.get());
+        break;
+      case SAC_FORMAT_DD8A:
+        estimate_blocks<SAC_FORMAT_DD8A>(data, channel, samples_per_bin, bins.get());
+        break;
+      default:
+        return 0;
+    }
+  }
+
+  for (int b = 0; b < num_bins; ++b) {
+    if (min) {
+      min[b] = bins[b].min;
+    }
+    if (max) {
+      max[b] = bins[b].max;
+    }
+    if (rms) {
+      const int count = b < num_bins - 1 ? samples_per_bin : num_samples - b * samples_per_bin;
+      rms[b] = static_cast<float>(std::sqrt(static_cast<double>(bins[b].sum_sq) / count));
+    }
+  }
+  return num_bins;
+}
+
+} // anonymous namespace
+
+peak_table_t *compute_peak_table(const packed_data_t *data, int samples_per_bin) {
+  scoped_ptr<peak_table_t> table(new peak_table_t(samples_per_bin, data->num_samples(), data->num_channels()));
+  if (samples_per_bin < 1 || !table->is_valid()) {
+    return 0;
+  }
+  for (int ch = 0; ch < data->num_channels(); ++ch) {
+    compute_exact(data, ch, samples_per_bin, table->num_bins(), table->bins(ch));
+  }
+  return table.release();
+}
+
+void compute_peak_bins(const packed_data_t *data, int channel, int samples_per_bin, int first_bin, int end_bin, bin_t *bins) {
+  init_bins(bins, end_bin - first_bin);
+  decode_bins(data, channel, samples_per_bin, first_bin, end_bin, bins);
+}
+
+} // namespace sac
+
+using namespace sac;
+
+extern "C"
+int sac_compute_envelope(const sac_packed_data_t *data_, int channel, int samples_per_bin, sac_envelope_mode_t mode, int16_t *min, int16_t *max, float *rms) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  return compute_envelope(data, channel, samples_per_bin, mode, min, max, rms);
+}
+
+extern "C"
+int sac_get_peak_bin_size(const sac_packed_data_t *data_) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data || !data->peak_table()) {
+    return 0;
+  }
+  return data->peak_table()->samples_per_bin();
+}
@@ -0,0 +1,49 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_ENVELOPE_H_
+#define LIBSAC_ENVELOPE_H_
+
+#include "packed_data.h"
+
+namespace sac {
+
+/// @brief Compute the envelope of all channels by decoding the data.
+/// @param data The packed data.
+/// @param samples_per_bin Number of samples per bin.
+/// @returns The envelope, or zero on failure.
+peak_table_t *compute_peak_table(const packed_data_t *data, int samples_per_bin);
+
+/// @brief Compute a range of bins of a channel by decoding the data.
+/// @param data The packed data.
+/// @param channel The channel.
+/// @param samples_per_bin Number of samples per bin.
+/// @param first_bin The first bin.
+/// @param end_bin The end of the range of bins.
+/// @param bins The bins (starting at first_bin).
+void compute_peak_bins(const packed_data_t *data, int channel, int samples_per_bin, int first_bin, int end_bin, peak_table_t::bin_t *bins);
+
+} // namespace sac
+
+#endif // LIBSAC_ENVELOPE_H_
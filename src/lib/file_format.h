@@ -0,0 +1,189 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// SAC file format:
+//
+//   "SAC\1" <size>            Master chunk (size = file size - 8)
+//     "FRMT" <size>           Format chunk (14 or 16 bytes)
+//       <fourcc>              Packed data format ("DD4A" or "DD8A", or the
+//                             long block variants "DD4B"/"DD8B" with 64
+//                             samples per block and "DD4C"/"DD8C" with 128
+//                             samples per block). The last letter is lower
+//                             case (e.g. "DD4a") for all non-default
+//                             layouts, so that loaders that do not know
+//                             about the layout field reject the file.
+//       <num_samples>         Number of samples per channel (32 bits)
+//       <num_channels>        Number of channels (16 bits)
+//       <sample_rate>         Sample rate in Hz (32 bits)
+//       [<layout>]            Block layout flags (16 bits, optional)
+//     ["SPRS" <size>]         Sparse block map (only for SAC_LAYOUT_SPARSE,
+//                             see sparse_map.h)
+//       <leading>             Number of trimmed leading samples (32 bits)
+//       <trailing>            Number of trimmed trailing samples (32 bits)
+//       <num_runs>            Number of constant block runs (32 bits)
+//       <constant_bits>       One bit per block, set for constant blocks
+//                             (64-bit words, in block storage order)
+//       <run_bits>            One bit per block, set for the first block of
+//                             each run (64-bit words)
+//       <run_values>          The sample value of each run (16 bits each)
+//     ["BIDX" <size>]         Deduplication table (only for SAC_LAYOUT_DEDUP,
+//                             see dedup_table.h)
+//       <num_unique>          Number of unique blocks (32 bits)
+//       <entries>             The unique block number of each listed block
+//                             (16 bits each if num_unique <= 65536, otherwise
+//                             32 bits each)
+//     ["CLMP" <size>]         Clamp map (optional, see clamp_map.h)
+//       <num_clamped>         Number of clamped blocks (32 bits)
+//       <indices>             The index of each clamped block, in increasing
+//                             order (32 bits each)
+//     ["PEAK" <size>]         Peak table (optional, see peak_table.h)
+//       <samples_per_bin>     Number of samples per bin (32 bits)
+//       <bins>                The bins of each channel, one channel after
+//                             another: min (16 bits), max (16 bits) and sum
+//                             of squared samples (64 bits)
+//     "DATA" <size>           Data chunk (the encoded blocks)
+//
+// All values are little endian. Unknown chunks are ignored by the loader. The
+// SPRS, BIDX, CLMP and PEAK chunks must come after the FRMT chunk and before
+// the DATA chunk, in that order. Without a CLMP chunk, all blocks are assumed
+// to need clamping when decoded.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_FILE_FORMAT_H_
+#define LIBSAC_FILE_FORMAT_H_
+
+#include "../include/libsac.h"
+#include "block_layout.h"
+
+namespace sac {
+
+/// @brief Max size of a file header (everything up to the data chunk payload).
+const int kMaxFileHeaderSize = 8 + 8 + 16 + 8;
+
+/// @brief Create a SAC file header.
+/// @param out The output buffer (at least kMaxFileHeaderSize bytes).
+/// @param encoding The encoding format.
+/// @param block_size The block size (samples per block).
+/// @param layout The block layout flags.
+/// @param num_samples Number of samples per channel.
+/// @param num_channels Number of channels.
+/// @param sample_rate The sample rate.
+/// @param data_size Size of the data chunk payload.
+/// @param extra_size Size of any extra chunks (including their chunk headers)
+/// that are written between the format chunk and the data chunk.
+/// @returns The size of the header (in bytes), or zero for an unsupported
+/// encoding. The data chunk header (chunk ID and size) is always the last
+/// eight bytes, which is where any extra chunks are to be inserted.
+int make_file_header(uint8_t *out, sac_encoding_t encoding, int block_size, int layout, uint32_t num_samples, int num_channels, int sample_rate, uint32_t data_size, uint32_t extra_size = 0);
+
+/// @brief Check if a layout must be signalled by the format fourcc.
+/// Data in any non-default layout can not be decoded as the default layout
+/// (even if the size of the data happens to match), so it must be rejected
+/// by loaders that only read the fourcc.
+inline bool is_fourcc_layout(int layout) {
+  return layout != SAC_LAYOUT_DEFAULT;
+}
+
+/// @brief Get the format fourcc for an encoding, block size and layout.
+/// @returns The fourcc, or zero for an unsupported format.
+inline uint32_t format_fourcc(sac_encoding_t encoding, int block_size, int layout) {
+  uint32_t fourcc;
+  switch (encoding) {
+    case SAC_FORMAT_DD4A:
+      fourcc = 0x00344444;  // "DD4?"
+      break;
+    case SAC_FORMAT_DD8A:
+      fourcc = 0x00384444;  // "DD8?"
+      break;
+    default:
+      return 0;
+  }
+  if (is_fourcc_layout(layout)) {
+    fourcc |= 0x20000000;        // Lower case
+  }
+  if (block_size == block_layout_t::default_block_size(encoding)) {
+    return fourcc | 0x41000000;  // "A"
+  } else if (block_size == 64) {
+    return fourcc | 0x42000000;  // "B"
+  } else if (block_size == 128) {
+    return fourcc | 0x43000000;  // "C"
+  }
+  return 0;
+}
+
+/// @brief Get the encoding and block size from a format fourcc.
+/// @param fourcc_layout Set to true if the layout must be one that is
+/// signalled by the fourcc (see is_fourcc_layout).
+/// @returns false for an unsupported format.
+inline bool parse_format_fourcc(uint32_t fourcc, sac_encoding_t *encoding, int *block_size, bool *fourcc_layout) {
+  switch (fourcc & 0x00ffffff) {
+    case 0x00344444:
+      *encoding = SAC_FORMAT_DD4A;
+      break;
+    case 0x00384444:
+      *encoding = SAC_FORMAT_DD8A;
+      break;
+    default:
+      return false;
+  }
+  *fourcc_layout = (fourcc & 0x20000000) != 0;
+  switch ((fourcc >> 24) & ~0x20u) {
+    case 0x41:
+      *block_size = block_layout_t::default_block_size(*encoding);
+      return true;
+    case 0x42:
+      *block_size = 64;
+      return true;
+    case 0x43:
+      *block_size = 128;
+      return true;
+    default:
+      return false;
+  }
+}
+
+/// @brief Load a 16-bit little endian value.
+inline uint16_t get_uint16(const uint8_t *in) {
+  return static_cast<uint16_t>(in[0]) |
+      (static_cast<uint16_t>(in[1]) << 8);
+}
+
+/// @brief Load a 32-bit little endian value.
+inline uint32_t get_uint32(const uint8_t *in) {
+  return static_cast<uint32_t>(in[0]) |
+      (static_cast<uint32_t>(in[1]) << 8) |
+      (static_cast<uint32_t>(in[2]) << 16) |
+      (static_cast<uint32_t>(in[3]) << 24);
+}
+
+/// @brief Store a 32-bit little endian value.
+inline void put_uint32(uint8_t *out, uint32_t x) {
+  out[0] = static_cast<uint8_t>(x);
+  out[1] = static_cast<uint8_t>(x >> 8);
+  out[2] = static_cast<uint8_t>(x >> 16);
+  out[3] = static_cast<uint8_t>(x >> 24);
+}
+
+} // namespace sac
+
+#endif // LIBSAC_FILE_FORMAT_H_
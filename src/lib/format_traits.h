@@ -0,0 +1,246 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_FORMAT_TRAITS_H_
+#define LIBSAC_FORMAT_TRAITS_H_
+
+#include <cstdlib>
+
+#include "libsac.h"
+#include "encoder/analyzer.h"
+#include "encoder/mapper.h"
+
+namespace sac {
+
+/// @brief Block sizes of the long block format variants.
+const int kLongBlockSizes[] = {64, 128};
+
+/// @brief The largest block size of any format.
+const int kMaxBlockSize = 128;
+
+namespace dd4a {
+// Defined in quant_lut_dd4a.cpp
+extern const short kQuantLut[64][16];
+} // namespace dd4a
+
+namespace dd8a {
+// Defined in quant_lut_dd8a.cpp
+extern const short kQuantLut[8][256];
+} // namespace dd8a
+
+/// @brief Access to the packed codes of a block.
+/// Codes are packed MSB first, i.e. for 4-bit codes the first code of a byte
+/// is in the high nibble.
+template <int BITS_PER_CODE>
+struct codes_t;
+
+template <>
+struct codes_t<4> {
+  static const int kCodesPerByte = 2;
+
+  /// @returns Code n (0 <= n < kCodesPerByte) of a byte.
+  static int unpack(int byte, int n) {
+    return (byte >> (4 - 4 * n)) & 15;
+  }
+
+  static int get(const uint8_t *codes, int i) {
+    return (codes[i >> 1] >> ((~i & 1) << 2)) & 15;
+  }
+
+  /// @note Codes must be written in order (the low nibble is OR:ed in).
+  static void put(uint8_t *codes, int i, int code) {
+    if ((i & 1) == 0) {
+      codes[i >> 1] = static_cast<uint8_t>(code << 4);
+    } else {
+      codes[i >> 1] |= static_cast<uint8_t>(code);
+    }
+  }
+};
+
+template <>
+struct codes_t<8> {
+  static const int kCodesPerByte = 1;
+
+  static int unpack(int byte, int n) {
+    (void)n;
+    return byte;
+  }
+
+  static int get(const uint8_t *codes, int i) {
+    return codes[i];
+  }
+
+  static void put(uint8_t *codes, int i, int code) {
+    codes[i] = static_cast<uint8_t>(code);
+  }
+};
+
+/// @brief Compile time properties of an encoding format.
+///
+/// Each format provides:
+///  - kEncoding: The sac_encoding_t value of the format.
+///  - kDefaultBlockSize: Number of samples per block (for the base format;
+///    all formats also have variants with kLongBlockSizes samples per block).
+///  - kBitsPerCode: Number of bits per delta code.
+///  - kNumMaps, kEntriesPerMap: The quantization maps.
+///  - kStartShift: Number of low bits of the 16-bit starting sample that are
+///    used for the block parameters.
+///  - kHeaderCodes: Number of code slots (before the first delta code) that
+///    are used for the block parameters.
+///  - lut(): The quantization maps.
+///  - pack_start(), header_code(), unpack_header(): The header bit layout.
+///  - select_map(): The map selector of the encoder.
+template <sac_encoding_t ENCODING>
+struct format_traits;
+
+// 4-bit DDPCM:
+// - 32 samples per block (or 64/128 samples for the long block variants)
+// - 18 bytes / block (28.1% of original size)
+// - 64 quantization maps (16 entries per map)
+// - Block format (bit layout):
+//   [ssss|ssss][ssss|smmm][mmmp|D1..][D2..|D3..][D4..|D5..] ... [D30.|D31.]
+//    s: Starting point (13 bits)
+//    m: Map-selection (6 bits)
+//    p: Predictor-selection (1 bit)
+//   Dx: Delta samples (4 bits / delta)
+template <>
+struct format_traits<SAC_FORMAT_DD4A> {
+  static const sac_encoding_t kEncoding = SAC_FORMAT_DD4A;
+  static const int kDefaultBlockSize = 32;
+  static const int kBitsPerCode = 4;
+  static const int kNumMaps = 64;
+  static const int kEntriesPerMap = 16;
+  static const int kStartShift = 3;
+  static const int kHeaderCodes = 1;
+
+  typedef codes_t<kBitsPerCode> codes;
+  typedef mapper_t<kNumMaps, kEntriesPerMap> mapper;
+
+  static const short (*lut())[kEntriesPerMap] {
+    return dd4a::kQuantLut;
+  }
+
+  /// @returns The starting sample with the block parameters in the low bits.
+  static int pack_start(int s, int map_no, int predictor_no) {
+    (void)predictor_no;
+    return (s & ~7) | (map_no >> 3);
+  }
+
+  /// @returns The header code (for kHeaderCodes > 0).
+  static int header_code(int map_no, int predictor_no) {
+    return ((map_no & 7) << 1) | predictor_no;
+  }
+
+  static void unpack_header(int s, const uint8_t *codes, int *map_no, int *predictor_no) {
+    const int code = codes_t<4>::get(codes, 0);
+    *map_no = ((s & 7) << 3) | (code >> 1);
+    *predictor_no = code & 1;
+  }
+
+  /// @returns The map whose maximum delta is closest to that of the block.
+  static int select_map(const analysis_result_t &analysis, const mapper &maps) {
+    int map_no = 0;
+    int best_max_diff = std::abs(analysis.max_delta - maps[0].max_delta());
+    for (int m = 1; m < kNumMaps; ++m) {
+      const int max_diff = std::abs(analysis.max_delta - maps[m].max_delta());
+      if (max_diff < best_max_diff) {
+        map_no = m;
+        best_max_diff = max_diff;
+      }
+    }
+    return map_no;
+  }
+};
+
+// 8-bit DDPCM:
+// - 16 samples per block (or 64/128 samples for the long block variants)
+// - 17 bytes / block (53.1% of original size)
+// - 8 quantization maps (256 entires per map)
+// - Block format (bit layout):
+//   [ssss|ssss][ssss|mmmp][D1......][D2......][D3......] ... [D15......]
+//    s: Starting point (12 bits)
+//    m: Map-selection (3 bits)
+//    p: Predictor-selection (1 bit)
+//   Dx: Delta samples (8 bits / delta)
+template <>
+struct format_traits<SAC_FORMAT_DD8A> {
+  static const sac_encoding_t kEncoding = SAC_FORMAT_DD8A;
+  static const int kDefaultBlockSize = 16;
+  static const int kBitsPerCode = 8;
+  static const int kNumMaps = 8;
+  static const int kEntriesPerMap = 256;
+  static const int kStartShift = 4;
+  static const int kHeaderCodes = 0;
+
+  typedef codes_t<kBitsPerCode> codes;
+  typedef mapper_t<kNumMaps, kEntriesPerMap> mapper;
+
+  static const short (*lut())[kEntriesPerMap] {
+    return dd8a::kQuantLut;
+  }
+
+  static int pack_start(int s, int map_no, int predictor_no) {
+    return (s & ~15) | (map_no << 1) | predictor_no;
+  }
+
+  static int header_code(int map_no, int predictor_no) {
+    (void)map_no;
+    (void)predictor_no;
+    return 0;
+  }
+
+  static void unpack_header(int s, const uint8_t *codes, int *map_no, int *predictor_no) {
+    (void)codes;
+    *map_no = (s >> 1) & 7;
+    *predictor_no = s & 1;
+  }
+
+  /// @returns The first map whose RMS threshold is above the block RMS delta.
+  static int select_map(const analysis_result_t &analysis, const mapper &maps) {
+    // Block delta RMS thresholds used for selecting which quantization map to
+    // use.
+    static const short kRmsThresholds[kNumMaps - 1] = {
+      100, 165, 337, 675, 1350, 2700, 5500
+    };
+    (void)maps;
+    for (int m = 0; m < kNumMaps - 1; ++m) {
+      if (analysis.rms_delta < kRmsThresholds[m]) {
+        return m;
+      }
+    }
+    return kNumMaps - 1;
+  }
+};
+
+/// @returns The number of bytes for a block of the given format.
+/// @param num_samples Number of samples in the block.
+template <class FORMAT>
+inline int format_bytes_per_block(int num_samples) {
+  const int num_codes = FORMAT::kHeaderCodes + num_samples - 1;
+  return 2 + (num_codes * FORMAT::kBitsPerCode + 7) / 8;
+}
+
+} // namespace sac
+
+#endif // LIBSAC_FORMAT_TRAITS_H_
@@ -24,9 +24,15 @@
 
 #include "../include/libsac.h"
 
+#include <climits>
+#include <cstring>
 #include <fstream>
 
+#include "allocator.h"
+#include "file_format.h"
 #include "packed_data.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 
 using namespace sac;
@@ -49,32 +55,89 @@ uint32_t read_uint32(std::istream &f) {
       (static_cast<uint32_t>(buf[3]) << 24);
 }
 
-int data_size(sac_encoding_t format, int num_samples, int num_channels) {
-  switch (format) {
-    case SAC_FORMAT_DD4A:
-      {
-        const int block_size = 32;
-        int num_blocks = (num_samples + block_size - 1) / block_size;
-        int bytes_per_channel = (num_samples + num_blocks * 4 + 1) / 2;
-        return bytes_per_channel * num_channels;
-      }
+/// @brief Read the superblocks of a single channel.
+/// @param f The input stream, positioned at the start of the data chunk.
+/// @param data The mono packed data to read into.
+/// @param blocks The block layout of the data chunk.
+/// @param channel The channel to read.
+/// @returns true on success.
+bool read_channel(std::istream &f, packed_data_t *data, const block_layout_t &blocks, int channel) {
+  const std::streampos chunk_start = f.tellg();
+  int pos = 0;
+  for (int r = 0; r < blocks.num_sb_rows(); ++r) {
+    const byte_range_t src = blocks.superblock(r, channel);
+    const byte_range_t dst = data->blocks().superblock(r, 0);
 
-    case SAC_FORMAT_DD8A:
-      {
-        const int block_size = 16;
-        int num_blocks = (num_samples + block_size - 1) / block_size;
-        return (num_samples + num_blocks) * num_channels;
-      }
+    // Only seek when the superblocks are not consecutive (e.g. for the planar
+    // layout a single channel is read as one contiguous range).
+    if (src.offset != pos) {
+      f.seekg(chunk_start + static_cast<std::streamoff>(src.offset));
+    }
+    f.read(reinterpret_cast<char*>(data->data() + dst.offset), dst.size);
+    pos = src.offset + src.size;
+  }
+  f.seekg(chunk_start + static_cast<std::streamoff>(blocks.data_size()));
+  return f.good();
+}
+
+/// @brief Extract a single channel of block list packed data (i.e. sparse
+/// and/or deduplicated data).
+/// @param data The packed data.
+/// @param channel The channel to extract.
+/// @returns Mono packed data, or zero on failure.
+packed_data_t *extract_list_channel(const packed_data_t *data, int channel) {
+  const sparse_map_t *map = data->sparse_map();
+  const int num_blocks = data->blocks().num_blocks();
+  const int block_bytes = data->blocks().full_block_size();
 
-    default:
+  // Create the sparse block map for the channel.
+  scoped_ptr<sparse_map_t> mono_map;
+  int num_coded = num_blocks;
+  if (map) {
+    scoped_buffer_t<int> values(num_blocks + 1);
+    if (!values.get()) {
       return 0;
+    }
+    for (int k = 0; k < num_blocks; ++k) {
+      const int index = data->blocks().block_index(k, channel);
+      values[k] = map->is_constant(index) ? map->value(index) : sparse_map_t::kNotConstant;
+    }
+    mono_map.reset(new sparse_map_t(num_blocks, map->leading(), map->trailing()));
+    if (!mono_map->build(values.get())) {
+      return 0;
+    }
+    num_coded = mono_map->num_coded();
+  }
+
+  // Copy the coded blocks, and deduplicate them again.
+  scoped_ptr<packed_data_t> mono(new packed_data_t(num_coded * block_bytes, data->num_samples(), 1, data->sample_rate(), data->encoding(), data->block_size(), data->layout(), mono_map.release()));
+  if (!mono->is_valid()) {
+    return 0;
   }
+  for (int k = 0; k < num_blocks; ++k) {
+    block_offsets_t src, dst;
+    int16_t value;
+    if (data->locate_block(k, channel, &src, &value)) {
+      // The mono map has the same coded blocks as the channel.
+      if (!mono->locate_block(k, 0, &dst, &value)) {
+        return 0;
+      }
+      std::memcpy(mono->data() + dst.header, data->data() + src.header, block_bytes);
+    }
+  }
+  if (data->dedup_table() && !mono->deduplicate()) {
+    return 0;
+  }
+  return mono.release();
 }
 
-} // anonymous namespace
+/// @brief Load a SAC file.
+/// @param file_name The name of the file to load.
+/// @param channel The channel to load, or -1 to load all channels.
+/// @returns The loaded packed data, or zero on failure.
+packed_data_t *load_file(const char *file_name, int channel) {
+  api_timer_t timer(SAC_API_LOAD_FILE);
 
-extern "C"
-sac_packed_data_t *sac_load_file(const char *file_name) {
   if (!file_name) {
     return 0;
   }
@@ -85,18 +148,34 @@ sac_packed_data_t *sac_load_file(const char *file_name) {
   if (read_uint32(f) != 0x01434153) {
     return 0;
   }
-  const int file_size = read_uint32(f) + 8;
-  int bytes_left = file_size - 8;
+  int64_t bytes_left = read_uint32(f);
+
+  // No chunk may extend past the end of the file (so that a malformed chunk
+  // size can not trigger a huge allocation).
+  const std::streampos chunks_start = f.tellg();
+  f.seekg(0, std::ios_base::end);
+  const int64_t file_end = static_cast<int64_t>(f.tellg());
+  f.seekg(chunks_start);
 
   scoped_ptr<packed_data_t> data;
   int num_samples = 0, sample_rate = 0, num_channels = 0;
   sac_encoding_t encoding = SAC_FORMAT_UNDEFINED;
+  int block_size = 0;
+  int layout = SAC_LAYOUT_DEFAULT;
+  scoped_ptr<sparse_map_t> map;
+  scoped_ptr<dedup_table_t> table;
+  scoped_ptr<clamp_map_t> clamp_map;
+  scoped_ptr<peak_table_t> peak_table;
 
   // Read sub-chunks.
   while (bytes_left > 0) {
-    int chunk_id = read_uint32(f);
-    int chunk_size = read_uint32(f);
-    bytes_left -= 8 + chunk_size;
+    const uint32_t chunk_id = read_uint32(f);
+    const uint32_t chunk_size32 = read_uint32(f);
+    if (!f.good() || static_cast<int64_t>(chunk_size32) > file_end - static_cast<int64_t>(f.tellg())) {
+      return 0;
+    }
+    const int chunk_size = static_cast<int>(chunk_size32);
+    bytes_left -= 8 + static_cast<int64_t>(chunk_size);
 
     switch (chunk_id) {
       // FRMT: Format chunk (must come before the data chunk).
@@ -105,25 +184,113 @@ sac_packed_data_t *sac_load_file(const char *file_name) {
           return 0;
         }
 
-        uint32_t format_fourcc = read_uint32(f);
-        switch (format_fourcc) {
-          case 0x41344444:
-            encoding = SAC_FORMAT_DD4A;
-            break;
+        bool fourcc_layout;
+        if (!parse_format_fourcc(read_uint32(f), &encoding, &block_size, &fourcc_layout)) {
+          return 0;
+        }
 
-          case 0x41384444:
-            encoding = SAC_FORMAT_DD8A;
-            break;
+        const uint32_t num_samples32 = read_uint32(f);
+        num_channels = read_uint16(f);
+        sample_rate = read_uint32(f);
+        if (num_samples32 > INT_MAX || num_channels < 1) {
+          return 0;
+        }
+        num_samples = static_cast<int>(num_samples32);
 
-          default:
+        // The layout field is optional (if missing, the default layout is
+        // used).
+        int format_bytes = 14;
+        if (chunk_size >= 16) {
+          layout = read_uint16(f);
+          if (!block_layout_t::is_valid_layout(layout)) {
             return 0;
+          }
+          format_bytes += 2;
+        }
+        if (is_fourcc_layout(layout) != fourcc_layout) {
+          return 0;
         }
 
-        num_samples = read_uint32(f);
-        num_channels = read_uint16(f);
-        sample_rate = read_uint32(f);
+        // The size of the encoded data must fit in an int.
+        if (!block_layout_t(encoding, block_size, layout, num_samples, num_channels).has_valid_size()) {
+          return 0;
+        }
+
+        f.seekg(chunk_size - format_bytes, std::ios_base::cur);
+        break;
+      }
+
+      // SPRS: Sparse block map (must come before the data chunk).
+      case 0x53525053: {
+        if (encoding == SAC_FORMAT_UNDEFINED || !(layout & SAC_LAYOUT_SPARSE) || chunk_size < 0) {
+          return 0;
+        }
+        scoped_buffer_t<uint8_t> buf(chunk_size + 1);
+        if (!buf.get()) {
+          return 0;
+        }
+        f.read(reinterpret_cast<char*>(buf.get()), chunk_size);
+        map.reset(sparse_map_t::parse(buf.get(), chunk_size, block_size, num_samples, num_channels));
+        if (!f.good() || !map.get()) {
+          return 0;
+        }
+        break;
+      }
+
+      // BIDX: Deduplication table (must come after the sparse block map, if
+      // any, and before the data chunk).
+      case 0x58444942: {
+        if (encoding == SAC_FORMAT_UNDEFINED || !(layout & SAC_LAYOUT_DEDUP) || chunk_size < 0 ||
+            ((layout & SAC_LAYOUT_SPARSE) && !map.get())) {
+          return 0;
+        }
+        scoped_buffer_t<uint8_t> buf(chunk_size + 1);
+        if (!buf.get()) {
+          return 0;
+        }
+        f.read(reinterpret_cast<char*>(buf.get()), chunk_size);
+        const int num_listed = map.get() ? map->num_coded() : block_layout_t(encoding, block_size, layout, num_samples, num_channels).num_blocks() * num_channels;
+        table.reset(dedup_table_t::parse(buf.get(), chunk_size, num_listed));
+        if (!f.good() || !table.get()) {
+          return 0;
+        }
+        break;
+      }
+
+      // CLMP: Clamp map (optional, must come after the sparse block map, if
+      // any, and before the data chunk).
+      case 0x504D4C43: {
+        if (encoding == SAC_FORMAT_UNDEFINED || chunk_size < 0 || ((layout & SAC_LAYOUT_SPARSE) && !map.get())) {
+          return 0;
+        }
+        scoped_buffer_t<uint8_t> buf(chunk_size + 1);
+        if (!buf.get()) {
+          return 0;
+        }
+        f.read(reinterpret_cast<char*>(buf.get()), chunk_size);
+        const int coded_samples = map.get() ? num_samples - map->leading() - map->trailing() : num_samples;
+        const int num_blocks = block_layout_t(encoding, block_size, layout, coded_samples, num_channels).num_blocks() * num_channels;
+        clamp_map.reset(clamp_map_t::parse(buf.get(), chunk_size, num_blocks));
+        if (!f.good() || !clamp_map.get()) {
+          return 0;
+        }
+        break;
+      }
 
-        f.seekg(chunk_size - 14, std::ios_base::cur);
+      // PEAK: Peak table (optional, must come before the data chunk).
+      case 0x4B414550: {
+        if (encoding == SAC_FORMAT_UNDEFINED || chunk_size < 0) {
+          return 0;
+        }
+        scoped_buffer_t<uint8_t> buf(chunk_size + 1);
+        if (!buf.get()) {
+          return 0;
+        }
+        f.read(reinterpret_cast<char*>(buf.get()), chunk_size);
+        peak_table.reset(peak_table_t::parse(buf.get(), chunk_size, num_samples, num_channels));
+        if (!f.good() || !peak_table.get()) {
+          return 0;
+        }
         break;
       }
 
@@ -134,14 +301,65 @@ sac_packed_data_t *sac_load_file(const char *file_name) {
           return 0;
         }
 
-        if (chunk_size != data_size(encoding, num_samples, num_channels)) {
+        if (channel >= num_channels) {
+          return 0;
+        }
+
+        if (block_layout_t::is_block_list(layout)) {
+          // We need the sparse block map and/or the deduplication table to
+          // locate the blocks.
+          if (((layout & SAC_LAYOUT_SPARSE) && !map.get()) || ((layout & SAC_LAYOUT_DEDUP) && !table.get())) {
+            return 0;
+          }
+          const int coded_samples = map.get() ? num_samples - map->leading() - map->trailing() : num_samples;
+          const block_layout_t blocks(encoding, block_size, layout, coded_samples, num_channels);
+          const int num_stored = table.get() ? table->num_unique() : (map.get() ? map->num_coded() : blocks.num_blocks() * num_channels);
+          if (chunk_size != num_stored * blocks.full_block_size()) {
+            // Wrong data size.
+            return 0;
+          }
+
+          // Read all the data (also for a single channel, since the blocks
+          // of the channel may be shared or interspersed with constant
+          // blocks).
+          data.reset(new packed_data_t(chunk_size, num_samples, num_channels, sample_rate, encoding, block_size, layout, map.release(), table.release()));
+          if (!data->is_valid()) {
+            return 0;
+          }
+          f.read(reinterpret_cast<char*>(data->data()), chunk_size);
+          if (channel >= 0) {
+            data.reset(extract_list_channel(data.get(), channel));
+            if (!data.get()) {
+              return 0;
+            }
+          }
+          break;
+        }
+
+        const block_layout_t blocks(encoding, block_size, layout, num_samples, num_channels);
+        if (chunk_size != blocks.data_size()) {
           // Wrong data size.
           return 0;
         }
 
-        if (chunk_size > 0) {
+        if (chunk_size > 0 && channel >= 0) {
+          // Create a mono packed data container.
+          const block_layout_t mono_blocks(encoding, block_size, layout, num_samples, 1);
+          data.reset(new packed_data_t(mono_blocks.data_size(), num_samples, 1, sample_rate, encoding, block_size, layout));
+          if (!data->is_valid()) {
+            return 0;
+          }
+
+          // Read the data for the requested channel only...
+          if (!read_channel(f, data.get(), blocks, channel)) {
+            return 0;
+          }
+        } else if (chunk_size > 0) {
           // Create the packed data container.
-          data.reset(new packed_data_t(chunk_size, num_samples, num_channels, sample_rate, encoding));
+          data.reset(new packed_data_t(chunk_size, num_samples, num_channels, sample_rate, encoding, block_size, layout));
+          if (!data->is_valid()) {
+            return 0;
+          }
 
           // Read the data...
           f.read(reinterpret_cast<char*>(data->data()), chunk_size);
@@ -157,5 +375,46 @@ sac_packed_data_t *sac_load_file(const char *file_name) {
     }
   }
 
-  return reinterpret_cast<sac_packed_data_t*>(data.release());
+  // Attach the clamp map and the peak table (only the blocks/bins of the
+  // loaded channel are kept when loading a single channel).
+  if (data.get() && clamp_map.get()) {
+    data->set_clamp_map(channel >= 0 ? clamp_map->extract_channel(channel, num_channels) : clamp_map.release());
+  }
+  if (data.get() && peak_table.get()) {
+    data->set_peak_table(channel >= 0 ? peak_table->extract_channel(channel) : peak_table.release());
+  }
+
+  // Update the statistics.
+  sac_stats_t *stats = thread_stats();
+  if (stats && data.get()) {
+    stats_add(stats->bytes_loaded, data->size());
+  }
+
+  return data.release();
+}
+
+/// @brief Load a SAC file (see load_file), and fire the tracing probes.
+packed_data_t *traced_load_file(const char *file_name, int channel) {
+  LIBSAC_PROBE2(load_file__entry, file_name, channel);
+  packed_data_t *data = load_file(file_name, channel);
+  LIBSAC_PROBE4(load_file__return, data,
+                data ? data->num_samples() : 0,
+                data ? data->num_channels() : 0,
+                data ? data->encoding() : SAC_FORMAT_UNDEFINED);
+  return data;
+}
+
+} // anonymous namespace
+
+extern "C"
+sac_packed_data_t *sac_load_file(const char *file_name) {
+  return reinterpret_cast<sac_packed_data_t*>(traced_load_file(file_name, -1));
+}
+
+extern "C"
+sac_packed_data_t *sac_load_file_channel(const char *file_name, int channel) {
+  if (channel < 0) {
+    return 0;
+  }
+  return reinterpret_cast<sac_packed_data_t*>(traced_load_file(file_name, channel));
 }
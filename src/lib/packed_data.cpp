@@ -26,6 +26,84 @@
 
 #include "packed_data.h"
 
+#include <cstring>
+
+#include "stats.h"
+
+namespace sac {
+
+bool packed_data_t::deduplicate() {
+  const int block_bytes = m_blocks.full_block_size();
+  const int num_blocks = block_bytes > 0 ? m_size / block_bytes : 0;
+  scoped_ptr<dedup_table_t> table(dedup_table_t::build(m_data, num_blocks, block_bytes));
+  if (!table.get()) {
+    return false;
+  }
+
+  // Only use the table if it saves more than its own size (including the
+  // chunk header).
+  const int num_duplicates = num_blocks - table->num_unique();
+  if (num_duplicates * block_bytes <= 8 + table->serialized_size()) {
+    return remove_dedup_flag();
+  }
+
+  // Keep only the unique blocks.
+  table->compact(m_data, block_bytes);
+  if (!shrink(table->num_unique() * block_bytes)) {
+    return false;
+  }
+
+  sac_stats_t *stats = thread_stats();
+  if (stats) {
+    stats_add(stats->duplicate_blocks, num_duplicates);
+  }
+
+  m_dedup_table.reset(table.release());
+  return true;
+}
+
+bool packed_data_t::remove_dedup_flag() {
+  const int layout = m_layout & ~SAC_LAYOUT_DEDUP;
+  if (block_layout_t::is_block_list(layout)) {
+    // The sparse layout uses the same block list.
+    m_layout = layout;
+    return true;
+  }
+
+  // In the default (or planar) layout, the final blocks only hold the codes
+  // of the final samples. The blocks are moved in storage order, and never
+  // towards the end of the data.
+  const block_layout_t blocks(m_encoding, m_blocks.block_size(), layout, m_coded_samples, m_num_channels);
+  const int num_blocks = blocks.num_blocks();
+  const int final_samples = m_coded_samples - (num_blocks - 1) * blocks.block_size();
+  const int final_bytes = block_layout_t::bytes_per_block(m_encoding, final_samples);
+  const int block_bytes = blocks.full_block_size();
+  const bool planar = (layout & SAC_LAYOUT_PLANAR) != 0;
+  for (int index = 0; index < num_blocks * m_num_channels; ++index) {
+    const int block_no = planar ? index % num_blocks : index / m_num_channels;
+    const int channel = planar ? index / num_blocks : index % m_num_channels;
+    const int dst = blocks.block(block_no, channel).header;
+    std::memmove(m_data + dst, m_data + index * block_bytes, block_no == num_blocks - 1 ? final_bytes : block_bytes);
+  }
+  m_layout = layout;
+  m_blocks = blocks;
+  return shrink(blocks.data_size());
+}
+
+bool packed_data_t::shrink(int size) {
+  uint8_t *data = static_cast<uint8_t*>(mem_alloc(size));
+  if (!data) {
+    return false;
+  }
+  std::memcpy(data, m_data, size);
+  mem_free(m_data);
+  m_data = data;
+  m_size = size;
+  return true;
+}
+
+} // namespace sac
+
 using namespace sac;
 
 extern "C"
@@ -40,7 +118,9 @@ int sac_get_size(const sac_packed_data_t *data_) {
   if (!data) {
     return 0;
   }
-  return data->size();
+  const sparse_map_t *map = data->sparse_map();
+  const dedup_table_t *table = data->dedup_table();
+  return data->size() + (map ? map->serialized_size() : 0) + (table ? table->serialized_size() : 0);
 }
 
 extern "C"
@@ -78,3 +158,41 @@ sac_encoding_t sac_get_encoding(const sac_packed_data_t *data_) {
   }
   return data->encoding();
 }
+
+extern "C"
+int sac_get_layout(const sac_packed_data_t *data_) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data) {
+    return SAC_LAYOUT_DEFAULT;
+  }
+  return data->layout();
+}
+
+extern "C"
+int sac_get_block_size(const sac_packed_data_t *data_) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data) {
+    return 0;
+  }
+  return data->block_size();
+}
+
+extern "C"
+int sac_get_num_blocks(const sac_packed_data_t *data_) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!data) {
+    return 0;
+  }
+  return data->blocks().num_blocks();
+}
+
+extern "C"
+void sac_get_silence(const sac_packed_data_t *data_, int *leading, int *trailing) {
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (leading) {
+    *leading = data ? data->leading_silence() : 0;
+  }
+  if (trailing) {
+    *trailing = data ? data->num_samples() - data->leading_silence() - data->coded_samples() : 0;
+  }
+}
@@ -26,27 +26,51 @@
 #define LIBSAC_PACKED_DATA_H_
 
 #include "../include/libsac.h"
+#include "allocator.h"
+#include "block_cache.h"
+#include "block_layout.h"
+#include "clamp_map.h"
+#include "dedup_table.h"
+#include "peak_table.h"
+#include "sparse_map.h"
+#include "util.h"
 
 namespace sac {
 
-class packed_data_t {
+class packed_data_t : public allocated_t {
   public:
     packed_data_t(
         int size,
         int num_samples,
         int num_channels,
         int sample_rate,
-        sac_encoding_t encoding)
+        sac_encoding_t encoding,
+        int block_size,
+        int layout = SAC_LAYOUT_DEFAULT,
+        sparse_map_t *sparse_map = 0,
+        dedup_table_t *dedup_table = 0)
         : m_size(size),
           m_num_samples(num_samples),
           m_num_channels(num_channels),
           m_sample_rate(sample_rate),
-          m_encoding(encoding) {
-      m_data = new uint8_t[size];
+          m_encoding(encoding),
+          m_layout(layout),
+          m_sparse_map(sparse_map),
+          m_dedup_table(dedup_table),
+          m_leading(sparse_map ? sparse_map->leading() : 0),
+          m_coded_samples(num_samples - m_leading - (sparse_map ? sparse_map->trailing() : 0)),
+          m_blocks(encoding, block_size, layout, m_coded_samples, num_channels),
+          m_data_id(new_data_id()) {
+      m_data = static_cast<uint8_t*>(mem_alloc(size));
     }
 
     ~packed_data_t() {
-      delete[] m_data;
+      mem_free(m_data);
+    }
+
+    /// @returns true if the data buffer could be allocated.
+    bool is_valid() const {
+      return m_data != 0;
     }
 
     uint8_t *data() const {
@@ -73,17 +97,143 @@ class packed_data_t {
       return m_encoding;
     }
 
+    int layout() const {
+      return m_layout;
+    }
+
+    int block_size() const {
+      return m_blocks.block_size();
+    }
+
+    /// @returns The number of trimmed leading samples (the first coded sample).
+    int leading_silence() const {
+      return m_leading;
+    }
+
+    /// @returns The number of coded samples per channel, i.e. excluding any
+    /// trimmed leading and trailing samples. Block numbers are counted from
+    /// the first coded sample.
+    int coded_samples() const {
+      return m_coded_samples;
+    }
+
+    /// @returns The unique id of the packed data (for the block cache).
+    uint64_t data_id() const {
+      return m_data_id;
+    }
+
+    /// @returns The block layout, which is used for locating encoded blocks.
+    const block_layout_t &blocks() const {
+      return m_blocks;
+    }
+
+    /// @returns The sparse block map, or zero if the layout is not sparse.
+    const sparse_map_t *sparse_map() const {
+      return m_sparse_map.get();
+    }
+
+    /// @returns The deduplication table, or zero if the layout is not
+    /// deduplicated.
+    const dedup_table_t *dedup_table() const {
+      return m_dedup_table.get();
+    }
+
+    /// @returns The clamp map, or zero if it is not known which blocks were
+    /// clamped.
+    const clamp_map_t *clamp_map() const {
+      return m_clamp_map.get();
+    }
+
+    /// @brief Set the clamp map (the packed data takes ownership of it).
+    void set_clamp_map(clamp_map_t *clamp_map) {
+      m_clamp_map.reset(clamp_map);
+    }
+
+    /// @returns The precomputed envelope, or zero if there is none.
+    const peak_table_t *peak_table() const {
+      return m_peak_table.get();
+    }
+
+    /// @brief Set the precomputed envelope (the packed data takes ownership
+    /// of it).
+    void set_peak_table(peak_table_t *peak_table) {
+      m_peak_table.reset(peak_table);
+    }
+
+    /// @returns true if the block is known to decode without clamping.
+    bool is_clamp_free(int block_no, int channel) const {
+      const clamp_map_t *map = m_clamp_map.get();
+      return map && !map->is_clamped(block_no * m_num_channels + channel);
+    }
+
+    /// @brief Deduplicate the blocks (SAC_LAYOUT_DEDUP).
+    /// The data must hold the complete block list, which is replaced by the
+    /// unique blocks. If the table would take up more space than it saves,
+    /// the SAC_LAYOUT_DEDUP flag is removed from the layout instead.
+    /// @returns false on failure.
+    bool deduplicate();
+
+    /// @brief Locate an encoded block.
+    /// @param block_no The block number (within the channel).
+    /// @param channel The channel.
+    /// @param offsets Set to the byte offsets of a coded block.
+    /// @param value Set to the sample value of a constant block.
+    /// @returns false if the block is a constant block (sparse layout only).
+    bool locate_block(int block_no, int channel, block_offsets_t *offsets, int16_t *value) const {
+      const sparse_map_t *map = m_sparse_map.get();
+      const dedup_table_t *table = m_dedup_table.get();
+      if (!map && !table) {
+        *offsets = m_blocks.block(block_no, channel);
+        return true;
+      }
+
+      // Resolve the block through the sparse map and/or the deduplication
+      // table.
+      int index = m_blocks.block_index(block_no, channel);
+      if (map) {
+        if (map->is_constant(index)) {
+          *value = map->value(index);
+          return false;
+        }
+        index = map->coded_index(index);
+      }
+      if (table) {
+        index = table->entry(index);
+      }
+      offsets->header = index * m_blocks.full_block_size();
+      offsets->codes = offsets->header + 2;
+      return true;
+    }
+
   private:
     packed_data_t();
     packed_data_t(const packed_data_t& other);
     packed_data_t& operator=(const packed_data_t& other);
 
+    /// @brief Remove the SAC_LAYOUT_DEDUP flag from the layout of a complete
+    /// block list.
+    /// @returns false on failure.
+    bool remove_dedup_flag();
+
+    /// @brief Shrink the data buffer.
+    /// @returns false on failure.
+    bool shrink(int size);
+
     uint8_t *m_data;
-    const int m_size;
+    int m_size;
     const int m_num_samples;
     const int m_num_channels;
     const int m_sample_rate;
     const sac_encoding_t m_encoding;
+    int m_layout;
+    scoped_ptr<sparse_map_t> m_sparse_map;
+    scoped_ptr<dedup_table_t> m_dedup_table;
+    scoped_ptr<clamp_map_t> m_clamp_map;
+    scoped_ptr<peak_table_t> m_peak_table;
+    const int m_leading;
+    const int m_coded_samples;
+    block_layout_t m_blocks;
+    const uint64_t m_data_id;
 };
 
 } // namespace sac
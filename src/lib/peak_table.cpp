@@ -0,0 +1,133 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+#include "peak_table.h"
+
+#include <cstring>
+
+#include "file_format.h"
+#include "util.h"
+
+namespace sac {
+
+namespace {
+
+// Size of the fixed part of a serialized table (samples_per_bin).
+const int kFixedSize = 4;
+
+// Size of a serialized bin (min, max, sum_sq).
+const int kBinSize = 12;
+
+/// @brief Load a 64-bit little endian value.
+uint64_t get_uint64(const uint8_t *in) {
+  return static_cast<uint64_t>(get_uint32(in)) | (static_cast<uint64_t>(get_uint32(in + 4)) << 32);
+}
+
+/// @returns The number of bins per channel.
+int count_bins(int samples_per_bin, int num_samples) {
+  if (samples_per_bin < 1 || num_samples < 1) {
+    return 0;
+  }
+  return num_samples / samples_per_bin + (num_samples % samples_per_bin != 0 ? 1 : 0);
+}
+
+} // anonymous namespace
+
+peak_table_t::peak_table_t(int samples_per_bin, int num_samples, int num_channels)
+    : m_samples_per_bin(samples_per_bin),
+      m_num_samples(num_samples),
+      m_num_channels(num_channels),
+      m_num_bins(count_bins(samples_per_bin, num_samples)),
+      m_bins(0) {
+  const size_t count = static_cast<size_t>(m_num_bins) * num_channels;
+  if (count > 0) {
+    m_bins = static_cast<bin_t*>(mem_alloc(count * sizeof(bin_t)));
+  }
+}
+
+peak_table_t::~peak_table_t() {
+  mem_free(m_bins);
+}
+
+peak_table_t *peak_table_t::parse(const uint8_t *in, int size, int num_samples, int num_channels) {
+  if (size < kFixedSize || num_channels < 1) {
+    return 0;
+  }
+  const uint32_t samples_per_bin = get_uint32(in);
+  if (samples_per_bin < 1 || samples_per_bin > 0x7fffffff) {
+    return 0;
+  }
+  const int num_bins = count_bins(static_cast<int>(samples_per_bin), num_samples);
+  if (static_cast<int64_t>(size) != kFixedSize + static_cast<int64_t>(num_bins) * num_channels * kBinSize) {
+    return 0;
+  }
+
+  scoped_ptr<peak_table_t> table(new peak_table_t(static_cast<int>(samples_per_bin), num_samples, num_channels));
+  if (!table->is_valid()) {
+    return 0;
+  }
+  const uint8_t *src = in + kFixedSize;
+  const int count = num_bins * num_channels;
+  for (int i = 0; i < count; ++i, src += kBinSize) {
+    bin_t &bin = table->m_bins[i];
+    bin.min = static_cast<int16_t>(get_uint16(src));
+    bin.max = static_cast<int16_t>(get_uint16(src + 2));
+    bin.sum_sq = get_uint64(src + 4);
+    if (bin.min > bin.max) {
+      return 0;
+    }
+  }
+  return table.release();
+}
+
+peak_table_t *peak_table_t::extract_channel(int channel) const {
+  scoped_ptr<peak_table_t> table(new peak_table_t(m_samples_per_bin, m_num_samples, 1));
+  if (!table->is_valid()) {
+    return 0;
+  }
+  if (m_num_bins > 0) {
+    std::memcpy(table->m_bins, bins(channel), m_num_bins * sizeof(bin_t));
+  }
+  return table.release();
+}
+
+int peak_table_t::serialized_size() const {
+  return kFixedSize + m_num_bins * m_num_channels * kBinSize;
+}
+
+void peak_table_t::serialize(uint8_t *out) const {
+  put_uint32(out, static_cast<uint32_t>(m_samples_per_bin));
+  uint8_t *dst = out + kFixedSize;
+  const int count = m_num_bins * m_num_channels;
+  for (int i = 0; i < count; ++i, dst += kBinSize) {
+    const bin_t &bin = m_bins[i];
+    dst[0] = static_cast<uint8_t>(bin.min);
+    dst[1] = static_cast<uint8_t>(static_cast<uint16_t>(bin.min) >> 8);
+    dst[2] = static_cast<uint8_t>(bin.max);
+    dst[3] = static_cast<uint8_t>(static_cast<uint16_t>(bin.max) >> 8);
+    put_uint32(dst + 4, static_cast<uint32_t>(bin.sum_sq));
+    put_uint32(dst + 8, static_cast<uint32_t>(bin.sum_sq >> 32));
+  }
+}
+
+} // namespace sac
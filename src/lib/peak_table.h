@@ -0,0 +1,114 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Peak table:
+//
+// A precomputed waveform envelope (the min, max and sum of squares of each
+// bin of samples_per_bin samples, per channel), which lets waveform overviews
+// be drawn without decoding any blocks. The table is optional, and is
+// computed from the decoded samples, so envelopes that are derived from it are
+// exact. The last bin of a channel may hold fewer samples.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_PEAK_TABLE_H_
+#define LIBSAC_PEAK_TABLE_H_
+
+#include "../include/libsac.h"
+#include "allocator.h"
+
+namespace sac {
+
+class peak_table_t : public allocated_t {
+  public:
+    /// @brief The envelope of a bin.
+    struct bin_t {
+      int16_t min;
+      int16_t max;
+      uint64_t sum_sq;  ///< Sum of the squared samples.
+    };
+
+    /// @brief Create a table (the bins are uninitialized).
+    /// @param samples_per_bin Number of samples per bin.
+    /// @param num_samples Number of samples per channel.
+    /// @param num_channels Number of channels.
+    peak_table_t(int samples_per_bin, int num_samples, int num_channels);
+
+    ~peak_table_t();
+
+    /// @returns true if the bins could be allocated.
+    bool is_valid() const {
+      return m_bins != 0 || m_num_bins == 0;
+    }
+
+    /// @brief Parse a serialized table (the payload of a PEAK chunk).
+    /// @param in The serialized table.
+    /// @param size Size of the serialized table, in bytes.
+    /// @param num_samples Number of samples per channel.
+    /// @param num_channels Number of channels.
+    /// @returns The table, or zero if the serialized table is malformed.
+    static peak_table_t *parse(const uint8_t *in, int size, int num_samples, int num_channels);
+
+    /// @brief Extract the table of a single channel.
+    /// @returns The mono table, or zero on failure.
+    peak_table_t *extract_channel(int channel) const;
+
+    /// @returns The size of the serialized table, in bytes.
+    int serialized_size() const;
+
+    /// @brief Serialize the table (see file_format.h).
+    /// @param out The output buffer (serialized_size() bytes).
+    void serialize(uint8_t *out) const;
+
+    int samples_per_bin() const {
+      return m_samples_per_bin;
+    }
+
+    /// @returns The number of bins per channel.
+    int num_bins() const {
+      return m_num_bins;
+    }
+
+    /// @returns The bins of a channel.
+    bin_t *bins(int channel) {
+      return m_bins + static_cast<size_t>(channel) * m_num_bins;
+    }
+
+    const bin_t *bins(int channel) const {
+      return m_bins + static_cast<size_t>(channel) * m_num_bins;
+    }
+
+  private:
+    peak_table_t();
+    peak_table_t(const peak_table_t& other);
+    peak_table_t& operator=(const peak_table_t& other);
+
+    const int m_samples_per_bin;
+    const int m_num_samples;
+    const int m_num_channels;
+    const int m_num_bins;
+    bin_t *m_bins;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_PEAK_TABLE_H_
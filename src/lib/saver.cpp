@@ -26,74 +26,119 @@
 
 #include <fstream>
 
+#include "allocator.h"
+#include "file_format.h"
 #include "packed_data.h"
+#include "stats.h"
 #include "util.h"
 
-using namespace sac;
+namespace sac {
 
-namespace {
+int make_file_header(uint8_t *out, sac_encoding_t encoding, int block_size, int layout, uint32_t num_samples, int num_channels, int sample_rate, uint32_t data_size, uint32_t extra_size) {
+  // Determine format fourcc code.
+  const uint32_t fourcc = format_fourcc(encoding, block_size, layout);
+  if (!fourcc) {
+    // Unhandled...
+    return 0;
+  }
 
-void write_uint16(std::ostream &f, uint16_t x) {
-  uint8_t buf[2];
-  buf[0] = x;
-  buf[1] = x >> 8;
-  f.write(reinterpret_cast<char*>(buf), 2);
-}
+  // The layout field of the format chunk is only written for non-default
+  // layouts, which keeps default layout files readable by older loaders.
+  // Older loaders skip the layout field, so layouts that they would decode
+  // incorrectly are also signalled by the fourcc (which they reject).
+  const bool has_layout = layout != SAC_LAYOUT_DEFAULT;
+  const int format_size = has_layout ? 16 : 14;
+  const int header_size = 8 + 8 + format_size + 8;
 
-void write_uint32(std::ostream &f, uint32_t x) {
-  uint8_t buf[4];
-  buf[0] = x;
-  buf[1] = x >> 8;
-  buf[2] = x >> 16;
-  buf[3] = x >> 24;
-  f.write(reinterpret_cast<char*>(buf), 4);
+  // File master chunk.
+  put_uint32(out, 0x01434153);                        // "SAC\1"
+  put_uint32(out + 4, header_size - 8 + extra_size + data_size);  // Master chunk size.
+
+  // Sub chunk: Format (must come before the data chunk).
+  put_uint32(out + 8, 0x544D5246);                    // "FRMT"
+  put_uint32(out + 12, format_size);                  // Chunk size.
+  put_uint32(out + 16, fourcc);                       // Packed data format.
+  put_uint32(out + 20, num_samples);                  // Number of samples.
+  out[24] = static_cast<uint8_t>(num_channels);       // Number of channels.
+  out[25] = static_cast<uint8_t>(num_channels >> 8);
+  put_uint32(out + 26, sample_rate);                  // Sample rate (Hz).
+  if (has_layout) {
+    out[30] = static_cast<uint8_t>(layout);           // Block layout flags.
+    out[31] = static_cast<uint8_t>(layout >> 8);
+  }
+
+  // Sub chunk: Data.
+  put_uint32(out + header_size - 8, 0x41544144);      // "DATA"
+  put_uint32(out + header_size - 4, data_size);       // Chunk size.
+
+  return header_size;
 }
 
-} // anonymous namespace
+} // namespace sac
+
+using namespace sac;
 
 extern "C"
-void sac_save_file(const char *file_name, const sac_packed_data_t *data_) {
+int sac_save_file(const char *file_name, const sac_packed_data_t *data_) {
+  api_timer_t timer(SAC_API_SAVE_FILE);
   const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
 
   if (!file_name || !data) {
-    return;
+    return 0;
   }
 
-  // Total file size.
-  const int file_size = 8 + 8 + 14 + 8 + data->size();
+  // Serialize the sparse block map, the deduplication table, the clamp map and
+  // the peak table (if any).
+  const sparse_map_t *map = data->sparse_map();
+  const dedup_table_t *table = data->dedup_table();
+  const clamp_map_t *clamp_map = data->clamp_map();
+  const peak_table_t *peak_table = data->peak_table();
+  const size_t extra_size = (map ? 8 + map->serialized_size() : 0) +
+                            (table ? 8 + table->serialized_size() : 0) +
+                            (clamp_map ? 8 + clamp_map->serialized_size() : 0) +
+                            (peak_table ? 8 + peak_table->serialized_size() : 0);
+  scoped_buffer_t<uint8_t> extra_chunks(extra_size);
+  if (extra_size > 0 && !extra_chunks.get()) {
+    return 0;
+  }
+  size_t pos = 0;
+  if (map) {
+    put_uint32(&extra_chunks[pos], 0x53525053);       // "SPRS"
+    put_uint32(&extra_chunks[pos + 4], map->serialized_size());
+    map->serialize(&extra_chunks[pos + 8]);
+    pos += 8 + map->serialized_size();
+  }
+  if (table) {
+    put_uint32(&extra_chunks[pos], 0x58444942);       // "BIDX"
+    put_uint32(&extra_chunks[pos + 4], table->serialized_size());
+    table->serialize(&extra_chunks[pos + 8]);
+    pos += 8 + table->serialized_size();
+  }
+  if (clamp_map) {
+    put_uint32(&extra_chunks[pos], 0x504D4C43);       // "CLMP"
+    put_uint32(&extra_chunks[pos + 4], clamp_map->serialized_size());
+    clamp_map->serialize(&extra_chunks[pos + 8]);
+    pos += 8 + clamp_map->serialized_size();
+  }
+  if (peak_table) {
+    put_uint32(&extra_chunks[pos], 0x4B414550);       // "PEAK"
+    put_uint32(&extra_chunks[pos + 4], peak_table->serialized_size());
+    peak_table->serialize(&extra_chunks[pos + 8]);
+  }
 
-  // Determine format fourcc code.
-  uint32_t format_fourcc = 0;
-  switch (data->encoding()) {
-    case SAC_FORMAT_DD4A:
-      format_fourcc = 0x41344444;
-      break;
-
-    case SAC_FORMAT_DD8A:
-      format_fourcc = 0x41384444;
-      break;
-
-    default:
-      // Unhandled...
-      return;
+  uint8_t header[kMaxFileHeaderSize];
+  const int header_size = make_file_header(header, data->encoding(), data->block_size(), data->layout(), data->num_samples(), data->num_channels(), data->sample_rate(), data->size(), static_cast<uint32_t>(extra_chunks.size()));
+  if (!header_size) {
+    return 0;
   }
 
   std::ofstream f(file_name, std::ofstream::out | std::ofstream::binary);
-
-  // File master chunk.
-  write_uint32(f, 0x01434153);            // "SAC\1"
-  write_uint32(f, file_size - 8);         // Master chunk size.
-
-  // Sub chunk: Format (must come before the data chunk).
-  write_uint32(f, 0x544D5246);            // "FRMT"
-  write_uint32(f, 14);                    // Chunk size.
-  write_uint32(f, format_fourcc);         // Packed data format.
-  write_uint32(f, data->num_samples());   // Number of samples.
-  write_uint16(f, data->num_channels());  // Number of channels.
-  write_uint32(f, data->sample_rate());   // Sample rate (Hz).
-
-  // Sub chunk: Data.
-  write_uint32(f, 0x41544144);            // "DATA"
-  write_uint32(f, data->size());          // Chunk size.
+  f.write(reinterpret_cast<char*>(header), header_size - 8);
+  if (!extra_chunks.empty()) {
+    f.write(reinterpret_cast<char*>(extra_chunks.get()), extra_chunks.size());
+  }
+  f.write(reinterpret_cast<char*>(header + header_size - 8), 8);
   f.write(reinterpret_cast<char*>(data->data()), data->size());
+  f.close();
+  return f.good() ? 1 : 0;
 }
@@ -0,0 +1,351 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+#include "sound_manager.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "decoder/decode.h"
+
+namespace sac {
+
+namespace {
+
+// The heat is multiplied by this factor at every update.
+const double kHeatDecay = 0.5;
+
+// Ranking bonus of resident sounds (hysteresis).
+const double kResidentBonus = 2.0;
+
+struct candidate_t {
+  double score;
+  int sound;
+
+  bool operator<(const candidate_t &other) const {
+    return score > other.score;
+  }
+};
+
+} // anonymous namespace
+
+sound_manager_t::sound_manager_t(size_t budget)
+    : m_budget(budget),
+      m_sounds(0),
+      m_num_sounds(0),
+      m_capacity(0),
+      m_resident_bytes(0) {
+  std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+sound_manager_t::~sound_manager_t() {
+  for (int i = 0; i < m_num_sounds; ++i) {
+    mem_free(m_sounds[i].pcm);
+  }
+  mem_free(m_sounds);
+}
+
+int sound_manager_t::add(const packed_data_t *data) {
+  scoped_lock_t lock(m_lock);
+
+  // Reuse a free slot, or append a new one.
+  int sound = 0;
+  while (sound < m_num_sounds && m_sounds[sound].data != 0) {
+    ++sound;
+  }
+  if (sound == m_capacity) {
+    const int capacity = std::max(16, m_capacity * 2);
+    sound_t *sounds = static_cast<sound_t*>(mem_alloc(capacity * sizeof(sound_t)));
+    if (!sounds) {
+      return -1;
+    }
+    if (m_num_sounds > 0) {
+      std::memcpy(sounds, m_sounds, m_num_sounds * sizeof(sound_t));
+    }
+    mem_free(m_sounds);
+    m_sounds = sounds;
+    m_capacity = capacity;
+  }
+  if (sound == m_num_sounds) {
+    ++m_num_sounds;
+  }
+
+  sound_t &s = m_sounds[sound];
+  s.data = data;
+  s.pcm = 0;
+  s.pcm_bytes = static_cast<size_t>(data->num_samples()) * data->num_channels() * sizeof(int16_t);
+  s.requested = 0;
+  s.heat = 0.0;
+  s.pins = 0;
+  s.removing = false;
+  return sound;
+}
+
+void sound_manager_t::remove(int sound) {
+  // Mark the sound as being removed, so that it can not be pinned again.
+  {
+    scoped_lock_t lock(m_lock);
+    if (!is_valid(sound)) {
+      return;
+    }
+    m_sounds[sound].removing = true;
+  }
+
+  // Wait for the current pins to be released (pins are short lived, so yield
+  // rather than block).
+  int16_t *pcm;
+  while (true) {
+    {
+      scoped_lock_t lock(m_lock);
+      sound_t &s = m_sounds[sound];
+      if (s.pins == 0) {
+        pcm = s.pcm;
+        if (pcm) {
+          m_resident_bytes -= s.pcm_bytes;
+        }
+        s.data = 0;
+        s.pcm = 0;
+        s.removing = false;
+        break;
+      }
+    }
+    spin_lock_t::yield();
+  }
+  mem_free(pcm);
+}
+
+int sound_manager_t::get_samples(int sound, int16_t *out, int start, int count) {
+  const packed_data_t *data;
+  const int16_t *pcm;
+  {
+    scoped_lock_t lock(m_lock);
+    if (!is_valid(sound) || !out) {
+      return 0;
+    }
+    sound_t &s = m_sounds[sound];
+    data = s.data;
+    pcm = s.pcm;
+
+    // Clamp the arguments to the range of the sound.
+    if (start < 0) {
+      count += start;
+      start = 0;
+    }
+    count = std::min(start + count, data->num_samples()) - start;
+    if (count < 1) {
+      return 0;
+    }
+
+    s.requested += count;
+    ++s.pins;
+    if (pcm) {
+      m_stats.pcm_samples += count;
+    } else {
+      m_stats.packed_samples += count;
+    }
+  }
+
+  if (pcm) {
+    const int num_channels = data->num_channels();
+    std::memcpy(out, pcm + static_cast<size_t>(start) * num_channels, static_cast<size_t>(count) * num_channels * sizeof(int16_t));
+  } else {
+    sac_decode_interleaved(out, reinterpret_cast<const sac_packed_data_t*>(data), start, count);
+  }
+
+  scoped_lock_t lock(m_lock);
+  --m_sounds[sound].pins;
+  return count;
+}
+
+int sound_manager_t::update() {
+  // Allocate the scratch buffers (sounds that are added after this are
+  // handled by the next update).
+  int num_sounds;
+  {
+    scoped_lock_t lock(m_lock);
+    num_sounds = m_num_sounds;
+  }
+  scoped_buffer_t<candidate_t> candidates(num_sounds);
+  scoped_buffer_t<int> promote(num_sounds);
+  scoped_buffer_t<int16_t*> demoted(num_sounds);
+  if (num_sounds > 0 && (!candidates.get() || !promote.get() || !demoted.get())) {
+    return 0;
+  }
+
+  // Update the heat, and rank the sounds by heat per byte of PCM.
+  int num_candidates = 0;
+  {
+    scoped_lock_t lock(m_lock);
+    for (int i = 0; i < num_sounds; ++i) {
+      sound_t &s = m_sounds[i];
+      if (!s.data || s.removing) {
+        continue;
+      }
+      s.heat = s.heat * kHeatDecay + static_cast<double>(s.requested);
+      s.requested = 0;
+      candidate_t &c = candidates[num_candidates++];
+      c.score = s.heat / static_cast<double>(std::max(s.pcm_bytes, static_cast<size_t>(1))) * (s.pcm ? kResidentBonus : 1.0);
+      c.sound = i;
+    }
+  }
+  std::sort(candidates.get(), candidates.get() + num_candidates);
+
+  // Select the sounds that should be resident (the hottest sounds that fit in
+  // the budget), and demote all other sounds (unless they are pinned).
+  int num_promote = 0, num_demoted = 0;
+  {
+    scoped_lock_t lock(m_lock);
+    size_t selected_bytes = 0;
+    for (int i = 0; i < num_candidates; ++i) {
+      sound_t &s = m_sounds[candidates[i].sound];
+      if (!s.data || s.removing) {
+        continue;
+      }
+      if (candidates[i].score > 0.0 && s.pcm_bytes <= m_budget - selected_bytes) {
+        selected_bytes += s.pcm_bytes;
+        if (!s.pcm) {
+          promote[num_promote++] = candidates[i].sound;
+        }
+      } else if (s.pcm && s.pins == 0) {
+        demoted[num_demoted++] = s.pcm;
+        s.pcm = 0;
+        m_resident_bytes -= s.pcm_bytes;
+        ++m_stats.demotions;
+      }
+    }
+  }
+  for (int i = 0; i < num_demoted; ++i) {
+    mem_free(demoted[i]);
+  }
+
+  // Decode the promoted sounds (hottest first). The sound is pinned while it
+  // is decoded, so that it can not be removed.
+  int num_promoted = 0;
+  for (int i = 0; i < num_promote; ++i) {
+    const packed_data_t *data;
+    size_t pcm_bytes;
+    {
+      scoped_lock_t lock(m_lock);
+      sound_t &s = m_sounds[promote[i]];
+      if (!s.data || s.removing || s.pcm || s.pcm_bytes > m_budget - m_resident_bytes) {
+        continue;
+      }
+      data = s.data;
+      pcm_bytes = s.pcm_bytes;
+      ++s.pins;
+    }
+
+    int16_t *pcm = static_cast<int16_t*>(mem_alloc(pcm_bytes));
+    if (pcm) {
+      decode_interleaved_uncached(pcm, data, 0, data->num_samples());
+    }
+
+    scoped_lock_t lock(m_lock);
+    sound_t &s = m_sounds[promote[i]];
+    --s.pins;
+    if (pcm) {
+      s.pcm = pcm;
+      m_resident_bytes += pcm_bytes;
+      ++m_stats.promotions;
+      ++num_promoted;
+    }
+  }
+
+  return num_demoted + num_promoted;
+}
+
+void sound_manager_t::get_stats(sac_sound_manager_stats_t *stats) {
+  scoped_lock_t lock(m_lock);
+  *stats = m_stats;
+  stats->resident_sounds = 0;
+  for (int i = 0; i < m_num_sounds; ++i) {
+    if (m_sounds[i].pcm) {
+      ++stats->resident_sounds;
+    }
+  }
+  stats->resident_bytes = m_resident_bytes;
+}
+
+} // namespace sac
+
+using namespace sac;
+
+extern "C"
+sac_sound_manager_t *sac_sound_manager_create(size_t pcm_budget) {
+  return reinterpret_cast<sac_sound_manager_t*>(new sound_manager_t(pcm_budget));
+}
+
+extern "C"
+void sac_sound_manager_destroy(sac_sound_manager_t *manager_) {
+  sound_manager_t *manager = reinterpret_cast<sound_manager_t*>(manager_);
+  delete manager;
+}
+
+extern "C"
+int sac_sound_manager_add(sac_sound_manager_t *manager_, const sac_packed_data_t *data_) {
+  sound_manager_t *manager = reinterpret_cast<sound_manager_t*>(manager_);
+  const packed_data_t *data = reinterpret_cast<const packed_data_t*>(data_);
+  if (!manager || !data) {
+    return -1;
+  }
+  return manager->add(data);
+}
+
+extern "C"
+void sac_sound_manager_remove(sac_sound_manager_t *manager_, int sound) {
+  sound_manager_t *manager = reinterpret_cast<sound_manager_t*>(manager_);
+  if (manager) {
+    manager->remove(sound);
+  }
+}
+
+extern "C"
+int sac_sound_manager_get_samples(sac_sound_manager_t *manager_, int sound, int16_t *out, int start, int count) {
+  sound_manager_t *manager = reinterpret_cast<sound_manager_t*>(manager_);
+  if (!manager) {
+    return 0;
+  }
+  return manager->get_samples(sound, out, start, count);
+}
+
+extern "C"
+int sac_sound_manager_update(sac_sound_manager_t *manager_) {
+  sound_manager_t *manager = reinterpret_cast<sound_manager_t*>(manager_);
+  if (!manager) {
+    return 0;
+  }
+  return manager->update();
+}
+
+extern "C"
+void sac_sound_manager_get_stats(sac_sound_manager_t *manager_, sac_sound_manager_stats_t *stats) {
+  sound_manager_t *manager = reinterpret_cast<sound_manager_t*>(manager_);
+  if (!stats) {
+    return;
+  }
+  if (manager) {
+    manager->get_stats(stats);
+  } else {
+    std::memset(stats, 0, sizeof(sac_sound_manager_stats_t));
+  }
+}
@@ -0,0 +1,105 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Sound manager:
+//
+// Sounds are kept in one of two tiers: packed only, or also fully decoded to
+// (interleaved) PCM. The heat of a sound is the number of sample frames that
+// have been requested, decayed at every update. At each update, the sounds
+// are ranked by heat per byte of PCM (i.e. by the decoding work that the PCM
+// saves per byte), and the highest ranked sounds that fit in the PCM budget
+// are made resident. Resident sounds get a bonus in the ranking, so that
+// sounds of similar heat do not swap tiers at every update.
+//
+// Only update() allocates and decodes PCM (outside of the lock), so readers
+// are never blocked by decoding. Sounds are pinned while their PCM is read or
+// while they are being decoded, and pinned sounds are not demoted or removed.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_SOUND_MANAGER_H_
+#define LIBSAC_SOUND_MANAGER_H_
+
+#include "../include/libsac.h"
+#include "allocator.h"
+#include "packed_data.h"
+#include "spin_lock.h"
+
+namespace sac {
+
+class sound_manager_t : public allocated_t {
+  public:
+    /// @param budget The max size of all PCM, in bytes.
+    explicit sound_manager_t(size_t budget);
+
+    ~sound_manager_t();
+
+    /// @brief Add a sound (the packed data is not copied).
+    /// @returns The sound id, or -1 on failure.
+    int add(const packed_data_t *data);
+
+    /// @brief Remove a sound (waits until it is no longer pinned).
+    void remove(int sound);
+
+    /// @brief Get interleaved samples of a sound (see sac_decode_interleaved).
+    /// @returns The number of sample frames that were output.
+    int get_samples(int sound, int16_t *out, int start, int count);
+
+    /// @brief Update the heat of the sounds, and promote/demote sounds.
+    /// @returns The number of sounds that changed tier.
+    int update();
+
+    void get_stats(sac_sound_manager_stats_t *stats);
+
+  private:
+    struct sound_t {
+      const packed_data_t *data;  ///< Zero for a free slot.
+      int16_t *pcm;               ///< Zero if the sound is not resident.
+      size_t pcm_bytes;
+      uint64_t requested;         ///< Frames requested since the last update.
+      double heat;
+      int pins;
+      bool removing;              ///< Waiting for the last pin to be released.
+    };
+
+    sound_manager_t();
+    sound_manager_t(const sound_manager_t& other);
+    sound_manager_t& operator=(const sound_manager_t& other);
+
+    /// @returns false if the sound id is invalid, or if the sound is being
+    /// removed (the lock must be held).
+    bool is_valid(int sound) const {
+      return sound >= 0 && sound < m_num_sounds && m_sounds[sound].data != 0 && !m_sounds[sound].removing;
+    }
+
+    const size_t m_budget;
+    spin_lock_t m_lock;
+    sound_t *m_sounds;
+    int m_num_sounds;
+    int m_capacity;
+    size_t m_resident_bytes;
+    sac_sound_manager_stats_t m_stats;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_SOUND_MANAGER_H_
@@ -0,0 +1,208 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "sparse_map.h"
+
+#include <cstring>
+
+#include "file_format.h"
+
+namespace sac {
+
+namespace {
+
+// Size of the fixed part of a serialized map (leading, trailing, num_runs).
+const int kFixedSize = 12;
+
+/// @brief Load a 64-bit little endian value.
+uint64_t get_uint64(const uint8_t *in) {
+  return static_cast<uint64_t>(get_uint32(in)) | (static_cast<uint64_t>(get_uint32(in + 4)) << 32);
+}
+
+} // anonymous namespace
+
+sparse_map_t::sparse_map_t(int num_blocks, int leading, int trailing)
+    : m_leading(leading),
+      m_trailing(trailing),
+      m_num_blocks(num_blocks),
+      m_num_words((num_blocks + 63) / 64),
+      m_num_runs(0),
+      m_num_coded(num_blocks),
+      m_memory(0),
+      m_const_bits(0),
+      m_run_bits(0),
+      m_const_rank(0),
+      m_run_rank(0),
+      m_values(0) {
+}
+
+sparse_map_t::~sparse_map_t() {
+  mem_free(m_memory);
+}
+
+bool sparse_map_t::allocate(int num_runs) {
+  // The bitmaps and the directories have an extra (empty) entry, so that
+  // rank() can be used for n = number of blocks.
+  const size_t num_words = m_num_words + 1;
+  const size_t size = num_words * 2 * sizeof(uint64_t) + num_words * 2 * sizeof(uint32_t) + num_runs * sizeof(int16_t);
+  uint8_t *memory = static_cast<uint8_t*>(mem_alloc(size));
+  if (!memory) {
+    return false;
+  }
+  std::memset(memory, 0, size);
+  mem_free(m_memory);
+  m_memory = memory;
+  m_const_bits = reinterpret_cast<uint64_t*>(memory);
+  m_run_bits = m_const_bits + num_words;
+  m_const_rank = reinterpret_cast<uint32_t*>(m_run_bits + num_words);
+  m_run_rank = m_const_rank + num_words;
+  m_values = reinterpret_cast<int16_t*>(m_run_rank + num_words);
+  m_num_runs = num_runs;
+  return true;
+}
+
+void sparse_map_t::update_directories() {
+  uint32_t num_const = 0, num_runs = 0;
+  for (int w = 0; w <= m_num_words; ++w) {
+    m_const_rank[w] = num_const;
+    m_run_rank[w] = num_runs;
+    num_const += popcount64(m_const_bits[w]);
+    num_runs += popcount64(m_run_bits[w]);
+  }
+  m_num_coded = m_num_blocks - static_cast<int>(num_const);
+}
+
+bool sparse_map_t::build(const int *values) {
+  // A new run starts at every constant block whose value differs from that
+  // of the previous block.
+  int num_runs = 0;
+  for (int index = 0; index < m_num_blocks; ++index) {
+    if (values[index] != kNotConstant && (index == 0 || values[index - 1] != values[index])) {
+      ++num_runs;
+    }
+  }
+  if (!allocate(num_runs)) {
+    return false;
+  }
+
+  int run = 0;
+  for (int index = 0; index < m_num_blocks; ++index) {
+    if (values[index] == kNotConstant) {
+      continue;
+    }
+    const uint64_t bit = uint64_t(1) << (index & 63);
+    m_const_bits[index >> 6] |= bit;
+    if (index == 0 || values[index - 1] != values[index]) {
+      m_run_bits[index >> 6] |= bit;
+      m_values[run++] = static_cast<int16_t>(values[index]);
+    }
+  }
+
+  update_directories();
+  return true;
+}
+
+sparse_map_t *sparse_map_t::parse(const uint8_t *in, int size, int block_size, int num_samples, int num_channels) {
+  if (size < kFixedSize || block_size < 1) {
+    return 0;
+  }
+  const uint32_t leading = get_uint32(in);
+  const uint32_t trailing = get_uint32(in + 4);
+  const uint32_t num_runs = get_uint32(in + 8);
+  if (leading > static_cast<uint32_t>(num_samples) || trailing > static_cast<uint32_t>(num_samples) - leading) {
+    return 0;
+  }
+
+  const int coded_samples = num_samples - static_cast<int>(leading) - static_cast<int>(trailing);
+  const int num_blocks = (coded_samples + block_size - 1) / block_size;
+  scoped_ptr<sparse_map_t> map(new sparse_map_t(num_blocks * num_channels, static_cast<int>(leading), static_cast<int>(trailing)));
+  const int bitmap_size = map->m_num_words * 8;
+  if (num_runs > static_cast<uint32_t>(map->m_num_blocks) || size != kFixedSize + 2 * bitmap_size + static_cast<int>(num_runs) * 2) {
+    return 0;
+  }
+  if (!map->allocate(static_cast<int>(num_runs))) {
+    return 0;
+  }
+
+  const uint8_t *src = in + kFixedSize;
+  for (int w = 0; w < map->m_num_words; ++w) {
+    map->m_const_bits[w] = get_uint64(src + w * 8);
+    map->m_run_bits[w] = get_uint64(src + bitmap_size + w * 8);
+  }
+  src += 2 * bitmap_size;
+  for (int r = 0; r < static_cast<int>(num_runs); ++r) {
+    map->m_values[r] = static_cast<int16_t>(get_uint16(src + r * 2));
+  }
+
+  // Check that only valid blocks are marked, that all runs start at a
+  // constant block, and that there is a run start after every coded block.
+  const int tail_bits = map->m_num_blocks & 63;
+  const uint64_t tail_mask = tail_bits ? ~((uint64_t(1) << tail_bits) - 1) : 0;
+  uint64_t prev_const = 0;
+  for (int w = 0; w < map->m_num_words; ++w) {
+    const uint64_t c = map->m_const_bits[w];
+    const uint64_t r = map->m_run_bits[w];
+    const uint64_t starts = c & ~((c << 1) | prev_const);
+    if ((r & ~c) != 0 || (starts & ~r) != 0) {
+      return 0;
+    }
+    prev_const = c >> 63;
+  }
+  if (map->m_num_words > 0 && ((map->m_const_bits[map->m_num_words - 1] | map->m_run_bits[map->m_num_words - 1]) & tail_mask) != 0) {
+    return 0;
+  }
+
+  map->update_directories();
+  if (map->m_run_rank[map->m_num_words] != num_runs) {
+    return 0;
+  }
+  return map.release();
+}
+
+int sparse_map_t::serialized_size() const {
+  return kFixedSize + 2 * m_num_words * 8 + m_num_runs * 2;
+}
+
+void sparse_map_t::serialize(uint8_t *out) const {
+  put_uint32(out, static_cast<uint32_t>(m_leading));
+  put_uint32(out + 4, static_cast<uint32_t>(m_trailing));
+  put_uint32(out + 8, static_cast<uint32_t>(m_num_runs));
+  uint8_t *dst = out + kFixedSize;
+  for (int w = 0; w < m_num_words; ++w) {
+    put_uint32(dst + w * 8, static_cast<uint32_t>(m_const_bits[w]));
+    put_uint32(dst + w * 8 + 4, static_cast<uint32_t>(m_const_bits[w] >> 32));
+  }
+  dst += m_num_words * 8;
+  for (int w = 0; w < m_num_words; ++w) {
+    put_uint32(dst + w * 8, static_cast<uint32_t>(m_run_bits[w]));
+    put_uint32(dst + w * 8 + 4, static_cast<uint32_t>(m_run_bits[w] >> 32));
+  }
+  dst += m_num_words * 8;
+  for (int r = 0; r < m_num_runs; ++r) {
+    dst[r * 2] = static_cast<uint8_t>(m_values[r]);
+    dst[r * 2 + 1] = static_cast<uint8_t>(m_values[r] >> 8);
+  }
+}
+
+} // namespace sac
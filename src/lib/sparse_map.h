@@ -0,0 +1,149 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Sparse block map (SAC_LAYOUT_SPARSE):
+//
+// Blocks whose samples all have the same value (e.g. digital silence or DC)
+// are not stored in the data chunk. Instead they are marked in a bitmap, and
+// consecutive constant blocks with the same value form a run, of which only
+// the value is stored.
+//
+// Blocks are numbered in storage order (block rows, or one channel after the
+// other for the planar layout), and the data chunk holds the remaining
+// (coded) blocks in the same order. All coded blocks are stored with the size
+// of a full block (see block_layout.h), so the position of a coded block is
+// given by the number of coded blocks before it, which is found in constant
+// time using a rank directory (one count per 64 blocks).
+//
+// Leading and trailing samples that are zero in all channels are trimmed, and
+// only the samples in between are divided into blocks.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_SPARSE_MAP_H_
+#define LIBSAC_SPARSE_MAP_H_
+
+#include "../include/libsac.h"
+#include "allocator.h"
+#include "util.h"
+
+namespace sac {
+
+class sparse_map_t : public allocated_t {
+  public:
+    /// @brief Block value for blocks that are not constant (see build()).
+    static const int kNotConstant = 0x10000;
+
+    /// @brief Create an empty map (all blocks are coded).
+    /// @param num_blocks Number of blocks (of all channels).
+    /// @param leading Number of trimmed leading samples.
+    /// @param trailing Number of trimmed trailing samples.
+    sparse_map_t(int num_blocks, int leading, int trailing);
+
+    ~sparse_map_t();
+
+    /// @brief Build the map from the block values.
+    /// @param values The value of each block (by storage order index), or
+    /// kNotConstant for blocks that are coded.
+    /// @returns false if the memory for the map could not be allocated.
+    bool build(const int *values);
+
+    /// @brief Parse a serialized map (the payload of a SPRS chunk).
+    /// @param in The serialized map.
+    /// @param size Size of the serialized map, in bytes.
+    /// @param block_size The block size (samples per block).
+    /// @param num_samples Number of samples per channel (including the
+    /// trimmed samples).
+    /// @param num_channels Number of channels.
+    /// @returns The map, or zero if the serialized map is malformed.
+    static sparse_map_t *parse(const uint8_t *in, int size, int block_size, int num_samples, int num_channels);
+
+    /// @returns The size of the serialized map, in bytes.
+    int serialized_size() const;
+
+    /// @brief Serialize the map (see file_format.h).
+    /// @param out The output buffer (serialized_size() bytes).
+    void serialize(uint8_t *out) const;
+
+    /// @returns Number of trimmed leading samples.
+    int leading() const {
+      return m_leading;
+    }
+
+    /// @returns Number of trimmed trailing samples.
+    int trailing() const {
+      return m_trailing;
+    }
+
+    /// @returns The number of coded (non-constant) blocks.
+    int num_coded() const {
+      return m_num_coded;
+    }
+
+    /// @param index The storage order index of a block.
+    bool is_constant(int index) const {
+      return (m_const_bits[index >> 6] & (uint64_t(1) << (index & 63))) != 0;
+    }
+
+    /// @returns The value of a constant block.
+    int16_t value(int index) const {
+      return m_values[rank(m_run_bits, m_run_rank, index + 1) - 1];
+    }
+
+    /// @returns The position of a coded block among the coded blocks.
+    int coded_index(int index) const {
+      return index - rank(m_const_bits, m_const_rank, index);
+    }
+
+  private:
+    sparse_map_t();
+    sparse_map_t(const sparse_map_t& other);
+    sparse_map_t& operator=(const sparse_map_t& other);
+
+    /// @returns The number of set bits before bit n.
+    static int rank(const uint64_t *bits, const uint32_t *directory, int n) {
+      const int word = n >> 6;
+      const uint64_t mask = (uint64_t(1) << (n & 63)) - 1;
+      return static_cast<int>(directory[word]) + popcount64(bits[word] & mask);
+    }
+
+    bool allocate(int num_runs);
+    void update_directories();
+
+    const int m_leading;
+    const int m_trailing;
+    const int m_num_blocks;
+    const int m_num_words;
+    int m_num_runs;
+    int m_num_coded;
+
+    void *m_memory;
+    uint64_t *m_const_bits;
+    uint64_t *m_run_bits;
+    uint32_t *m_const_rank;
+    uint32_t *m_run_rank;
+    int16_t *m_values;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_SPARSE_MAP_H_
@@ -0,0 +1,93 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_SPIN_LOCK_H_
+#define LIBSAC_SPIN_LOCK_H_
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace sac {
+
+/// @brief A minimal spin lock, for short critical sections.
+/// After a number of failed attempts, the waiting thread yields, so that a
+/// lock holder that has been preempted gets to run (e.g. when there are more
+/// threads than CPUs).
+class spin_lock_t {
+  public:
+    spin_lock_t() : m_lock(0) {}
+
+    void lock() {
+      for (int attempt = 1; !try_lock(); ++attempt) {
+        if ((attempt & 63) == 0) {
+          yield();
+        }
+      }
+    }
+
+    void unlock() {
+#ifdef _MSC_VER
+      _InterlockedExchange(&m_lock, 0);
+#else
+      __sync_lock_release(&m_lock);
+#endif
+    }
+
+    /// @brief Give up the rest of the time slice of the calling thread.
+    static void yield();
+
+  private:
+    bool try_lock() {
+#ifdef _MSC_VER
+      return _InterlockedExchange(&m_lock, 1) == 0;
+#else
+      return __sync_lock_test_and_set(&m_lock, 1) == 0;
+#endif
+    }
+
+    volatile long m_lock;
+};
+
+/// @brief Scoped lock.
+class scoped_lock_t {
+  public:
+    explicit scoped_lock_t(spin_lock_t &lock) : m_lock(lock) {
+      m_lock.lock();
+    }
+
+    ~scoped_lock_t() {
+      m_lock.unlock();
+    }
+
+  private:
+    scoped_lock_t(const scoped_lock_t& other);
+    scoped_lock_t& operator=(const scoped_lock_t& other);
+
+    spin_lock_t &m_lock;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_SPIN_LOCK_H_
@@ -0,0 +1,239 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "stats.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef LIBSAC_ENABLE_STATS
+#  ifdef _WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#    define LIBSAC_THREAD_LOCAL __declspec(thread)
+#    define LIBSAC_EXIT_CALLBACK NTAPI
+#  else
+#    include <pthread.h>
+#    include <time.h>
+#    define LIBSAC_THREAD_LOCAL __thread
+#    define LIBSAC_EXIT_CALLBACK
+#  endif
+#  include "spin_lock.h"
+#endif
+
+namespace sac {
+
+#ifdef LIBSAC_ENABLE_STATS
+
+namespace {
+
+// The counters of each thread are kept in a node of a global list. When a
+// thread exits, its counts are added to s_retired (so that they are retained),
+// and its node is put on a free list, to be reused by a new thread.
+struct stats_node_t {
+  sac_stats_t stats;
+  stats_node_t *next;
+};
+
+// NOTE: sac_stats_t must only contain uint64_t counters.
+const int kNumCounters = sizeof(sac_stats_t) / sizeof(uint64_t);
+
+LIBSAC_THREAD_LOCAL stats_node_t *s_thread_node = 0;
+stats_node_t *s_nodes = 0;
+stats_node_t *s_free_nodes = 0;
+
+// Sum of the counters of all threads that have exited.
+sac_stats_t s_retired;
+
+// Counter values at the time of the last reset.
+sac_stats_t s_baseline;
+
+// The spin lock protects the node lists, the retired counts and the baseline.
+// It is only taken when a thread is registered or exits, and when the stats
+// are read or reset, so the counting itself is lock free.
+spin_lock_t s_lock;
+
+// Thread exit notification (the node of the thread is stored in a thread
+// specific slot with a destructor).
+bool s_have_exit_key = false;
+#ifdef _WIN32
+DWORD s_exit_key;
+#else
+pthread_key_t s_exit_key;
+#endif
+
+/// @brief Add counters (the source counters may be owned by another thread).
+void add_counters(sac_stats_t *dst_stats, const sac_stats_t *src_stats) {
+  uint64_t *dst = reinterpret_cast<uint64_t*>(dst_stats);
+  const uint64_t *src = reinterpret_cast<const uint64_t*>(src_stats);
+  for (int i = 0; i < kNumCounters; ++i) {
+    dst[i] += stats_load(src[i]);
+  }
+}
+
+/// @brief Sum the counters of all threads (the lock must be held).
+void aggregate(sac_stats_t *result) {
+  *result = s_retired;
+  for (const stats_node_t *node = s_nodes; node; node = node->next) {
+    add_counters(result, &node->stats);
+  }
+}
+
+/// @brief Retire the node of an exiting thread.
+void LIBSAC_EXIT_CALLBACK release_node(void *ptr) {
+  stats_node_t *node = static_cast<stats_node_t*>(ptr);
+  if (!node) {
+    return;
+  }
+  {
+    scoped_lock_t lock(s_lock);
+    add_counters(&s_retired, &node->stats);
+    stats_node_t **link = &s_nodes;
+    while (*link != node) {
+      link = &(*link)->next;
+    }
+    *link = node->next;
+    std::memset(&node->stats, 0, sizeof(sac_stats_t));
+    node->next = s_free_nodes;
+    s_free_nodes = node;
+  }
+  s_thread_node = 0;
+}
+
+/// @brief Register a node for the calling thread.
+stats_node_t *register_thread() {
+  stats_node_t *node;
+  bool have_exit_key;
+  {
+    scoped_lock_t lock(s_lock);
+    if (!s_have_exit_key) {
+#ifdef _WIN32
+      s_exit_key = FlsAlloc(release_node);
+      s_have_exit_key = s_exit_key != FLS_OUT_OF_INDEXES;
+#else
+      s_have_exit_key = pthread_key_create(&s_exit_key, release_node) == 0;
+#endif
+    }
+    have_exit_key = s_have_exit_key;
+    node = s_free_nodes;
+    if (node) {
+      s_free_nodes = node->next;
+    }
+  }
+  if (!node) {
+    // Stats nodes outlive any custom allocator, so use the system allocator.
+    node = static_cast<stats_node_t*>(std::calloc(1, sizeof(stats_node_t)));
+    if (!node) {
+      return 0;
+    }
+  }
+  {
+    scoped_lock_t lock(s_lock);
+    node->next = s_nodes;
+    s_nodes = node;
+  }
+
+  // Without an exit notification, the node is kept for the life of the
+  // process (like the node of the main thread, which never exits).
+  if (have_exit_key) {
+#ifdef _WIN32
+    FlsSetValue(s_exit_key, node);
+#else
+    pthread_setspecific(s_exit_key, node);
+#endif
+  }
+  return node;
+}
+
+} // anonymous namespace
+
+volatile int g_stats_enabled = 0;
+
+sac_stats_t *current_thread_stats() {
+  if (!s_thread_node) {
+    s_thread_node = register_thread();
+    if (!s_thread_node) {
+      return 0;
+    }
+  }
+  return &s_thread_node->stats;
+}
+
+uint64_t stats_time_ns() {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, count;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&count);
+  return static_cast<uint64_t>(static_cast<double>(count.QuadPart) * (1e9 / static_cast<double>(frequency.QuadPart)));
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+#endif // LIBSAC_ENABLE_STATS
+
+} // namespace sac
+
+using namespace sac;
+
+extern "C"
+int sac_set_stats_enabled(int enabled) {
+#ifdef LIBSAC_ENABLE_STATS
+  g_stats_enabled = enabled ? 1 : 0;
+  return 1;
+#else
+  (void)enabled;
+  return 0;
+#endif
+}
+
+extern "C"
+void sac_get_stats(sac_stats_t *stats) {
+  if (!stats) {
+    return;
+  }
+#ifdef LIBSAC_ENABLE_STATS
+  scoped_lock_t lock(s_lock);
+  aggregate(stats);
+  uint64_t *dst = reinterpret_cast<uint64_t*>(stats);
+  const uint64_t *base = reinterpret_cast<const uint64_t*>(&s_baseline);
+  for (int i = 0; i < kNumCounters; ++i) {
+    dst[i] -= base[i];
+  }
+#else
+  std::memset(stats, 0, sizeof(sac_stats_t));
+#endif
+}
+
+extern "C"
+void sac_reset_stats(void) {
+#ifdef LIBSAC_ENABLE_STATS
+  // The counters are owned by their threads, so instead of clearing them we
+  // record the current values as the new baseline.
+  scoped_lock_t lock(s_lock);
+  aggregate(&s_baseline);
+#endif
+}
@@ -0,0 +1,125 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_STATS_H_
+#define LIBSAC_STATS_H_
+
+#include "../include/libsac.h"
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace sac {
+
+/// @brief Add to a statistics counter of the calling thread.
+/// The counters of a thread are only written by that thread, but they are
+/// read by other threads (see sac_get_stats), so they are loaded and stored
+/// atomically (without any ordering constraints).
+inline void stats_add(uint64_t &counter, uint64_t n) {
+#ifdef _MSC_VER
+  volatile __int64 *ptr = reinterpret_cast<volatile __int64*>(&counter);
+  __iso_volatile_store64(ptr, __iso_volatile_load64(ptr) + static_cast<__int64>(n));
+#else
+  __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+#endif
+}
+
+/// @brief Read a statistics counter of any thread (see stats_add).
+inline uint64_t stats_load(const uint64_t &counter) {
+#ifdef _MSC_VER
+  return static_cast<uint64_t>(__iso_volatile_load64(reinterpret_cast<const volatile __int64*>(&counter)));
+#else
+  return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+#endif
+}
+
+#ifdef LIBSAC_ENABLE_STATS
+
+/// @brief Run time switch for statistics collection.
+extern volatile int g_stats_enabled;
+
+/// @returns The statistics counters of the calling thread.
+sac_stats_t *current_thread_stats();
+
+/// @returns A monotonic time stamp, in nanoseconds.
+uint64_t stats_time_ns();
+
+/// @returns The statistics counters of the calling thread, or null if
+/// statistics collection is disabled.
+inline sac_stats_t *thread_stats() {
+  return g_stats_enabled ? current_thread_stats() : 0;
+}
+
+#else
+
+inline sac_stats_t *thread_stats() {
+  return 0;
+}
+
+inline uint64_t stats_time_ns() {
+  return 0;
+}
+
+#endif // LIBSAC_ENABLE_STATS
+
+/// @brief Count an encoded block.
+/// @param stats The statistics to update.
+/// @param encoding The encoding of the block.
+/// @param map_no The quantization map of the block.
+/// @param predictor_no The predictor of the block.
+/// @param num_clamped Number of clamped samples in the block.
+inline void count_encoded_block(sac_stats_t *stats, sac_encoding_t encoding, int map_no, int predictor_no, int num_clamped) {
+  stats_add(stats->blocks_encoded[encoding], 1);
+  stats_add(stats->map_usage[encoding][map_no], 1);
+  stats_add(stats->predictor_usage[encoding][predictor_no], 1);
+  stats_add(stats->clamp_events, num_clamped);
+}
+
+/// @brief Scoped API call timer.
+/// Counts the call and accumulates the time spent in the scope of the timer.
+class api_timer_t {
+  public:
+    explicit api_timer_t(sac_api_t api) : m_api(api), m_stats(thread_stats()), m_start(0) {
+      if (m_stats) {
+        m_start = stats_time_ns();
+      }
+    }
+
+    ~api_timer_t() {
+      if (m_stats) {
+        stats_add(m_stats->api[m_api].calls, 1);
+        stats_add(m_stats->api[m_api].time_ns, stats_time_ns() - m_start);
+      }
+    }
+
+  private:
+    const sac_api_t m_api;
+    sac_stats_t *const m_stats;
+    uint64_t m_start;
+};
+
+} // namespace sac
+
+#endif // LIBSAC_STATS_H_
@@ -0,0 +1,433 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Streaming encoding/decoding.
+//
+// For non-planar layouts, the encoded data is a sequence of superblock rows
+// (block rows for the default layout), and only the final row may be partial.
+// Encoding a whole number of rows as a separate packed data container thus
+// produces exactly the corresponding slice of the complete data chunk, which
+// is what the stream writer and reader make use of: they encode/decode the
+// stream in chunks of rows, using a constant amount of memory.
+//-----------------------------------------------------------------------------
+
+#include "../include/libsac.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "allocator.h"
+#include "file_format.h"
+#include "packed_data.h"
+#include "util.h"
+
+namespace sac {
+
+namespace {
+
+// Approximate number of samples (per channel) in a chunk.
+const int kTargetChunkSamples = 65536;
+
+/// @returns The number of samples per channel in a (full) chunk. This is a
+/// whole number of superblock rows.
+int chunk_samples(int block_size, int layout) {
+  const int blocks_per_row = (layout & SAC_LAYOUT_SUPERBLOCKS) ? block_layout_t::kBlocksPerSuperblock : 1;
+  const int row_samples = block_size * blocks_per_row;
+  return row_samples * std::max(1, kTargetChunkSamples / row_samples);
+}
+
+class stream_writer_t : public allocated_t {
+  public:
+    stream_writer_t(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t &options, sac_write_fn_t write_fn, sac_seek_fn_t seek_fn, void *user)
+        : m_declared_samples(num_samples),
+          m_num_channels(num_channels),
+          m_sample_rate(sample_rate),
+          m_options(options),
+          m_write_fn(write_fn),
+          m_seek_fn(seek_fn),
+          m_user(user),
+          m_block_size(options.block_size > 0 ? options.block_size : block_layout_t::default_block_size(options.format)),
+          m_chunk_samples(chunk_samples(m_block_size, options.layout)),
+          m_channels(num_channels, static_cast<int16_t*>(0)),
+          m_buffered(0),
+          m_num_samples(0),
+          m_data_size(0),
+          m_header_size(0) {
+      for (size_t ch = 0; ch < m_channels.size(); ++ch) {
+        m_channels[ch] = static_cast<int16_t*>(mem_alloc(m_chunk_samples * sizeof(int16_t)));
+      }
+    }
+
+    ~stream_writer_t() {
+      for (size_t ch = 0; ch < m_channels.size(); ++ch) {
+        mem_free(m_channels[ch]);
+      }
+    }
+
+    /// @brief Write the file header.
+    bool open() {
+      if (!m_channels.get()) {
+        return false;
+      }
+      for (size_t ch = 0; ch < m_channels.size(); ++ch) {
+        if (!m_channels[ch]) {
+          return false;
+        }
+      }
+      if (m_declared_samples >= 0) {
+        const block_layout_t blocks(m_options.format, m_block_size, m_options.layout, m_declared_samples, m_num_channels);
+        return write_header(m_declared_samples, blocks.data_size());
+      }
+      return write_header(0, 0);
+    }
+
+    bool write(const int16_t *const *channels, int count) {
+      int pos = 0;
+      while (pos < count) {
+        const int n = std::min(count - pos, m_chunk_samples - m_buffered);
+        for (int ch = 0; ch < m_num_channels; ++ch) {
+          std::memcpy(m_channels[ch] + m_buffered, channels[ch] + pos, n * sizeof(int16_t));
+        }
+        m_buffered += n;
+        pos += n;
+
+        // Only full chunks are encoded here, since the final chunk is the only
+        // chunk that may end with a partial row.
+        if (m_buffered == m_chunk_samples && !flush()) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool close() {
+      if (m_buffered > 0 && !flush()) {
+        return false;
+      }
+
+      // Patch the header if the size was not known up front. Note that the
+      // file size fields are 32 bits.
+      if (m_num_samples != m_declared_samples) {
+        if (m_num_samples > 0x7fffffff || m_header_size + m_data_size > 0xffffffff) {
+          return false;
+        }
+        if (!m_seek_fn || !m_seek_fn(0, m_user) ||
+            !write_header(static_cast<uint32_t>(m_num_samples), static_cast<uint32_t>(m_data_size)) ||
+            !m_seek_fn(m_header_size + m_data_size, m_user)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+  private:
+    bool write_header(uint32_t num_samples, uint32_t data_size) {
+      uint8_t header[kMaxFileHeaderSize];
+      m_header_size = make_file_header(header, m_options.format, m_block_size, m_options.layout, num_samples, m_num_channels, m_sample_rate, data_size);
+      return m_header_size > 0 && m_write_fn(header, m_header_size, m_user);
+    }
+
+    /// @brief Encode and write the buffered samples.
+    bool flush() {
+      scoped_ptr<packed_data_t> data(reinterpret_cast<packed_data_t*>(
+          sac_encode_ex(m_buffered, m_num_channels, m_sample_rate, &m_options, m_channels.get())));
+      if (!data.get()) {
+        return false;
+      }
+      m_num_samples += m_buffered;
+      m_data_size += data->size();
+      m_buffered = 0;
+      return m_write_fn(data->data(), data->size(), m_user) != 0;
+    }
+
+    const int m_declared_samples;
+    const int m_num_channels;
+    const int m_sample_rate;
+    const sac_encode_options_t m_options;
+    const sac_write_fn_t m_write_fn;
+    const sac_seek_fn_t m_seek_fn;
+    void *const m_user;
+    const int m_block_size;
+    const int m_chunk_samples;
+    scoped_buffer_t<int16_t*> m_channels;
+    int m_buffered;
+    int64_t m_num_samples;
+    int64_t m_data_size;
+    int m_header_size;
+};
+
+class stream_reader_t : public allocated_t {
+  public:
+    stream_reader_t(sac_read_fn_t read_fn, void *user)
+        : m_read_fn(read_fn),
+          m_user(user),
+          m_num_samples(0),
+          m_num_channels(0),
+          m_sample_rate(0),
+          m_encoding(SAC_FORMAT_UNDEFINED),
+          m_block_size(0),
+          m_layout(SAC_LAYOUT_DEFAULT),
+          m_chunk_start(0),
+          m_pos(0) {}
+
+    /// @brief Read the file header, up to the start of the data chunk.
+    bool open() {
+      uint8_t buf[16];
+
+      // File master chunk (must have chunk ID "SAC\1").
+      if (!read_bytes(buf, 8) || get_uint32(buf) != 0x01434153) {
+        return false;
+      }
+
+      // Read sub-chunk headers until we reach the data chunk.
+      while (read_bytes(buf, 8)) {
+        const uint32_t chunk_id = get_uint32(buf);
+        const uint32_t chunk_size = get_uint32(buf + 4);
+
+        switch (chunk_id) {
+          // FRMT: Format chunk (must come before the data chunk).
+          case 0x544D5246: {
+            if (chunk_size < 14) {
+              return false;
+            }
+            const int format_bytes = chunk_size >= 16 ? 16 : 14;
+            if (!read_bytes(buf, format_bytes) || !skip_bytes(chunk_size - format_bytes)) {
+              return false;
+            }
+            bool fourcc_layout;
+            if (!parse_format_fourcc(get_uint32(buf), &m_encoding, &m_block_size, &fourcc_layout)) {
+              return false;
+            }
+            const uint32_t num_samples = get_uint32(buf + 4);
+            m_num_channels = get_uint16(buf + 8);
+            m_sample_rate = static_cast<int>(get_uint32(buf + 10));
+            m_layout = format_bytes >= 16 ? get_uint16(buf + 14) : static_cast<int>(SAC_LAYOUT_DEFAULT);
+            if (!block_layout_t::is_valid_layout(m_layout) || is_fourcc_layout(m_layout) != fourcc_layout ||
+                (m_layout & SAC_LAYOUT_PLANAR) || block_layout_t::is_block_list(m_layout) ||
+                num_samples > INT_MAX || m_num_channels < 1) {
+              return false;
+            }
+            m_num_samples = static_cast<int>(num_samples);
+            if (!block_layout_t(m_encoding, m_block_size, m_layout, m_num_samples, m_num_channels).has_valid_size()) {
+              return false;
+            }
+            break;
+          }
+
+          // DATA: Data chunk.
+          case 0x41544144: {
+            if (m_encoding == SAC_FORMAT_UNDEFINED) {
+              // We don't have the data definition yet.
+              return false;
+            }
+            const block_layout_t blocks(m_encoding, m_block_size, m_layout, m_num_samples, m_num_channels);
+            return chunk_size == static_cast<uint32_t>(blocks.data_size());
+          }
+
+          // Any other chunk: skip.
+          default: {
+            if (!skip_bytes(chunk_size)) {
+              return false;
+            }
+            break;
+          }
+        }
+      }
+
+      return false;
+    }
+
+    int read(int16_t **channels, int max_samples) {
+      int done = 0;
+      while (done < max_samples && m_pos < m_num_samples) {
+        if (!m_chunk.get() || m_pos >= m_chunk_start + m_chunk->num_samples()) {
+          if (!next_chunk()) {
+            return -1;
+          }
+        }
+        const int offset = m_pos - m_chunk_start;
+        const int count = std::min(max_samples - done, m_chunk->num_samples() - offset);
+        for (int ch = 0; ch < m_num_channels; ++ch) {
+          sac_decode_channel(channels[ch] + done, m_chunk.get(), offset, count, ch);
+        }
+        done += count;
+        m_pos += count;
+      }
+      return done;
+    }
+
+    int num_samples() const {
+      return m_num_samples;
+    }
+
+    int num_channels() const {
+      return m_num_channels;
+    }
+
+    int sample_rate() const {
+      return m_sample_rate;
+    }
+
+    sac_encoding_t encoding() const {
+      return m_encoding;
+    }
+
+  private:
+    /// @brief Read the next chunk of encoded data.
+    bool next_chunk() {
+      const int start = m_chunk.get() ? m_chunk_start + m_chunk->num_samples() : 0;
+      const int samples = std::min(chunk_samples(m_block_size, m_layout), m_num_samples - start);
+      const block_layout_t blocks(m_encoding, m_block_size, m_layout, samples, m_num_channels);
+      m_chunk.reset(new packed_data_t(blocks.data_size(), samples, m_num_channels, m_sample_rate, m_encoding, m_block_size, m_layout));
+      m_chunk_start = start;
+      return m_chunk->is_valid() && read_bytes(m_chunk->data(), m_chunk->size());
+    }
+
+    bool read_bytes(void *buf, int size) {
+      uint8_t *dst = static_cast<uint8_t*>(buf);
+      while (size > 0) {
+        const int n = m_read_fn(dst, size, m_user);
+        if (n <= 0) {
+          return false;
+        }
+        dst += n;
+        size -= n;
+      }
+      return true;
+    }
+
+    bool skip_bytes(uint32_t size) {
+      uint8_t buf[1024];
+      while (size > 0) {
+        const int n = static_cast<int>(std::min(size, static_cast<uint32_t>(sizeof(buf))));
+        if (!read_bytes(buf, n)) {
+          return false;
+        }
+        size -= n;
+      }
+      return true;
+    }
+
+    const sac_read_fn_t m_read_fn;
+    void *const m_user;
+    int m_num_samples;
+    int m_num_channels;
+    int m_sample_rate;
+    sac_encoding_t m_encoding;
+    int m_block_size;
+    int m_layout;
+    scoped_ptr<packed_data_t> m_chunk;
+    int m_chunk_start;
+    int m_pos;
+};
+
+} // anonymous namespace
+
+} // namespace sac
+
+using namespace sac;
+
+extern "C"
+sac_stream_writer_t *sac_stream_writer_open(int num_samples, int num_channels, int sample_rate, const sac_encode_options_t *options, sac_write_fn_t write_fn, sac_seek_fn_t seek_fn, void *user) {
+  // Check input arguments.
+  if (!options || !write_fn || num_channels < 1 || num_channels > 65535 || sample_rate < 1 ||
+      num_samples < -1 || (num_samples < 0 && !seek_fn) ||
+      (options->format != SAC_FORMAT_DD4A && options->format != SAC_FORMAT_DD8A) ||
+      !block_layout_t::is_valid_layout(options->layout) || (options->layout & SAC_LAYOUT_PLANAR) || block_layout_t::is_block_list(options->layout) ||
+      (options->block_size != 0 && !block_layout_t::is_valid_block_size(options->format, options->block_size))) {
+    return 0;
+  }
+
+  scoped_ptr<stream_writer_t> writer(new stream_writer_t(num_samples, num_channels, sample_rate, *options, write_fn, seek_fn, user));
+  if (!writer->open()) {
+    return 0;
+  }
+  return reinterpret_cast<sac_stream_writer_t*>(writer.release());
+}
+
+extern "C"
+int sac_stream_writer_write(sac_stream_writer_t *writer_, const int16_t *const *channels, int num_samples) {
+  stream_writer_t *writer = reinterpret_cast<stream_writer_t*>(writer_);
+  if (!writer || !channels || num_samples < 0) {
+    return 0;
+  }
+  return writer->write(channels, num_samples) ? 1 : 0;
+}
+
+extern "C"
+int sac_stream_writer_close(sac_stream_writer_t *writer_) {
+  stream_writer_t *writer = reinterpret_cast<stream_writer_t*>(writer_);
+  if (!writer) {
+    return 0;
+  }
+  const bool ok = writer->close();
+  delete writer;
+  return ok ? 1 : 0;
+}
+
+extern "C"
+sac_stream_reader_t *sac_stream_reader_open(sac_read_fn_t read_fn, void *user) {
+  if (!read_fn) {
+    return 0;
+  }
+  scoped_ptr<stream_reader_t> reader(new stream_reader_t(read_fn, user));
+  if (!reader->open()) {
+    return 0;
+  }
+  return reinterpret_cast<sac_stream_reader_t*>(reader.release());
+}
+
+extern "C"
+int sac_stream_reader_get_num_samples(const sac_stream_reader_t *reader) {
+  return reader ? reinterpret_cast<const stream_reader_t*>(reader)->num_samples() : 0;
+}
+
+extern "C"
+int sac_stream_reader_get_num_channels(const sac_stream_reader_t *reader) {
+  return reader ? reinterpret_cast<const stream_reader_t*>(reader)->num_channels() : 0;
+}
+
+extern "C"
+int sac_stream_reader_get_sample_rate(const sac_stream_reader_t *reader) {
+  return reader ? reinterpret_cast<const stream_reader_t*>(reader)->sample_rate() : 0;
+}
+
+extern "C"
+sac_encoding_t sac_stream_reader_get_encoding(const sac_stream_reader_t *reader) {
+  return reader ? reinterpret_cast<const stream_reader_t*>(reader)->encoding() : SAC_FORMAT_UNDEFINED;
+}
+
+extern "C"
+int sac_stream_reader_read(sac_stream_reader_t *reader_, int16_t **channels, int max_samples) {
+  stream_reader_t *reader = reinterpret_cast<stream_reader_t*>(reader_);
+  if (!reader || !channels || max_samples < 0) {
+    return -1;
+  }
+  return reader->read(channels, max_samples);
+}
+
+extern "C"
+void sac_stream_reader_close(sac_stream_reader_t *reader_) {
+  delete reinterpret_cast<stream_reader_t*>(reader_);
+}
@@ -0,0 +1,58 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Static tracepoints (USDT probes).
+//
+// When libsac is built with LIBSAC_ENABLE_USDT, the probes below are compiled
+// as sys/sdt.h probes (provider "libsac"), which are single nop instructions
+// until they are attached to by a tracer (e.g. perf, bpftrace or SystemTap).
+// Otherwise the probes compile to nothing.
+//
+// Probes (and their arguments):
+//   load_file__entry(file_name, channel)
+//   load_file__return(data, num_samples, num_channels, format)
+//   encode__entry(num_samples, num_channels, sample_rate, format)
+//   encode__return(data, num_samples, num_channels, format)
+//   encode_chunk__entry(first_block, num_blocks, num_channels, format)
+//   encode_chunk__return(first_block, num_blocks, num_channels, format)
+//   decode_channel__entry(data, start, count, channel, format)
+//   decode_channel__return(data, start, count, channel, format)
+//   decode_interleaved__entry(data, start, count, num_channels, format)
+//   decode_interleaved__return(data, start, count, num_channels, format)
+//-----------------------------------------------------------------------------
+
+#ifndef LIBSAC_TRACE_H_
+#define LIBSAC_TRACE_H_
+
+#ifdef LIBSAC_ENABLE_USDT
+#  include <sys/sdt.h>
+#  define LIBSAC_PROBE2(name, a1, a2) DTRACE_PROBE2(libsac, name, a1, a2)
+#  define LIBSAC_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(libsac, name, a1, a2, a3, a4)
+#  define LIBSAC_PROBE5(name, a1, a2, a3, a4, a5) DTRACE_PROBE5(libsac, name, a1, a2, a3, a4, a5)
+#else
+#  define LIBSAC_PROBE2(name, a1, a2)
+#  define LIBSAC_PROBE4(name, a1, a2, a3, a4)
+#  define LIBSAC_PROBE5(name, a1, a2, a3, a4, a5)
+#endif
+
+#endif // LIBSAC_TRACE_H_
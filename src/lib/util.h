@@ -40,6 +40,18 @@ int inline clamp(const int x) {
   return x;
 }
 
+/// @brief Count the number of set bits in a 64-bit word.
+inline int popcount64(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
 /// @brief Scoped pointer class.
 /// This is a simple scoped pointer class, similar to C++11 unique_ptr.
 template <class T>
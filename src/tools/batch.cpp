@@ -0,0 +1,235 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// The batch converter processes one file per worker thread. Each worker reads,
+// converts and writes its file before picking up the next one, so file I/O in
+// one worker overlaps with encoding/decoding in the others, while the memory
+// in flight is bounded by the number of workers.
+//-----------------------------------------------------------------------------
+
+#include "batch.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#ifdef TOOLS_USE_OPENMP
+#  include <omp.h>
+#endif
+
+#if !defined(WIN32) && defined(_WIN32)
+#  define WIN32
+#endif
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <dirent.h>
+#endif
+
+#include "file_io.h"
+#include "hires_time.h"
+#include "scoped_ptr.h"
+#include "sound.h"
+
+namespace tools {
+
+namespace {
+
+enum file_type_t {
+  FILE_TYPE_UNKNOWN,
+  FILE_TYPE_WAVE,
+  FILE_TYPE_SAC
+};
+
+struct job_t {
+  std::string in_file;
+  std::string out_file;
+  file_type_t type;
+};
+
+/// @brief Conversion statistics for a single file.
+struct job_result_t {
+  job_result_t() : ok(false), num_samples(0), num_channels(0), codec_time(0.0) {}
+
+  bool ok;
+  long long num_samples;
+  int num_channels;
+  double codec_time;
+};
+
+std::string to_lower(const std::string &s) {
+  std::string result(s);
+  for (size_t i = 0; i < result.size(); ++i) {
+    if (result[i] >= 'A' && result[i] <= 'Z') {
+      result[i] = result[i] - 'A' + 'a';
+    }
+  }
+  return result;
+}
+
+file_type_t file_type(const std::string &name, std::string *base_name) {
+  const size_t dot = name.rfind('.');
+  if (dot == std::string::npos) {
+    return FILE_TYPE_UNKNOWN;
+  }
+  const std::string ext = to_lower(name.substr(dot));
+  *base_name = name.substr(0, dot);
+  if (ext == ".wav") {
+    return FILE_TYPE_WAVE;
+  } else if (ext == ".sac") {
+    return FILE_TYPE_SAC;
+  }
+  return FILE_TYPE_UNKNOWN;
+}
+
+/// @brief List the (non-directory) entries of a directory.
+bool list_files(const std::string &dir, std::vector<std::string> &names) {
+#ifdef WIN32
+  WIN32_FIND_DATAA find_data;
+  HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &find_data);
+  if (h == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  do {
+    if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      names.push_back(find_data.cFileName);
+    }
+  } while (FindNextFileA(h, &find_data));
+  FindClose(h);
+#else
+  DIR *d = opendir(dir.c_str());
+  if (!d) {
+    return false;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    const std::string name(entry->d_name);
+    if (name != "." && name != "..") {
+      names.push_back(name);
+    }
+  }
+  closedir(d);
+#endif
+  std::sort(names.begin(), names.end());
+  return true;
+}
+
+job_result_t convert(const job_t &job, const sac_encode_options_t &options) {
+  job_result_t result;
+  scoped_ptr<sound_t> sound;
+  if (job.type == FILE_TYPE_WAVE) {
+    sound.reset(load_wave(job.in_file));
+    if (!sound.get()) {
+      return result;
+    }
+    if (!save_sac(job.out_file, sound.get(), options, &result.codec_time)) {
+      return result;
+    }
+  } else {
+    sound.reset(load_sac(job.in_file, &result.codec_time));
+    if (!sound.get()) {
+      return result;
+    }
+    if (!save_wave(job.out_file, sound.get())) {
+      return result;
+    }
+  }
+  result.ok = true;
+  result.num_samples = sound->num_samples();
+  result.num_channels = sound->num_channels();
+  return result;
+}
+
+} // anonymous namespace
+
+int convert_directory(const std::string &in_dir,
+                      const std::string &out_dir,
+                      const sac_encode_options_t &options,
+                      int num_threads) {
+  // Collect the conversion jobs.
+  std::vector<std::string> names;
+  if (!list_files(in_dir, names)) {
+    std::cerr << "Unable to read directory " << in_dir << std::endl;
+    return 1;
+  }
+  std::vector<job_t> jobs;
+  for (size_t i = 0; i < names.size(); ++i) {
+    std::string base_name;
+    job_t job;
+    job.type = file_type(names[i], &base_name);
+    if (job.type == FILE_TYPE_UNKNOWN) {
+      continue;
+    }
+    job.in_file = in_dir + "/" + names[i];
+    job.out_file = out_dir + "/" + base_name + (job.type == FILE_TYPE_WAVE ? ".sac" : ".wav");
+    jobs.push_back(job);
+  }
+
+  hires_time_t time;
+  time.push();
+
+  // Run the jobs. Dynamic scheduling keeps all workers busy even when the
+  // file sizes vary a lot.
+  const int num_jobs = static_cast<int>(jobs.size());
+  std::vector<job_result_t> results(num_jobs);
+#ifdef TOOLS_USE_OPENMP
+  if (num_threads > 0) {
+    omp_set_num_threads(num_threads);
+  }
+  #pragma omp parallel for schedule(dynamic, 1)
+#else
+  (void)num_threads;
+#endif
+  for (int i = 0; i < num_jobs; ++i) {
+    results[i] = convert(jobs[i], options);
+  }
+
+  const double dt = time.pop_delta();
+
+  // Report the aggregate throughput.
+  int num_failed = 0;
+  long long total_samples = 0;
+  double total_codec_time = 0.0;
+  for (int i = 0; i < num_jobs; ++i) {
+    if (!results[i].ok) {
+      std::cerr << "Unable to convert " << jobs[i].in_file << std::endl;
+      ++num_failed;
+      continue;
+    }
+    total_samples += results[i].num_samples * results[i].num_channels;
+    total_codec_time += results[i].codec_time;
+  }
+  const double mb = static_cast<double>(total_samples * 2) / (1024.0 * 1024.0);
+  std::cout << "Converted " << (num_jobs - num_failed) << " of " << num_jobs << " files in "
+            << (dt * 1000.0) << " ms.\n";
+  if (dt > 0.0) {
+    std::cout << "Throughput: " << (mb / dt) << " MB/s (16-bit PCM), "
+              << (static_cast<double>(total_samples) / dt) << " samples/s, "
+              << (static_cast<double>(num_jobs - num_failed) / dt) << " files/s.\n";
+  }
+  std::cout << "Total encode/decode time: " << (total_codec_time * 1000.0) << " ms.\n";
+
+  return num_failed;
+}
+
+} // namespace tools
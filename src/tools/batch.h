@@ -0,0 +1,50 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef TOOLS_BATCH_H_
+#define TOOLS_BATCH_H_
+
+#include <string>
+
+#include <libsac.h>
+
+namespace tools {
+
+/// @brief Convert all WAVE and SAC files in a directory.
+/// WAVE files (*.wav) are converted to SAC, and SAC files (*.sac) are
+/// converted to WAVE. The output files are written to the output directory
+/// using the same base names as the input files.
+/// @param in_dir The input directory.
+/// @param out_dir The output directory (must exist).
+/// @param options The SAC encoding options.
+/// @param num_threads The number of concurrent conversions (0 = automatic).
+/// @returns The number of files that could not be converted.
+int convert_directory(const std::string &in_dir,
+                      const std::string &out_dir,
+                      const sac_encode_options_t &options,
+                      int num_threads);
+
+} // namespace tools
+
+#endif // TOOLS_BATCH_H_
@@ -24,11 +24,21 @@
 
 #include "file_io.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
+#ifdef _WIN32
+#  include <fcntl.h>
+#  include <io.h>
+#endif
+
 #include "hires_time.h"
+#include "interleave.h"
+#include "mapped_file.h"
 #include "scoped_ptr.h"
 #include "sound.h"
 
@@ -36,80 +46,122 @@ namespace tools {
 
 namespace {
 
-uint16_t read_uint16(std::istream& s) {
-  uint8_t buf[2];
-  s.read(reinterpret_cast<char*>(buf), 2);
-  return static_cast<uint32_t>(buf[0]) |
-      (static_cast<uint32_t>(buf[1]) << 8);
+// Number of frames to convert per slice when reading/writing WAVE data.
+const int kFramesPerSlice = 16384;
+
+uint16_t get_uint16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0]) |
+      (static_cast<uint16_t>(p[1]) << 8);
+}
+
+uint32_t get_uint32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) |
+      (static_cast<uint32_t>(p[1]) << 8) |
+      (static_cast<uint32_t>(p[2]) << 16) |
+      (static_cast<uint32_t>(p[3]) << 24);
 }
 
-uint32_t read_uint32(std::istream& s) {
-  uint8_t buf[4];
-  s.read(reinterpret_cast<char*>(buf), 4);
-  return static_cast<uint32_t>(buf[0]) |
-      (static_cast<uint32_t>(buf[1]) << 8) |
-      (static_cast<uint32_t>(buf[2]) << 16) |
-      (static_cast<uint32_t>(buf[3]) << 24);
+void put_uint16(uint8_t *out, uint16_t x) {
+  out[0] = x;
+  out[1] = x >> 8;
 }
 
-void write_uint16(std::ostream& s, uint16_t x) {
-  uint8_t buf[2];
-  buf[0] = x;
-  buf[1] = x >> 8;
-  s.write(reinterpret_cast<char*>(buf), 2);
+void put_uint32(uint8_t *out, uint32_t x) {
+  out[0] = x;
+  out[1] = x >> 8;
+  out[2] = x >> 16;
+  out[3] = x >> 24;
 }
 
-void write_uint32(std::ostream& s, uint32_t x) {
-  uint8_t buf[4];
-  buf[0] = x;
-  buf[1] = x >> 8;
-  buf[2] = x >> 16;
-  buf[3] = x >> 24;
-  s.write(reinterpret_cast<char*>(buf), 4);
+/// @brief Deinterleave and convert 24-bit, 32-bit or float samples.
+/// 24-bit samples are left-aligned to 32 bits.
+void deinterleave_wide(const uint8_t *in, sound_t *sound, int offset, int count, int bits_per_sample) {
+  const int num_channels = sound->num_channels();
+  const int bytes_per_sample = bits_per_sample / 8;
+  for (int ch = 0; ch < num_channels; ++ch) {
+    const uint8_t *src = in + ch * bytes_per_sample;
+    const int stride = num_channels * bytes_per_sample;
+    if (sound->format() == SAMPLE_FLOAT) {
+      float *out = sound->channel_float(ch) + offset;
+      for (int k = 0; k < count; ++k, src += stride) {
+        const uint32_t x = get_uint32(src);
+        std::memcpy(&out[k], &x, sizeof(float));
+      }
+    } else if (bytes_per_sample == 3) {
+      int32_t *out = sound->channel_int32(ch) + offset;
+      for (int k = 0; k < count; ++k, src += stride) {
+        out[k] = static_cast<int32_t>((static_cast<uint32_t>(src[0]) << 8) |
+                                      (static_cast<uint32_t>(src[1]) << 16) |
+                                      (static_cast<uint32_t>(src[2]) << 24));
+      }
+    } else {
+      int32_t *out = sound->channel_int32(ch) + offset;
+      for (int k = 0; k < count; ++k, src += stride) {
+        out[k] = static_cast<int32_t>(get_uint32(src));
+      }
+    }
+  }
 }
 
 } // anonymous namespace
 
 sound_t *load_wave(const std::string& file_name) {
-  std::ifstream s(file_name.c_str(), std::ifstream::in | std::ifstream::binary);
+  // The file is memory mapped, and the samples are deinterleaved directly from
+  // the mapped data, so no intermediate copy of the data is made.
+  const mapped_file_t file(file_name);
+  if (!file.is_open() || file.size() < 12) {
+    return 0;
+  }
+  file.advise_sequential();
+  const uint8_t *data = file.data();
 
   // Read header.
-  if (read_uint32(s) != 0x46464952) {
+  if (get_uint32(data) != 0x46464952) {
     return 0;
   }
-  uint32_t file_size = read_uint32(s) + 8;
-  if (read_uint32(s) != 0x45564157) {
+  const size_t file_size = std::min(static_cast<size_t>(get_uint32(data + 4)) + 8, file.size());
+  if (get_uint32(data + 8) != 0x45564157) {
     return 0;
   }
-  file_size -= 12;
 
   scoped_ptr<sound_t> sound;
   int num_channels = 0, bits_per_sample = 0, sample_rate = 0;
+  sample_format_t format = SAMPLE_INT16;
 
   // Read chunks...
-  while (file_size > 0) {
-    uint32_t chunk_id = read_uint32(s);
-    uint32_t chunk_size = read_uint32(s);
-    file_size -= 8 + chunk_size;
+  size_t pos = 12;
+  while (pos + 8 <= file_size) {
+    const uint32_t chunk_id = get_uint32(data + pos);
+    const size_t chunk_size = std::min(static_cast<size_t>(get_uint32(data + pos + 4)), file_size - pos - 8);
+    const uint8_t *chunk = data + pos + 8;
+
+    // Chunks are padded to an even number of bytes.
+    pos += 8 + chunk_size + (chunk_size & 1);
 
     switch (chunk_id) {
       case 0x20746d66: {
         // "fmt "
-        if (read_uint16(s) != 1) {
-          // We only support PCM.
+        if (chunk_size < 16) {
           return 0;
         }
-        num_channels = read_uint16(s);
-        sample_rate = read_uint32(s);
-        read_uint32(s); // Byte rate
-        read_uint16(s); // Block align
-        bits_per_sample = read_uint16(s);
-        if (bits_per_sample != 16) {
-          // We only support 16-bit.
+        int format_tag = get_uint16(chunk);
+        if (format_tag == 0xfffe && chunk_size >= 26) {
+          // WAVE_FORMAT_EXTENSIBLE: The format is given by the sub format GUID.
+          format_tag = get_uint16(chunk + 24);
+        }
+        num_channels = get_uint16(chunk + 2);
+        sample_rate = get_uint32(chunk + 4);
+        bits_per_sample = get_uint16(chunk + 14);
+        if (format_tag == 1 && bits_per_sample == 16) {
+          format = SAMPLE_INT16;
+        } else if (format_tag == 1 && (bits_per_sample == 24 || bits_per_sample == 32)) {
+          format = SAMPLE_INT32;
+        } else if (format_tag == 3 && bits_per_sample == 32) {
+          format = SAMPLE_FLOAT;
+        } else {
+          // We only support 16/24/32-bit PCM and 32-bit float.
           return 0;
         }
-
-        s.seekg(chunk_size - 16, std::ios_base::cur);
         break;
       }
 
@@ -120,26 +172,42 @@ sound_t *load_wave(const std::string& file_name) {
         }
 
         // Create the sound.
-        int num_samples = chunk_size / (num_channels * (bits_per_sample / 8));
-        sound.reset(new sound_t(num_samples, num_channels, sample_rate));
-
-        // Read the data...
-        std::vector<int16_t> buffer(chunk_size);
-        s.read(reinterpret_cast<char*>(&buffer[0]), chunk_size);
-
-        // Convert the buffered data to a sound.
-        // TODO(m): Add support for big endian machines.
-        for (int k = 0; k < num_samples; ++k) {
+        const int bytes_per_frame = num_channels * (bits_per_sample / 8);
+        const int num_samples = static_cast<int>(chunk_size / bytes_per_frame);
+        sound.reset(new sound_t(num_samples, num_channels, sample_rate, format));
+
+        // Convert the data to a sound, one slice at a time. Mapped pages are
+        // released as soon as they have been converted, which keeps the
+        // memory usage close to the size of the decoded sound.
+        std::vector<int16_t> bounce;
+        std::vector<int16_t*> out(num_channels);
+        for (int k = 0; k < num_samples; k += kFramesPerSlice) {
+          const int slice_frames = std::min(kFramesPerSlice, num_samples - k);
+          const size_t slice_offset = static_cast<size_t>(k) * bytes_per_frame;
+          const size_t slice_size = static_cast<size_t>(slice_frames) * bytes_per_frame;
+          if (format != SAMPLE_INT16) {
+            deinterleave_wide(chunk + slice_offset, sound.get(), k, slice_frames, bits_per_sample);
+            file.release(static_cast<size_t>(chunk - data) + slice_offset, slice_size);
+            continue;
+          }
+          const int16_t *in = reinterpret_cast<const int16_t*>(chunk + slice_offset);
+          if ((reinterpret_cast<size_t>(in) & 1) != 0) {
+            // Misaligned data (the file is not properly padded).
+            bounce.resize(slice_frames * num_channels);
+            std::memcpy(&bounce[0], in, slice_size);
+            in = &bounce[0];
+          }
           for (int ch = 0; ch < num_channels; ++ch) {
-            sound->channel(ch)[k] = buffer[k * num_channels + ch];
+            out[ch] = sound->channel(ch) + k;
           }
+          deinterleave(in, &out[0], slice_frames, num_channels);
+          file.release(static_cast<size_t>(chunk - data) + slice_offset, slice_size);
         }
-
         break;
       }
 
       default: {
-        s.seekg(chunk_size, std::ios_base::cur);
+        break;
       }
     }
   }
@@ -147,44 +215,72 @@ sound_t *load_wave(const std::string& file_name) {
   return sound.release();
 }
 
-void save_wave(const std::string &file_name, const sound_t *sound) {
-  std::ofstream s(file_name.c_str(), std::ofstream::out | std::ofstream::binary);
-
-  int data_size = sound->num_samples() * sound->num_channels() * 2;
-  int file_size = 12 + 24 + 8 + data_size;
+void make_wave_header(uint8_t *out, int num_samples, int num_channels, int sample_rate) {
+  const uint32_t data_size = static_cast<uint32_t>(num_samples) * num_channels * 2;
 
   // Write header.
-  write_uint32(s, 0x46464952);
-  write_uint32(s, file_size - 8);
-  write_uint32(s, 0x45564157);
+  put_uint32(out, 0x46464952);
+  put_uint32(out + 4, kWaveHeaderSize - 8 + data_size);
+  put_uint32(out + 8, 0x45564157);
 
   // Write fmt chunk.
-  write_uint32(s, 0x20746d66);
-  write_uint32(s, 24 - 8);
-  write_uint16(s, 1);
-  write_uint16(s, sound->num_channels());
-  write_uint32(s, sound->sample_rate());
-  write_uint32(s, sound->sample_rate() * sound->num_channels() * 2);
-  write_uint16(s, sound->num_channels() * 2);
-  write_uint16(s, 16);
+  put_uint32(out + 12, 0x20746d66);
+  put_uint32(out + 16, 24 - 8);
+  put_uint16(out + 20, 1);
+  put_uint16(out + 22, num_channels);
+  put_uint32(out + 24, sample_rate);
+  put_uint32(out + 28, sample_rate * num_channels * 2);
+  put_uint16(out + 32, num_channels * 2);
+  put_uint16(out + 34, 16);
 
   // Write data chunk.
-  write_uint32(s, 0x61746164);
-  write_uint32(s, data_size);
-
-  // Convert the sound to a buffer.
-  // TODO(m): Add support for big endian machines.
-  std::vector<int16_t> buffer(data_size);
-  for (int k = 0; k < sound->num_samples(); ++k) {
-    for (int ch = 0; ch < sound->num_channels(); ++ch) {
-      buffer[k * sound->num_channels() + ch] = sound->channel(ch)[k];
+  put_uint32(out + 36, 0x61746164);
+  put_uint32(out + 40, data_size);
+}
+
+bool save_wave(const std::string &file_name, const sound_t *sound) {
+  if (sound->format() != SAMPLE_INT16) {
+    // We only write 16-bit WAVE files.
+    return false;
+  }
+  std::ofstream file;
+  if (file_name == "-") {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  } else {
+    file.open(file_name.c_str(), std::ofstream::out | std::ofstream::binary);
+    if (!file.good()) {
+      return false;
     }
   }
-
-  s.write(reinterpret_cast<char*>(&buffer[0]), data_size);
+  std::ostream &s = file_name == "-" ? std::cout : file;
+
+  const int num_channels = sound->num_channels();
+  uint8_t header[kWaveHeaderSize];
+  make_wave_header(header, sound->num_samples(), num_channels, sound->sample_rate());
+  s.write(reinterpret_cast<char*>(header), kWaveHeaderSize);
+
+  // Convert and write the sound one slice at a time.
+  std::vector<int16_t> buffer(kFramesPerSlice * num_channels);
+  std::vector<const int16_t*> in(num_channels);
+  for (int k = 0; k < sound->num_samples(); k += kFramesPerSlice) {
+    const int slice_frames = std::min(kFramesPerSlice, sound->num_samples() - k);
+    for (int ch = 0; ch < num_channels; ++ch) {
+      in[ch] = sound->channel(ch) + k;
+    }
+    interleave(&in[0], &buffer[0], slice_frames, num_channels);
+    s.write(reinterpret_cast<char*>(&buffer[0]), slice_frames * num_channels * 2);
+  }
+  if (file.is_open()) {
+    file.close();
+  } else {
+    s.flush();
+  }
+  return s.good();
 }
 
-sound_t *load_sac(const std::string &file_name) {
+sound_t *load_sac(const std::string &file_name, double *decode_time) {
   hires_time_t time;
 
   // Load the packed data.
@@ -200,7 +296,9 @@ sound_t *load_sac(const std::string &file_name) {
     sac_decode_channel(sound->channel(ch), packed, 0, sound->num_samples(), ch);
   }
   double dt = time.pop_delta();
-  std::cout << "Decoded SAC in " << (dt * 1000.0) << " ms.\n";
+  if (decode_time) {
+    *decode_time = dt;
+  }
 
   // Free the packedsound.
   sac_free(packed);
@@ -208,24 +306,38 @@ sound_t *load_sac(const std::string &file_name) {
   return sound.release();
 }
 
-void save_sac(const std::string &file_name, const sound_t *sound, sac_encoding_t encoding) {
+bool save_sac(const std::string &file_name, const sound_t *sound, const sac_encode_options_t &options, double *encode_time) {
   hires_time_t time;
 
   // Encode the sound.
   time.push();
-  sac_packed_data_t *packed = sac_encode(sound->num_samples(), sound->num_channels(), sound->sample_rate(), encoding, sound->channels());
+  sac_packed_data_t *packed = 0;
+  switch (sound->format()) {
+    case SAMPLE_INT16:
+      packed = sac_encode_ex(sound->num_samples(), sound->num_channels(), sound->sample_rate(), &options, sound->channels());
+      break;
+    case SAMPLE_INT32:
+      packed = sac_encode_int32(sound->num_samples(), sound->num_channels(), sound->sample_rate(), &options, sound->channels_int32());
+      break;
+    case SAMPLE_FLOAT:
+      packed = sac_encode_float(sound->num_samples(), sound->num_channels(), sound->sample_rate(), &options, sound->channels_float());
+      break;
+  }
   if (!packed) {
-    std::cerr << "Unable to encode the sound." << std::endl;
-    return;
+    return false;
   }
   double dt = time.pop_delta();
-  std::cout << "Encoded SAC in " << (dt * 1000.0) << " ms.\n";
+  if (encode_time) {
+    *encode_time = dt;
+  }
 
   // Save the SAC format file.
-  sac_save_file(file_name.c_str(), packed);
+  const bool ok = sac_save_file(file_name.c_str(), packed) != 0;
 
   // Free the encoded sound.
   sac_free(packed);
+
+  return ok;
 }
 
 } // namespace tools
@@ -33,11 +33,36 @@ namespace tools {
 
 class sound_t;
 
+/// @brief Size of a canonical 16-bit PCM WAVE file header.
+const int kWaveHeaderSize = 44;
+
+/// @brief Create a canonical 16-bit PCM WAVE file header.
+/// @param out The output buffer (kWaveHeaderSize bytes).
+/// @param num_samples Number of samples per channel.
+/// @param num_channels Number of channels.
+/// @param sample_rate The sample rate.
+void make_wave_header(uint8_t *out, int num_samples, int num_channels, int sample_rate);
+
 sound_t *load_wave(const std::string& file_name);
-void save_wave(const std::string &file_name, const sound_t *sound);
 
-sound_t *load_sac(const std::string &file_name);
-void save_sac(const std::string &file_name, const sound_t *sound, sac_encoding_t encoding);
+/// @brief Save a 16-bit WAVE file.
+/// @param file_name The file to save, or "-" for stdout.
+/// @param sound The sound to save.
+/// @returns true on success.
+bool save_wave(const std::string &file_name, const sound_t *sound);
+
+/// @brief Load and decode a SAC file.
+/// @param file_name The file to load.
+/// @param decode_time If non-zero, receives the decoding time (in seconds).
+sound_t *load_sac(const std::string &file_name, double *decode_time = 0);
+
+/// @brief Encode and save a SAC file.
+/// @param file_name The file to save.
+/// @param sound The sound to encode.
+/// @param options The encoding options.
+/// @param encode_time If non-zero, receives the encoding time (in seconds).
+/// @returns true on success (i.e. the sound was encoded and written).
+bool save_sac(const std::string &file_name, const sound_t *sound, const sac_encode_options_t &options, double *encode_time = 0);
 
 } // namespace tools
 
@@ -33,6 +33,11 @@
 #  include <windows.h>
 #else
 #  include <sys/time.h>
+#  include <time.h>
+#  include <unistd.h>
+#  if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0) && defined(CLOCK_MONOTONIC)
+#    define TOOLS_USE_CLOCK_GETTIME
+#  endif
 #endif
 
 #include <list>
@@ -48,9 +53,7 @@ class hires_time_t {
       else
         m_time_freq = 0;
 #else
-      struct timeval tv;
-      gettimeofday(&tv, 0);
-      m_time_start = (long long)tv.tv_sec * 1000000LL + (long long)tv.tv_usec;
+      m_time_start = get_ns();
 #endif
     }
 
@@ -61,10 +64,7 @@ class hires_time_t {
       QueryPerformanceCounter((LARGE_INTEGER*)&t);
       return double(t - m_time_start) / double(m_time_freq);
 #else
-      struct timeval tv;
-      gettimeofday(&tv, 0);
-      long long t = (long long)tv.tv_sec * 1000000LL + (long long)tv.tv_usec;
-      return (1e-6) * double(t - m_time_start);
+      return (1e-9) * double(get_ns() - m_time_start);
 #endif
     }
 
@@ -81,6 +81,21 @@ class hires_time_t {
     }
 
   private:
+#ifndef WIN32
+    /// @brief Get the current time in nanoseconds (monotonic if possible).
+    static long long get_ns() {
+#ifdef TOOLS_USE_CLOCK_GETTIME
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return (long long)ts.tv_sec * 1000000000LL + (long long)ts.tv_nsec;
+#else
+      struct timeval tv;
+      gettimeofday(&tv, 0);
+      return (long long)tv.tv_sec * 1000000000LL + (long long)tv.tv_usec * 1000LL;
+#endif
+    }
+#endif
+
     std::list<double> m_stack;
 #ifdef WIN32
     __int64 m_time_freq;
@@ -0,0 +1,339 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// PCM (de)interleaving kernels.
+//
+// There are specialized kernels for 1, 2, 4 and 8 channels. On x86 the 2, 4
+// and 8 channel kernels have SSE2 versions (and AVX2 for 2 channels), which
+// are selected at run time based on sac_get_cpu_level(). Other channel counts
+// use a generic scalar loop.
+//-----------------------------------------------------------------------------
+
+#include "interleave.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  include <immintrin.h>
+#  define TOOLS_USE_X86_SIMD
+#  if defined(__GNUC__) || defined(__clang__)
+// Allow the use of instructions that are not enabled for the entire program.
+#    define TOOLS_TARGET(x) __attribute__((target(x)))
+#  else
+#    define TOOLS_TARGET(x)
+#  endif
+#endif
+
+namespace tools {
+
+// TODO(m): Add support for big endian machines.
+
+namespace {
+
+typedef void (*deinterleave_fn_t)(const int16_t *in, int16_t *const *out, int num_frames);
+typedef void (*interleave_fn_t)(const int16_t *const *in, int16_t *out, int num_frames);
+
+/// @brief The kernels of one CPU level (for 2, 4 and 8 channels).
+struct kernels_t {
+  deinterleave_fn_t deinterleave[3];
+  interleave_fn_t interleave[3];
+};
+
+void deinterleave_generic(const int16_t *in, int16_t *const *out, int first_frame, int num_frames, int num_channels) {
+  for (int k = first_frame; k < num_frames; ++k) {
+    for (int ch = 0; ch < num_channels; ++ch) {
+      out[ch][k] = in[k * num_channels + ch];
+    }
+  }
+}
+
+void interleave_generic(const int16_t *const *in, int16_t *out, int first_frame, int num_frames, int num_channels) {
+  for (int k = first_frame; k < num_frames; ++k) {
+    for (int ch = 0; ch < num_channels; ++ch) {
+      out[k * num_channels + ch] = in[ch][k];
+    }
+  }
+}
+
+template <int N>
+void deinterleave_n(const int16_t *in, int16_t *const *out, int num_frames) {
+  deinterleave_generic(in, out, 0, num_frames, N);
+}
+
+template <int N>
+void interleave_n(const int16_t *const *in, int16_t *out, int num_frames) {
+  interleave_generic(in, out, 0, num_frames, N);
+}
+
+const kernels_t s_generic_kernels = {
+  {deinterleave_n<2>, deinterleave_n<4>, deinterleave_n<8> },
+  {interleave_n<2>, interleave_n<4>, interleave_n<8> }
+};
+
+#ifdef TOOLS_USE_X86_SIMD
+/// @brief Transpose an 8x8 matrix of 16-bit elements.
+TOOLS_TARGET("sse2")
+inline void transpose_8x8(__m128i *v) {
+  const __m128i b0 = _mm_unpacklo_epi16(v[0], v[1]);
+  const __m128i b1 = _mm_unpackhi_epi16(v[0], v[1]);
+  const __m128i b2 = _mm_unpacklo_epi16(v[2], v[3]);
+  const __m128i b3 = _mm_unpackhi_epi16(v[2], v[3]);
+  const __m128i b4 = _mm_unpacklo_epi16(v[4], v[5]);
+  const __m128i b5 = _mm_unpackhi_epi16(v[4], v[5]);
+  const __m128i b6 = _mm_unpacklo_epi16(v[6], v[7]);
+  const __m128i b7 = _mm_unpackhi_epi16(v[6], v[7]);
+  const __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+  const __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+  const __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+  const __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+  const __m128i c4 = _mm_unpacklo_epi32(b4, b6);
+  const __m128i c5 = _mm_unpackhi_epi32(b4, b6);
+  const __m128i c6 = _mm_unpacklo_epi32(b5, b7);
+  const __m128i c7 = _mm_unpackhi_epi32(b5, b7);
+  v[0] = _mm_unpacklo_epi64(c0, c4);
+  v[1] = _mm_unpackhi_epi64(c0, c4);
+  v[2] = _mm_unpacklo_epi64(c1, c5);
+  v[3] = _mm_unpackhi_epi64(c1, c5);
+  v[4] = _mm_unpacklo_epi64(c2, c6);
+  v[5] = _mm_unpackhi_epi64(c2, c6);
+  v[6] = _mm_unpacklo_epi64(c3, c7);
+  v[7] = _mm_unpackhi_epi64(c3, c7);
+}
+
+TOOLS_TARGET("sse2")
+void deinterleave_2_sse2(const int16_t *in, int16_t *const *out, int num_frames) {
+  int16_t *left = out[0];
+  int16_t *right = out[1];
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[2 * k]));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[2 * k + 8]));
+    // Sign extend the even (left) and odd (right) samples to 32 bits, and pack.
+    const __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                      _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    const __m128i r = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&left[k]), l);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&right[k]), r);
+  }
+  deinterleave_generic(in, out, k, num_frames, 2);
+}
+
+TOOLS_TARGET("sse2")
+void interleave_2_sse2(const int16_t *const *in, int16_t *out, int num_frames) {
+  const int16_t *left = in[0];
+  const int16_t *right = in[1];
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    const __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&left[k]));
+    const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&right[k]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[2 * k]), _mm_unpacklo_epi16(l, r));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[2 * k + 8]), _mm_unpackhi_epi16(l, r));
+  }
+  interleave_generic(in, out, k, num_frames, 2);
+}
+
+TOOLS_TARGET("sse2")
+void deinterleave_4_sse2(const int16_t *in, int16_t *const *out, int num_frames) {
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    const __m128i *src = reinterpret_cast<const __m128i*>(&in[4 * k]);
+    const __m128i v0 = _mm_loadu_si128(src);
+    const __m128i v1 = _mm_loadu_si128(src + 1);
+    const __m128i v2 = _mm_loadu_si128(src + 2);
+    const __m128i v3 = _mm_loadu_si128(src + 3);
+    const __m128i t0 = _mm_unpacklo_epi16(v0, v1);
+    const __m128i t1 = _mm_unpackhi_epi16(v0, v1);
+    const __m128i t2 = _mm_unpacklo_epi16(v2, v3);
+    const __m128i t3 = _mm_unpackhi_epi16(v2, v3);
+    const __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+    const __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+    const __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+    const __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[0][k]), _mm_unpacklo_epi64(u0, u2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[1][k]), _mm_unpackhi_epi64(u0, u2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[2][k]), _mm_unpacklo_epi64(u1, u3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[3][k]), _mm_unpackhi_epi64(u1, u3));
+  }
+  deinterleave_generic(in, out, k, num_frames, 4);
+}
+
+TOOLS_TARGET("sse2")
+void interleave_4_sse2(const int16_t *const *in, int16_t *out, int num_frames) {
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[0][k]));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[1][k]));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[2][k]));
+    const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[3][k]));
+    const __m128i ab_lo = _mm_unpacklo_epi16(a, b);
+    const __m128i ab_hi = _mm_unpackhi_epi16(a, b);
+    const __m128i cd_lo = _mm_unpacklo_epi16(c, d);
+    const __m128i cd_hi = _mm_unpackhi_epi16(c, d);
+    __m128i *dst = reinterpret_cast<__m128i*>(&out[4 * k]);
+    _mm_storeu_si128(dst, _mm_unpacklo_epi32(ab_lo, cd_lo));
+    _mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(ab_lo, cd_lo));
+    _mm_storeu_si128(dst + 2, _mm_unpacklo_epi32(ab_hi, cd_hi));
+    _mm_storeu_si128(dst + 3, _mm_unpackhi_epi32(ab_hi, cd_hi));
+  }
+  interleave_generic(in, out, k, num_frames, 4);
+}
+
+TOOLS_TARGET("sse2")
+void deinterleave_8_sse2(const int16_t *in, int16_t *const *out, int num_frames) {
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    // Each vector is a frame: transpose to get one vector per channel.
+    __m128i v[8];
+    const __m128i *src = reinterpret_cast<const __m128i*>(&in[8 * k]);
+    for (int i = 0; i < 8; ++i) {
+      v[i] = _mm_loadu_si128(src + i);
+    }
+    transpose_8x8(v);
+    for (int ch = 0; ch < 8; ++ch) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[ch][k]), v[ch]);
+    }
+  }
+  deinterleave_generic(in, out, k, num_frames, 8);
+}
+
+TOOLS_TARGET("sse2")
+void interleave_8_sse2(const int16_t *const *in, int16_t *out, int num_frames) {
+  int k = 0;
+  for (; k + 8 <= num_frames; k += 8) {
+    // Each vector is a channel: transpose to get one vector per frame.
+    __m128i v[8];
+    for (int ch = 0; ch < 8; ++ch) {
+      v[ch] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[ch][k]));
+    }
+    transpose_8x8(v);
+    __m128i *dst = reinterpret_cast<__m128i*>(&out[8 * k]);
+    for (int i = 0; i < 8; ++i) {
+      _mm_storeu_si128(dst + i, v[i]);
+    }
+  }
+  interleave_generic(in, out, k, num_frames, 8);
+}
+
+TOOLS_TARGET("avx2")
+void deinterleave_2_avx2(const int16_t *in, int16_t *const *out, int num_frames) {
+  int16_t *left = out[0];
+  int16_t *right = out[1];
+  int k = 0;
+  for (; k + 16 <= num_frames; k += 16) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&in[2 * k]));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&in[2 * k + 16]));
+    // Sign extend the even (left) and odd (right) samples to 32 bits, and pack.
+    const __m256i l = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+                                         _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+    const __m256i r = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+    // Undo the per lane ordering of the pack instruction.
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&left[k]), _mm256_permute4x64_epi64(l, 0xd8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&right[k]), _mm256_permute4x64_epi64(r, 0xd8));
+  }
+  deinterleave_generic(in, out, k, num_frames, 2);
+}
+
+TOOLS_TARGET("avx2")
+void interleave_2_avx2(const int16_t *const *in, int16_t *out, int num_frames) {
+  const int16_t *left = in[0];
+  const int16_t *right = in[1];
+  int k = 0;
+  for (; k + 16 <= num_frames; k += 16) {
+    const __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&left[k]));
+    const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&right[k]));
+    const __m256i lo = _mm256_unpacklo_epi16(l, r);
+    const __m256i hi = _mm256_unpackhi_epi16(l, r);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[2 * k]), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[2 * k + 16]), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  interleave_generic(in, out, k, num_frames, 2);
+}
+
+const kernels_t s_sse2_kernels = {
+  {deinterleave_2_sse2, deinterleave_4_sse2, deinterleave_8_sse2},
+  {interleave_2_sse2, interleave_4_sse2, interleave_8_sse2}
+};
+
+const kernels_t s_avx2_kernels = {
+  {deinterleave_2_avx2, deinterleave_4_sse2, deinterleave_8_sse2},
+  {interleave_2_avx2, interleave_4_sse2, interleave_8_sse2}
+};
+#endif // TOOLS_USE_X86_SIMD
+
+/// @returns The kernels for the current CPU level.
+const kernels_t &kernels() {
+#ifdef TOOLS_USE_X86_SIMD
+  const sac_cpu_level_t level = sac_get_cpu_level();
+  if (level >= SAC_CPU_AVX2) {
+    return s_avx2_kernels;
+  }
+  if (level >= SAC_CPU_SSE2) {
+    return s_sse2_kernels;
+  }
+#endif
+  return s_generic_kernels;
+}
+
+} // anonymous namespace
+
+void deinterleave(const int16_t *in, int16_t *const *out, int num_frames, int num_channels) {
+  switch (num_channels) {
+    case 1:
+      std::memcpy(out[0], in, num_frames * sizeof(int16_t));
+      break;
+    case 2:
+      kernels().deinterleave[0](in, out, num_frames);
+      break;
+    case 4:
+      kernels().deinterleave[1](in, out, num_frames);
+      break;
+    case 8:
+      kernels().deinterleave[2](in, out, num_frames);
+      break;
+    default:
+      deinterleave_generic(in, out, 0, num_frames, num_channels);
+      break;
+  }
+}
+
+void interleave(const int16_t *const *in, int16_t *out, int num_frames, int num_channels) {
+  switch (num_channels) {
+    case 1:
+      std::memcpy(out, in[0], num_frames * sizeof(int16_t));
+      break;
+    case 2:
+      kernels().interleave[0](in, out, num_frames);
+      break;
+    case 4:
+      kernels().interleave[1](in, out, num_frames);
+      break;
+    case 8:
+      kernels().interleave[2](in, out, num_frames);
+      break;
+    default:
+      interleave_generic(in, out, 0, num_frames, num_channels);
+      break;
+  }
+}
+
+} // namespace tools
@@ -0,0 +1,48 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef TOOLS_INTERLEAVE_H_
+#define TOOLS_INTERLEAVE_H_
+
+#include <libsac.h>
+
+namespace tools {
+
+/// @brief Split interleaved PCM frames into separate channel buffers.
+/// @param in Interleaved input samples (num_frames * num_channels samples).
+/// @param out Output channel buffers (num_channels buffers).
+/// @param num_frames Number of frames to convert.
+/// @param num_channels Number of channels.
+void deinterleave(const int16_t *in, int16_t *const *out, int num_frames, int num_channels);
+
+/// @brief Combine separate channel buffers into interleaved PCM frames.
+/// @param in Input channel buffers (num_channels buffers).
+/// @param out Interleaved output samples (num_frames * num_channels samples).
+/// @param num_frames Number of frames to convert.
+/// @param num_channels Number of channels.
+void interleave(const int16_t *const *in, int16_t *out, int num_frames, int num_channels);
+
+} // namespace tools
+
+#endif // TOOLS_INTERLEAVE_H_
@@ -0,0 +1,137 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "mapped_file.h"
+
+#include <algorithm>
+
+#if !defined(WIN32) && defined(_WIN32)
+#  define WIN32
+#endif
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace tools {
+
+#ifdef WIN32
+
+mapped_file_t::mapped_file_t(const std::string &file_name)
+    : m_data(0), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(0) {
+  m_file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+    return;
+  }
+  m_mapping = CreateFileMappingA(m_file, 0, PAGE_READONLY, 0, 0, 0);
+  if (!m_mapping) {
+    return;
+  }
+  m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data) {
+    m_size = static_cast<size_t>(size.QuadPart);
+  }
+}
+
+mapped_file_t::~mapped_file_t() {
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_file);
+  }
+}
+
+void mapped_file_t::advise_sequential() const {
+  // The file was opened with FILE_FLAG_SEQUENTIAL_SCAN.
+}
+
+void mapped_file_t::release(size_t offset, size_t size) const {
+  // Unlocking pages that are not locked removes them from the working set.
+  if (m_data && size > 0) {
+    VirtualUnlock(const_cast<uint8_t*>(m_data) + offset, size);
+  }
+}
+
+#else
+
+mapped_file_t::mapped_file_t(const std::string &file_name) : m_data(0), m_size(0) {
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *ptr = mmap(0, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      m_data = static_cast<const uint8_t*>(ptr);
+      m_size = static_cast<size_t>(st.st_size);
+    }
+  }
+
+  // The mapping keeps a reference to the file, so it can be closed.
+  close(fd);
+}
+
+mapped_file_t::~mapped_file_t() {
+  if (m_data) {
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+  }
+}
+
+void mapped_file_t::advise_sequential() const {
+  if (m_data) {
+    madvise(const_cast<uint8_t*>(m_data), m_size, MADV_SEQUENTIAL);
+  }
+}
+
+void mapped_file_t::release(size_t offset, size_t size) const {
+  if (!m_data) {
+    return;
+  }
+
+  // Only whole pages can be released.
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t start = ((offset + page_size - 1) / page_size) * page_size;
+  const size_t end = std::min(offset + size, m_size) / page_size * page_size;
+  if (end > start) {
+    madvise(const_cast<uint8_t*>(m_data) + start, end - start, MADV_DONTNEED);
+  }
+}
+
+#endif
+
+} // namespace tools
@@ -0,0 +1,81 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef TOOLS_MAPPED_FILE_H_
+#define TOOLS_MAPPED_FILE_H_
+
+#include <string>
+
+#include <libsac.h>
+
+namespace tools {
+
+/// @brief Read-only memory mapped file.
+class mapped_file_t {
+  public:
+    /// @brief Map a file into memory.
+    /// @param file_name The file to map.
+    explicit mapped_file_t(const std::string &file_name);
+    ~mapped_file_t();
+
+    /// @returns true if the file was successfully mapped.
+    bool is_open() const {
+      return m_data != 0;
+    }
+
+    const uint8_t *data() const {
+      return m_data;
+    }
+
+    size_t size() const {
+      return m_size;
+    }
+
+    /// @brief Indicate that the file will be read sequentially.
+    void advise_sequential() const;
+
+    /// @brief Release the memory of a range that will not be accessed again.
+    /// This does not unmap the range, but allows the OS to drop the pages from
+    /// the working set, which bounds the memory usage when streaming through
+    /// large files.
+    /// @param offset Start of the range (in bytes).
+    /// @param size Size of the range (in bytes).
+    void release(size_t offset, size_t size) const;
+
+  private:
+    // Not copyable.
+    mapped_file_t(const mapped_file_t &);
+    mapped_file_t &operator=(const mapped_file_t &);
+
+    const uint8_t *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#endif
+};
+
+} // namespace tools
+
+#endif // TOOLS_MAPPED_FILE_H_
@@ -24,26 +24,217 @@
 
 #include <libsac.h>
 
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
 
+#include "batch.h"
 #include "file_io.h"
+#include "hires_time.h"
 #include "scoped_ptr.h"
 #include "sound.h"
+#include "stream_convert.h"
+
+namespace {
+
+/// @brief Print the libsac statistics.
+/// @param out The output stream.
+void print_stats(std::ostream &out) {
+  sac_stats_t stats;
+  sac_get_stats(&stats);
+
+  static const char *const kApiNames[SAC_API_COUNT] = {
+    "load_file", "save_file", "encode", "decode_channel", "decode_interleaved"
+  };
+  static const char *const kFormatNames[3] = {"", "DD4A", "DD8A"};
+
+  out << "Statistics:" << std::endl;
+  for (int f = SAC_FORMAT_DD4A; f <= SAC_FORMAT_DD8A; ++f) {
+    if (stats.blocks_encoded[f] > 0) {
+      out << " " << kFormatNames[f] << " blocks encoded: " << stats.blocks_encoded[f]
+          << " (predictor 0/1: " << stats.predictor_usage[f][0] << "/" << stats.predictor_usage[f][1] << ")" << std::endl;
+    }
+    if (stats.blocks_decoded[f] > 0) {
+      out << " " << kFormatNames[f] << " blocks decoded: " << stats.blocks_decoded[f] << std::endl;
+    }
+  }
+  out << " Partial block decodes: " << stats.partial_block_decodes << std::endl;
+  out << " Skipped samples: " << stats.skipped_samples << std::endl;
+  out << " Clamp events: " << stats.clamp_events << std::endl;
+  out << " Constant blocks: " << stats.constant_blocks << std::endl;
+  out << " Duplicate blocks: " << stats.duplicate_blocks << std::endl;
+  out << " Bytes loaded: " << stats.bytes_loaded << std::endl;
+  for (int i = 0; i < SAC_API_COUNT; ++i) {
+    if (stats.api[i].calls > 0) {
+      out << " sac_" << kApiNames[i] << ": " << stats.api[i].calls << " calls, "
+          << (static_cast<double>(stats.api[i].time_ns) * 1e-6) << " ms" << std::endl;
+    }
+  }
+}
+
+/// @brief Slice a SAC file, or join it with another SAC file (if
+/// second_file is not empty), without decoding the sound.
+bool edit_sac(const std::string &first_file, const std::string &second_file, const std::string &out_file, int start_block, int num_blocks) {
+  tools::hires_time_t time;
+  sac_packed_data_t *first = sac_load_file(first_file.c_str());
+  if (!first) {
+    std::cerr << "Unable to load input file " << first_file << std::endl;
+    return false;
+  }
+  sac_packed_data_t *second = 0;
+  if (!second_file.empty()) {
+    second = sac_load_file(second_file.c_str());
+    if (!second) {
+      std::cerr << "Unable to load input file " << second_file << std::endl;
+      sac_free(first);
+      return false;
+    }
+  }
+
+  time.push();
+  sac_packed_data_t *result = second ? sac_concat(first, second) : sac_slice(first, start_block, num_blocks);
+  const double dt = time.pop_delta();
+  sac_free(first);
+  sac_free(second);
+  if (!result) {
+    std::cerr << (second ? "Unable to join the sounds." : "Invalid block range.") << std::endl;
+    return false;
+  }
+  std::cout << "Edited SAC in " << (dt * 1000.0) << " ms.\n";
+  const bool ok = sac_save_file(out_file.c_str(), result) != 0;
+  sac_free(result);
+  if (!ok) {
+    std::cerr << "Unable to write output file " << out_file << std::endl;
+  }
+  return ok;
+}
+
+/// @brief Encode a SAC file in another format (or layout), without decoding
+/// the whole sound.
+bool transcode_sac(const std::string &in_file, const std::string &out_file, const sac_encode_options_t &options) {
+  sac_packed_data_t *data = sac_load_file(in_file.c_str());
+  if (!data) {
+    std::cerr << "Unable to load input file " << in_file << std::endl;
+    return false;
+  }
+  tools::hires_time_t time;
+  time.push();
+  sac_packed_data_t *result = sac_transcode_ex(data, &options);
+  const double dt = time.pop_delta();
+  sac_free(data);
+  if (!result) {
+    std::cerr << "Unable to transcode the sound." << std::endl;
+    return false;
+  }
+  std::cout << "Transcoded SAC in " << (dt * 1000.0) << " ms.\n";
+  const bool ok = sac_save_file(out_file.c_str(), result) != 0;
+  sac_free(result);
+  if (!ok) {
+    std::cerr << "Unable to write output file " << out_file << std::endl;
+  }
+  return ok;
+}
+
+/// @brief Pick channels of a SAC file (channel_map is a comma separated list
+/// of channel numbers), without decoding the sound.
+bool extract_sac_channels(const std::string &in_file, const std::string &out_file, const std::string &channel_map) {
+  std::vector<int> channels;
+  for (size_t pos = 0; pos <= channel_map.size();) {
+    size_t end = channel_map.find(',', pos);
+    if (end == std::string::npos) {
+      end = channel_map.size();
+    }
+    const std::string entry = channel_map.substr(pos, end - pos);
+    char *entry_end;
+    const long channel = std::strtol(entry.c_str(), &entry_end, 10);
+    if (entry.empty() || entry[0] < '0' || entry[0] > '9' || *entry_end != '\0' || channel > 65535) {
+      std::cerr << "Invalid channel number: \"" << entry << "\"" << std::endl;
+      return false;
+    }
+    channels.push_back(static_cast<int>(channel));
+    pos = end + 1;
+  }
+
+  sac_packed_data_t *data = sac_load_file(in_file.c_str());
+  if (!data) {
+    std::cerr << "Unable to load input file " << in_file << std::endl;
+    return false;
+  }
+  sac_packed_data_t *result = sac_extract_channels(data, &channels[0], static_cast<int>(channels.size()));
+  sac_free(data);
+  if (!result) {
+    std::cerr << "Invalid channel list." << std::endl;
+    return false;
+  }
+  const bool ok = sac_save_file(out_file.c_str(), result) != 0;
+  sac_free(result);
+  if (!ok) {
+    std::cerr << "Unable to write output file " << out_file << std::endl;
+  }
+  return ok;
+}
+
+} // anonymous namespace
 
 int main(int argc, char** argv) {
   // Parse arguments.
-  sac_encoding_t encoding = SAC_FORMAT_DD8A;
+  sac_encode_options_t options;
+  sac_init_encode_options(&options);
   std::string in_file;
   std::string out_file;
+  bool batch = false;
+  bool show_stats = false;
+  bool stream = false;
+  bool slice = false;
+  int slice_start = 0, slice_count = 0;
+  bool concat = false;
+  std::string concat_file;
+  std::string channel_map;
+  bool transcode = false;
+  int num_threads = 0;
   bool bad_arg = false;
   for (int a = 1; a < argc; ++a) {
     std::string arg(argv[a]);
     if (arg == "-4") {
-      encoding = SAC_FORMAT_DD4A;
+      options.format = SAC_FORMAT_DD4A;
     } else if (arg == "-8") {
-      encoding = SAC_FORMAT_DD8A;
-    } else if (arg[0] == '-') {
+      options.format = SAC_FORMAT_DD8A;
+    } else if (arg == "-a") {
+      options.layout |= SAC_LAYOUT_SUPERBLOCKS;
+    } else if (arg == "-p") {
+      options.layout |= SAC_LAYOUT_PLANAR;
+    } else if (arg == "-s") {
+      options.layout |= SAC_LAYOUT_SPARSE;
+    } else if (arg == "-u") {
+      options.layout |= SAC_LAYOUT_DEDUP;
+    } else if (arg == "-m") {
+      options.map_search = 1;
+    } else if (arg == "-t") {
+      transcode = true;
+    } else if (arg == "-d") {
+      options.dither = 1;
+    } else if (arg == "-b" && a + 1 < argc) {
+      options.block_size = std::atoi(argv[++a]);
+    } else if (arg == "-w" && a + 1 < argc) {
+      options.peak_bin_size = std::atoi(argv[++a]);
+    } else if (arg == "--batch") {
+      batch = true;
+    } else if (arg == "--stats") {
+      show_stats = true;
+    } else if (arg == "--stream") {
+      stream = true;
+    } else if (arg == "--slice" && a + 2 < argc) {
+      slice = true;
+      slice_start = std::atoi(argv[++a]);
+      slice_count = std::atoi(argv[++a]);
+    } else if (arg == "--concat") {
+      concat = true;
+    } else if (arg == "--channels" && a + 1 < argc) {
+      channel_map = argv[++a];
+    } else if (arg == "-j" && a + 1 < argc) {
+      num_threads = std::atoi(argv[++a]);
+    } else if (arg[0] == '-' && arg != "-") {
       std::cerr << "Invalid option: " << arg << std::endl;
       bad_arg = true;
       break;
@@ -51,6 +242,10 @@ int main(int argc, char** argv) {
       in_file = arg;
     } else if (out_file.empty()) {
       out_file = arg;
+    } else if (concat && concat_file.empty()) {
+      // --concat takes two input files.
+      concat_file = out_file;
+      out_file = arg;
     } else {
       std::cerr << "Too many arguments" << std::endl;
       bad_arg = true;
@@ -59,37 +254,121 @@ int main(int argc, char** argv) {
   }
 
   // Show usage if necessary.
-  if (bad_arg || in_file.empty() || out_file.empty()) {
+  if (bad_arg || in_file.empty() || out_file.empty() || (concat && concat_file.empty())) {
     std::cout << "Usage: " << argv[0] << " [options] infile outfile" << std::endl;
+    std::cout << "       " << argv[0] << " [options] --batch [-j N] indir outdir" << std::endl;
+    std::cout << "       " << argv[0] << " --slice START COUNT infile outfile" << std::endl;
+    std::cout << "       " << argv[0] << " --concat infile1 infile2 outfile" << std::endl;
+    std::cout << "       " << argv[0] << " --channels LIST infile outfile" << std::endl;
+    std::cout << "       " << argv[0] << " [options] -t infile outfile" << std::endl;
     std::cout << std::endl;
-    std::cout << " infile   The input file (either 16-bit PCM WAVE or SAC)" << std::endl;
+    std::cout << " infile   The input file (either 16/24/32-bit PCM or float WAVE, or SAC)" << std::endl;
     std::cout << " outfile  The output file (for WAVE input, the output is SAC, and vice versa)" << std::endl;
+    std::cout << "          Use - for stdin/stdout (implies --stream, if the input can be streamed)" << std::endl;
+    std::cout << " indir    Convert all *.wav and *.sac files in this directory..." << std::endl;
+    std::cout << " outdir   ...and write the results to this directory" << std::endl;
+    std::cout << " -j N     Number of files to convert in parallel (default: number of CPUs)" << std::endl;
+    std::cout << " --stats  Print libsac statistics (if supported by the library)" << std::endl;
+    std::cout << " --stream Convert incrementally, with constant memory usage" << std::endl;
+    std::cout << " --slice  Extract COUNT block rows, starting at block row START, of a SAC file" << std::endl;
+    std::cout << " --concat Join two SAC files (with the same format, channels and rate)" << std::endl;
+    std::cout << " --channels  Pick channels of a SAC file, e.g. 1,0 swaps two channels" << std::endl;
+    std::cout << " -t       Transcode a SAC file (to the format given by the options below)" << std::endl;
     std::cout << std::endl;
     std::cout << "Options (only used for SAC output):" << std::endl;
     std::cout << " -4       Use 4-bit DD4A encoding" << std::endl;
     std::cout << " -8       Use 8-bit DD8A encoding (default)" << std::endl;
+    std::cout << " -a       Use cache line aligned superblocks" << std::endl;
+    std::cout << " -p       Use planar layout (channels stored one after another)" << std::endl;
+    std::cout << " -s       Use sparse layout (constant blocks and leading/trailing silence are not stored)" << std::endl;
+    std::cout << " -u       Use deduplicated layout (identical blocks are stored once)" << std::endl;
+    std::cout << " -b N     Samples per block: 64 or 128 (default: 32 for DD4A, 16 for DD8A)" << std::endl;
+    std::cout << " -w N     Store a precomputed waveform envelope with N samples per bin" << std::endl;
+    std::cout << " -d       Dither 24/32-bit and float input when converting to 16 bits" << std::endl;
+    std::cout << " -m       Try all quantization maps for each block (slower, more accurate)" << std::endl;
     return 0;
   }
 
+  // Keep messages out of the output when it is written to stdout.
+  std::ostream &log = out_file == "-" ? std::cerr : std::cout;
+
+  if (show_stats && !sac_set_stats_enabled(1)) {
+    std::cerr << "Statistics are not supported by this build of libsac." << std::endl;
+    show_stats = false;
+  }
+
+  // Transcoding?
+  if (transcode) {
+    const bool ok = transcode_sac(in_file, out_file, options);
+    if (show_stats) {
+      print_stats(log);
+    }
+    return ok ? 0 : 1;
+  }
+
+  // Compressed domain editing?
+  if (!channel_map.empty()) {
+    return extract_sac_channels(in_file, out_file, channel_map) ? 0 : 1;
+  }
+  if (slice || concat) {
+    return edit_sac(in_file, concat ? concat_file : std::string(), out_file, slice_start, slice_count) ? 0 : 1;
+  }
+
+  // Streaming conversion? SAC files that can not be streamed are decoded in
+  // memory when writing to stdout.
+  if (!batch && (stream || in_file == "-" || (out_file == "-" && tools::can_stream(in_file)))) {
+    const bool ok = tools::stream_convert(in_file, out_file, options);
+    if (show_stats) {
+      print_stats(log);
+    }
+    return ok ? 0 : 1;
+  }
+
+  // Batch conversion?
+  if (batch) {
+    const int result = tools::convert_directory(in_file, out_file, options, num_threads) == 0 ? 0 : 1;
+    if (show_stats) {
+      print_stats(log);
+    }
+    return result;
+  }
+
   tools::scoped_ptr<tools::sound_t> sound;
 
   // Try loading a WAVE input file.
   sound.reset(tools::load_wave(in_file));
   if (sound.get()) {
     // Save as SAC file.
-    tools::save_sac(out_file, sound.get(), encoding);
+    double dt;
+    if (!tools::save_sac(out_file, sound.get(), options, &dt)) {
+      std::cerr << "Unable to encode and save the sound." << std::endl;
+      return 1;
+    }
+    log << "Encoded SAC in " << (dt * 1000.0) << " ms.\n";
+    if (show_stats) {
+      print_stats(log);
+    }
     return 0;
   }
 
   // Try loading a SAC input file.
-  sound.reset(tools::load_sac(in_file));
+  double dt;
+  sound.reset(tools::load_sac(in_file, &dt));
   if (sound.get()) {
+    log << "Decoded SAC in " << (dt * 1000.0) << " ms.\n";
+
     // Save as WAVE file.
-    tools::save_wave(out_file, sound.get());
+    if (!tools::save_wave(out_file, sound.get())) {
+      std::cerr << "Unable to write output file " << out_file << std::endl;
+      return 1;
+    }
+    if (show_stats) {
+      print_stats(log);
+    }
     return 0;
   }
 
   std::cerr << "Unable to load input file " << in_file << std::endl;
 
-  return 0;
+  return 1;
 }
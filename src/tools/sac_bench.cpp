@@ -0,0 +1,386 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// sac_bench - End-to-end throughput and latency benchmark for libsac.
+//
+// The benchmark encodes and decodes synthetic (deterministic) signals and,
+// optionally, user supplied WAVE files, and reports the results as JSON so
+// that they can be compared between libsac versions.
+//-----------------------------------------------------------------------------
+
+#include <libsac.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef TOOLS_USE_OPENMP
+#  include <omp.h>
+#endif
+
+#include "file_io.h"
+#include "hires_time.h"
+#include "scoped_ptr.h"
+#include "sound.h"
+
+namespace {
+
+// Minimum time to spend on each throughput measurement (in seconds).
+const double kMinMeasureTime = 0.2;
+
+// Random access benchmark parameters.
+const int kRandomAccessFrames = 256;
+const int kRandomAccessReads = 2000;
+
+// Name of the temporary file used for measuring the file load time.
+const char kTempFileName[] = "sac_bench.tmp.sac";
+
+struct config_t {
+  config_t() : seconds(10), max_threads(0), layout(SAC_LAYOUT_DEFAULT) {}
+
+  int seconds;
+  int max_threads;
+  int layout;
+  std::string out_file;
+  std::vector<std::string> wave_files;
+};
+
+struct input_t {
+  std::string name;
+  tools::sound_t *sound;
+};
+
+/// @brief A simple deterministic pseudo random number generator (LCG).
+class rng_t {
+  public:
+    rng_t(uint32_t seed) : m_state(seed) {}
+
+    uint32_t next() {
+      m_state = m_state * 1664525u + 1013904223u;
+      return m_state >> 8;
+    }
+
+  private:
+    uint32_t m_state;
+};
+
+/// @brief Create a deterministic synthetic test signal.
+/// The signal is a mix of tones, noise and short silent gaps, which exercises
+/// all predictors and most of the quantization maps.
+tools::sound_t *make_synthetic(int num_samples, int num_channels, int sample_rate) {
+  tools::sound_t *sound = new tools::sound_t(num_samples, num_channels, sample_rate);
+  for (int ch = 0; ch < num_channels; ++ch) {
+    rng_t rng(1234 + ch);
+    int16_t *out = sound->channel(ch);
+    const double f1 = 2.0 * 3.14159265358979 * (110.0 * (ch + 1)) / sample_rate;
+    const double f2 = 2.0 * 3.14159265358979 * (1870.0 + 13.0 * ch) / sample_rate;
+    for (int k = 0; k < num_samples; ++k) {
+      // Amplitude envelope with a short gap every second.
+      const int pos = k % sample_rate;
+      const double env = pos < sample_rate / 20 ? 0.0 : 0.5 + 0.5 * std::sin(k * 0.00005);
+      const double noise = (static_cast<int>(rng.next() & 0xffff) - 32768) / 32768.0;
+      const double x = env * (12000.0 * std::sin(k * f1) + 4000.0 * std::sin(k * f2) + 1500.0 * noise);
+      out[k] = static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, x)));
+    }
+  }
+  return sound;
+}
+
+std::string json_string(const std::string &s) {
+  std::string result("\"");
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      result += '\\';
+    }
+    result += s[i];
+  }
+  return result + "\"";
+}
+
+const char *format_name(sac_encoding_t format) {
+  return format == SAC_FORMAT_DD4A ? "DD4A" : "DD8A";
+}
+
+void set_num_threads(int num_threads) {
+#ifdef TOOLS_USE_OPENMP
+  omp_set_num_threads(num_threads);
+#else
+  (void)num_threads;
+#endif
+}
+
+int max_num_threads() {
+#ifdef TOOLS_USE_OPENMP
+  return omp_get_num_procs();
+#else
+  return 1;
+#endif
+}
+
+/// @brief Measure the encoding time.
+/// @returns The best time (in seconds) for encoding the entire sound.
+double measure_encode(const tools::sound_t *sound, const sac_encode_options_t &options) {
+  tools::hires_time_t time;
+  double best = 1e30, total = 0.0;
+  for (int i = 0; i < 3 || total < kMinMeasureTime; ++i) {
+    const double t0 = time.get_time();
+    sac_packed_data_t *packed = sac_encode_ex(sound->num_samples(), sound->num_channels(), sound->sample_rate(), &options, sound->channels());
+    const double dt = time.get_time() - t0;
+    sac_free(packed);
+    best = std::min(best, dt);
+    total += dt;
+  }
+  return best;
+}
+
+/// @brief Measure the decoding time (interleaved output).
+/// The sound is split into one contiguous slice per thread, and the slices are
+/// decoded concurrently.
+/// @returns The best time (in seconds) for decoding the entire sound.
+double measure_decode(const sac_packed_data_t *packed, int num_threads) {
+  const int num_samples = sac_get_num_samples(packed);
+  const int num_channels = sac_get_num_channels(packed);
+  std::vector<int16_t> out(static_cast<size_t>(num_samples) * num_channels);
+  const int slice_size = (num_samples + num_threads - 1) / num_threads;
+
+  tools::hires_time_t time;
+  double best = 1e30, total = 0.0;
+  for (int i = 0; i < 3 || total < kMinMeasureTime; ++i) {
+    const double t0 = time.get_time();
+#ifdef TOOLS_USE_OPENMP
+    #pragma omp parallel for num_threads(num_threads)
+#endif
+    for (int s = 0; s < num_threads; ++s) {
+      const int start = s * slice_size;
+      sac_decode_interleaved(&out[static_cast<size_t>(start) * num_channels], packed, start, slice_size);
+    }
+    const double dt = time.get_time() - t0;
+    best = std::min(best, dt);
+    total += dt;
+  }
+  return best;
+}
+
+/// @brief Measure random access decoding latency.
+/// @param p50 Receives the median latency (in seconds).
+/// @param p99 Receives the 99th percentile latency (in seconds).
+void measure_random_access(const sac_packed_data_t *packed, double *p50, double *p99) {
+  const int num_samples = sac_get_num_samples(packed);
+  const int num_channels = sac_get_num_channels(packed);
+  std::vector<int16_t> out(kRandomAccessFrames * num_channels);
+  std::vector<double> latencies(kRandomAccessReads);
+
+  rng_t rng(42);
+  tools::hires_time_t time;
+  for (int i = 0; i < kRandomAccessReads; ++i) {
+    const int max_start = std::max(1, num_samples - kRandomAccessFrames);
+    const int start = static_cast<int>(rng.next() % static_cast<uint32_t>(max_start));
+    const double t0 = time.get_time();
+    sac_decode_interleaved(&out[0], packed, start, kRandomAccessFrames);
+    latencies[i] = time.get_time() - t0;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  *p50 = latencies[kRandomAccessReads / 2];
+  *p99 = latencies[(kRandomAccessReads * 99) / 100];
+}
+
+/// @brief Measure the file load time.
+/// @returns The best time (in seconds) for sac_load_file().
+double measure_load(const sac_packed_data_t *packed) {
+  sac_save_file(kTempFileName, packed);
+
+  tools::hires_time_t time;
+  double best = 1e30, total = 0.0;
+  for (int i = 0; i < 3 || total < kMinMeasureTime; ++i) {
+    const double t0 = time.get_time();
+    sac_packed_data_t *loaded = sac_load_file(kTempFileName);
+    const double dt = time.get_time() - t0;
+    sac_free(loaded);
+    best = std::min(best, dt);
+    total += dt;
+  }
+
+  std::remove(kTempFileName);
+  return best;
+}
+
+/// @brief Run all the benchmarks for a single input and encoding format.
+void run_benchmark(std::ostream &json, const input_t &input, sac_encoding_t format, const config_t &config, bool first) {
+  const tools::sound_t *sound = input.sound;
+  const double num_samples = static_cast<double>(sound->num_samples()) * sound->num_channels();
+  const double pcm_mb = num_samples * 2.0 / (1024.0 * 1024.0);
+
+  std::cerr << "Benchmarking " << input.name << " (" << sound->num_channels() << " ch, "
+            << format_name(format) << ")..." << std::endl;
+
+  sac_encode_options_t options;
+  sac_init_encode_options(&options);
+  options.format = format;
+  options.layout = config.layout;
+
+  sac_packed_data_t *packed = sac_encode_ex(sound->num_samples(), sound->num_channels(), sound->sample_rate(), &options, sound->channels());
+  if (!packed) {
+    std::cerr << "Unable to encode " << input.name << std::endl;
+    return;
+  }
+
+  if (!first) {
+    json << ",\n";
+  }
+  json << "    {\n";
+  json << "      \"input\": " << json_string(input.name) << ",\n";
+  json << "      \"format\": \"" << format_name(format) << "\",\n";
+  json << "      \"layout\": " << config.layout << ",\n";
+  json << "      \"channels\": " << sound->num_channels() << ",\n";
+  json << "      \"sample_rate\": " << sound->sample_rate() << ",\n";
+  json << "      \"num_samples\": " << sound->num_samples() << ",\n";
+  json << "      \"packed_bytes\": " << sac_get_size(packed) << ",\n";
+
+  // Throughput for different thread counts (1, 2, 4, ..., max).
+  const int max_threads = config.max_threads > 0 ? config.max_threads : max_num_threads();
+  json << "      \"throughput\": [\n";
+  for (int threads = 1; threads <= max_threads; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1) {
+    set_num_threads(threads);
+    const double enc_time = measure_encode(sound, options);
+    const double dec_time = measure_decode(packed, threads);
+    json << "        {\"threads\": " << threads
+         << ", \"encode_mb_s\": " << (pcm_mb / enc_time)
+         << ", \"encode_samples_s\": " << (num_samples / enc_time)
+         << ", \"decode_mb_s\": " << (pcm_mb / dec_time)
+         << ", \"decode_samples_s\": " << (num_samples / dec_time)
+         << "}" << (threads < max_threads ? "," : "") << "\n";
+  }
+  json << "      ],\n";
+
+  // Random access latency.
+  double p50, p99;
+  measure_random_access(packed, &p50, &p99);
+  json << "      \"random_access_frames\": " << kRandomAccessFrames << ",\n";
+  json << "      \"random_access_p50_us\": " << (p50 * 1e6) << ",\n";
+  json << "      \"random_access_p99_us\": " << (p99 * 1e6) << ",\n";
+
+  // File load time.
+  json << "      \"load_file_ms\": " << (measure_load(packed) * 1e3) << "\n";
+  json << "    }";
+
+  sac_free(packed);
+}
+
+void print_usage(const char *prg_name) {
+  std::cout << "Usage: " << prg_name << " [options] [file.wav ...]" << std::endl;
+  std::cout << std::endl;
+  std::cout << "Options:" << std::endl;
+  std::cout << " -o FILE  Write the JSON results to FILE (default: stdout)" << std::endl;
+  std::cout << " -s SEC   Length of the synthetic signals in seconds (default: 10)" << std::endl;
+  std::cout << " -j N     Maximum number of threads (default: number of CPUs)" << std::endl;
+  std::cout << " -a       Use cache line aligned superblocks" << std::endl;
+  std::cout << " -p       Use planar layout" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  // Parse arguments.
+  config_t config;
+  for (int a = 1; a < argc; ++a) {
+    std::string arg(argv[a]);
+    if (arg == "-o" && a + 1 < argc) {
+      config.out_file = argv[++a];
+    } else if (arg == "-s" && a + 1 < argc) {
+      config.seconds = std::max(1, std::atoi(argv[++a]));
+    } else if (arg == "-j" && a + 1 < argc) {
+      config.max_threads = std::atoi(argv[++a]);
+    } else if (arg == "-a") {
+      config.layout |= SAC_LAYOUT_SUPERBLOCKS;
+    } else if (arg == "-p") {
+      config.layout |= SAC_LAYOUT_PLANAR;
+    } else if (arg[0] == '-') {
+      print_usage(argv[0]);
+      return 1;
+    } else {
+      config.wave_files.push_back(arg);
+    }
+  }
+
+  // Collect the inputs: synthetic signals with different channel counts...
+  std::vector<input_t> inputs;
+  const int kSyntheticChannels[] = {1, 2, 8};
+  for (int i = 0; i < 3; ++i) {
+    const int sample_rate = 48000;
+    std::ostringstream name;
+    name << "synthetic_" << kSyntheticChannels[i] << "ch";
+    input_t input;
+    input.name = name.str();
+    input.sound = make_synthetic(config.seconds * sample_rate, kSyntheticChannels[i], sample_rate);
+    inputs.push_back(input);
+  }
+
+  // ...and user supplied WAVE files.
+  for (size_t i = 0; i < config.wave_files.size(); ++i) {
+    input_t input;
+    input.name = config.wave_files[i];
+    input.sound = tools::load_wave(config.wave_files[i]);
+    if (!input.sound) {
+      std::cerr << "Unable to load " << config.wave_files[i] << std::endl;
+      continue;
+    }
+    if (input.sound->format() != tools::SAMPLE_INT16) {
+      std::cerr << "Skipping " << config.wave_files[i] << " (not a 16-bit WAVE file)" << std::endl;
+      delete input.sound;
+      continue;
+    }
+    inputs.push_back(input);
+  }
+
+  // Run the benchmarks.
+  std::ostringstream json;
+  json << "{\n";
+  json << "  \"benchmark\": \"sac_bench\",\n";
+  json << "  \"version\": 1,\n";
+  json << "  \"results\": [\n";
+  bool first = true;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    run_benchmark(json, inputs[i], SAC_FORMAT_DD4A, config, first);
+    run_benchmark(json, inputs[i], SAC_FORMAT_DD8A, config, false);
+    first = false;
+    delete inputs[i].sound;
+  }
+  json << "\n  ]\n";
+  json << "}\n";
+
+  if (config.out_file.empty()) {
+    std::cout << json.str();
+  } else {
+    std::ofstream f(config.out_file.c_str());
+    f << json.str();
+  }
+
+  return 0;
+}
@@ -0,0 +1,560 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// sac_microbench - Per-kernel microbenchmarks for libsac.
+//
+// Each hot inner loop is run in isolation over a large working set, and the
+// cost is reported as ns/sample and cycles/sample. As a reference, the memcpy
+// cost for moving the same number of bytes is reported next to each kernel:
+// a kernel that is much slower than memcpy is compute-bound, while a kernel
+// that is close to memcpy speed is memory-bound.
+//
+// NOTE: Cycles are measured with the time stamp counter (when available),
+// which counts at a constant reference frequency rather than the actual core
+// frequency.
+//-----------------------------------------------------------------------------
+
+#include <libsac.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#  define TOOLS_HAS_RDTSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  include <x86intrin.h>
+#  define TOOLS_HAS_RDTSC
+#endif
+
+// libsac internals.
+#include "decoder/decode_dd4a.h"
+#include "decoder/decode_dd8a.h"
+#include "encoder/analyzer.h"
+#include "encoder/encode_dd4a.h"
+#include "encoder/encode_dd8a.h"
+#include "encoder/mapper.h"
+#include "block_layout.h"
+#include "format_traits.h"
+
+#include "hires_time.h"
+#include "interleave.h"
+
+namespace {
+
+// Number of samples that each kernel processes per run (the working set is
+// intentionally larger than the caches).
+const int kNumSamples = 1 << 21;
+
+// Minimum time to spend on each measurement (in seconds).
+const double kMinMeasureTime = 0.1;
+
+// Sink for results that must not be optimized away.
+volatile int s_sink;
+
+/// @brief A simple deterministic pseudo random number generator (LCG).
+class rng_t {
+  public:
+    rng_t(uint32_t seed) : m_state(seed) {}
+
+    uint32_t next() {
+      m_state = m_state * 1664525u + 1013904223u;
+      return m_state >> 8;
+    }
+
+  private:
+    uint32_t m_state;
+};
+
+/// @brief Fill a buffer with a test signal (tones + noise).
+void make_signal(int16_t *out, int count, uint32_t seed) {
+  rng_t rng(seed);
+  int x = 0;
+  for (int k = 0; k < count; ++k) {
+    // Random walk with occasional jumps, which gives a realistic mix of small
+    // and large deltas.
+    x += static_cast<int>(rng.next() % 2001) - 1000;
+    if ((rng.next() & 1023) == 0) {
+      x = static_cast<int>(rng.next() % 40001) - 20000;
+    }
+    x = std::max(-32768, std::min(32767, x));
+    out[k] = static_cast<int16_t>(x);
+  }
+}
+
+/// @brief Cycle counter.
+class cycle_timer_t {
+  public:
+    cycle_timer_t() : m_cycles_per_second(0.0) {
+#ifdef TOOLS_HAS_RDTSC
+      // Calibrate the time stamp counter against the wall clock.
+      const double t0 = m_time.get_time();
+      const unsigned long long c0 = __rdtsc();
+      while (m_time.get_time() - t0 < 0.05) {
+      }
+      const double t1 = m_time.get_time();
+      const unsigned long long c1 = __rdtsc();
+      m_cycles_per_second = static_cast<double>(c1 - c0) / (t1 - t0);
+#endif
+    }
+
+    double get_time() {
+      return m_time.get_time();
+    }
+
+    /// @returns The number of cycles per second, or zero if unknown.
+    double cycles_per_second() const {
+      return m_cycles_per_second;
+    }
+
+  private:
+    tools::hires_time_t m_time;
+    double m_cycles_per_second;
+};
+
+/// @brief Benchmark kernel interface.
+class kernel_t {
+  public:
+    kernel_t(const std::string &name) : m_name(name) {}
+    virtual ~kernel_t() {}
+
+    /// @brief Run the kernel over the entire working set.
+    virtual void run() = 0;
+
+    /// @returns The number of samples that are processed by run().
+    virtual int num_samples() const = 0;
+
+    /// @returns The number of bytes that are read and written by run().
+    virtual double num_bytes() const = 0;
+
+    const std::string &name() const {
+      return m_name;
+    }
+
+  private:
+    const std::string m_name;
+};
+
+/// @brief Block decoder kernel.
+class decode_kernel_t : public kernel_t {
+  public:
+    decode_kernel_t(const std::string &name, sac_encoding_t format, int predictor_no, bool partial, int block_size = 0, bool clamp_free = false)
+        : kernel_t(name), m_format(format), m_clamp_free(clamp_free) {
+      m_block_size = block_size > 0 ? block_size : sac::block_layout_t::default_block_size(format);
+      m_bytes_per_block = sac::block_layout_t::bytes_per_block(format, m_block_size);
+      m_num_blocks = kNumSamples / m_block_size;
+      m_offset = partial ? m_block_size / 2 - 3 : 0;
+      m_count = partial ? m_block_size / 4 : m_block_size;
+
+      // Encode a test signal and force the predictor.
+      std::vector<int16_t> signal(m_num_blocks * m_block_size);
+      make_signal(&signal[0], static_cast<int>(signal.size()), 1);
+      m_data.resize(m_num_blocks * m_bytes_per_block);
+      for (int b = 0; b < m_num_blocks; ++b) {
+        uint8_t *block = &m_data[b * m_bytes_per_block];
+        if (format == SAC_FORMAT_DD4A) {
+          sac::dd4a::encode_block(&signal[b * m_block_size], block, block + 2, m_block_size, 1);
+          block[2] = (block[2] & 0xef) | (predictor_no << 4);
+        } else {
+          sac::dd8a::encode_block(&signal[b * m_block_size], block, block + 2, m_block_size, 1);
+          block[0] = (block[0] & 0xfe) | predictor_no;
+        }
+      }
+      m_out.resize(m_block_size);
+    }
+
+    void run() {
+      int16_t *out = &m_out[0];
+      for (int b = 0; b < m_num_blocks; ++b) {
+        const uint8_t *block = &m_data[b * m_bytes_per_block];
+        if (m_format == SAC_FORMAT_DD4A) {
+          sac::dd4a::decode_block(block, block + 2, out, m_offset, m_count, 1, m_clamp_free);
+        } else {
+          sac::dd8a::decode_block(block, block + 2, out, m_offset, m_count, 1, m_clamp_free);
+        }
+      }
+      s_sink = out[0];
+    }
+
+    int num_samples() const {
+      return m_num_blocks * m_count;
+    }
+
+    double num_bytes() const {
+      return static_cast<double>(m_num_blocks) * (m_bytes_per_block + 2 * m_count);
+    }
+
+  private:
+    sac_encoding_t m_format;
+    bool m_clamp_free;
+    int m_block_size;
+    int m_bytes_per_block;
+    int m_num_blocks;
+    int m_offset;
+    int m_count;
+    std::vector<uint8_t> m_data;
+    std::vector<int16_t> m_out;
+};
+
+/// @brief Block encoder kernel (including analysis and map selection).
+class encode_kernel_t : public kernel_t {
+  public:
+    encode_kernel_t(const std::string &name, sac_encoding_t format)
+        : kernel_t(name), m_format(format) {
+      m_block_size = format == SAC_FORMAT_DD4A ? 32 : 16;
+      m_bytes_per_block = format == SAC_FORMAT_DD4A ? 18 : 17;
+      m_num_blocks = kNumSamples / m_block_size;
+      m_signal.resize(m_num_blocks * m_block_size);
+      make_signal(&m_signal[0], static_cast<int>(m_signal.size()), 2);
+      m_data.resize(m_num_blocks * m_bytes_per_block);
+    }
+
+    void run() {
+      for (int b = 0; b < m_num_blocks; ++b) {
+        const int16_t *in = &m_signal[b * m_block_size];
+        uint8_t *block = &m_data[b * m_bytes_per_block];
+        if (m_format == SAC_FORMAT_DD4A) {
+          sac::dd4a::encode_block(in, block, block + 2, m_block_size, 1);
+        } else {
+          sac::dd8a::encode_block(in, block, block + 2, m_block_size, 1);
+        }
+      }
+      s_sink = m_data[0];
+    }
+
+    int num_samples() const {
+      return m_num_blocks * m_block_size;
+    }
+
+    double num_bytes() const {
+      return static_cast<double>(m_num_blocks) * (2 * m_block_size + m_bytes_per_block);
+    }
+
+  private:
+    sac_encoding_t m_format;
+    int m_block_size;
+    int m_bytes_per_block;
+    int m_num_blocks;
+    std::vector<int16_t> m_signal;
+    std::vector<uint8_t> m_data;
+};
+
+/// @brief Block analysis kernel.
+class analyze_kernel_t : public kernel_t {
+  public:
+    analyze_kernel_t(const std::string &name, int block_size)
+        : kernel_t(name), m_block_size(block_size) {
+      m_num_blocks = kNumSamples / m_block_size;
+      m_signal.resize(m_num_blocks * m_block_size);
+      make_signal(&m_signal[0], static_cast<int>(m_signal.size()), 3);
+    }
+
+    void run() {
+      int sum = 0;
+      for (int b = 0; b < m_num_blocks; ++b) {
+        const sac::analysis_result_t result = sac::analyze_block(&m_signal[b * m_block_size], m_block_size, 1);
+        sum += result.predictor_no + result.max_delta;
+      }
+      s_sink = sum;
+    }
+
+    int num_samples() const {
+      return m_num_blocks * m_block_size;
+    }
+
+    double num_bytes() const {
+      return 2.0 * num_samples();
+    }
+
+  private:
+    int m_block_size;
+    int m_num_blocks;
+    std::vector<int16_t> m_signal;
+};
+
+/// @brief Delta quantization kernel (map_t::encode_delta).
+template <int NUM_ENTRIES>
+class encode_delta_kernel_t : public kernel_t {
+  public:
+    encode_delta_kernel_t(const std::string &name, const short *lut)
+        : kernel_t(name), m_map(lut) {
+      // Random deltas that cover the entire range of the map (and then some).
+      rng_t rng(4);
+      const int range = 2 * m_map.max_delta() + 1;
+      m_deltas.resize(kNumSamples);
+      for (int i = 0; i < kNumSamples; ++i) {
+        m_deltas[i] = static_cast<int16_t>(static_cast<int>(rng.next() % range) - range / 2);
+      }
+      m_codes.resize(kNumSamples);
+    }
+
+    void run() {
+      for (int i = 0; i < kNumSamples; ++i) {
+        m_codes[i] = m_map.encode_delta(m_deltas[i]);
+      }
+      s_sink = m_codes[0];
+    }
+
+    int num_samples() const {
+      return kNumSamples;
+    }
+
+    double num_bytes() const {
+      return 3.0 * kNumSamples;
+    }
+
+  private:
+    const sac::map_t<NUM_ENTRIES> m_map;
+    std::vector<int16_t> m_deltas;
+    std::vector<uint8_t> m_codes;
+};
+
+/// @brief WAVE (de)interleave kernel.
+class interleave_kernel_t : public kernel_t {
+  public:
+    interleave_kernel_t(const std::string &name, int num_channels, bool deinterleave)
+        : kernel_t(name), m_num_channels(num_channels), m_deinterleave(deinterleave) {
+      m_num_frames = kNumSamples / num_channels;
+      m_interleaved.resize(m_num_frames * num_channels);
+      make_signal(&m_interleaved[0], static_cast<int>(m_interleaved.size()), 5);
+      m_channels.resize(num_channels);
+      for (int ch = 0; ch < num_channels; ++ch) {
+        m_channels[ch].resize(m_num_frames);
+        m_channel_ptrs.push_back(&m_channels[ch][0]);
+      }
+    }
+
+    void run() {
+      if (m_deinterleave) {
+        tools::deinterleave(&m_interleaved[0], &m_channel_ptrs[0], m_num_frames, m_num_channels);
+        s_sink = m_channels[0][0];
+      } else {
+        tools::interleave(&m_channel_ptrs[0], &m_interleaved[0], m_num_frames, m_num_channels);
+        s_sink = m_interleaved[0];
+      }
+    }
+
+    int num_samples() const {
+      return m_num_frames * m_num_channels;
+    }
+
+    double num_bytes() const {
+      return 4.0 * num_samples();
+    }
+
+  private:
+    int m_num_channels;
+    bool m_deinterleave;
+    int m_num_frames;
+    std::vector<int16_t> m_interleaved;
+    std::vector<std::vector<int16_t> > m_channels;
+    std::vector<int16_t*> m_channel_ptrs;
+};
+
+/// @brief memcpy kernel (used as the memory bandwidth baseline).
+class memcpy_kernel_t : public kernel_t {
+  public:
+    memcpy_kernel_t(const std::string &name, int num_bytes)
+        : kernel_t(name), m_src(num_bytes, 1), m_dst(num_bytes) {}
+
+    void run() {
+      std::memcpy(&m_dst[0], &m_src[0], m_src.size());
+      s_sink = m_dst[0];
+    }
+
+    int num_samples() const {
+      return static_cast<int>(m_src.size()) / 2;
+    }
+
+    double num_bytes() const {
+      return 2.0 * m_src.size();
+    }
+
+  private:
+    std::vector<uint8_t> m_src;
+    std::vector<uint8_t> m_dst;
+};
+
+/// @brief Measure a kernel.
+/// @returns The best time (in seconds) for a single run.
+double measure(kernel_t &kernel, cycle_timer_t &timer) {
+  kernel.run();  // Warm up.
+  double best = 1e30, total = 0.0;
+  for (int i = 0; i < 3 || total < kMinMeasureTime; ++i) {
+    const double t0 = timer.get_time();
+    kernel.run();
+    const double dt = timer.get_time() - t0;
+    best = std::min(best, dt);
+    total += dt;
+  }
+  return best;
+}
+
+const char *const kCpuLevelNames[] = {"generic", "sse2", "sse4.1", "avx2", "avx512"};
+
+/// @brief Run all dispatched code paths at the current CPU level.
+/// @returns The concatenated output of all the code paths.
+std::vector<int16_t> run_dispatched_paths(const std::vector<int16_t> &signal, int num_frames) {
+  std::vector<int16_t> result;
+  std::vector<int16_t> planar(signal.size());
+  std::vector<int16_t> interleaved(signal.size());
+  for (int num_channels = 1; num_channels <= 8; ++num_channels) {
+    std::vector<int16_t*> channels(num_channels);
+    for (int ch = 0; ch < num_channels; ++ch) {
+      channels[ch] = &planar[static_cast<size_t>(ch) * num_frames];
+    }
+
+    // (De)interleaving.
+    tools::deinterleave(&signal[0], &channels[0], num_frames, num_channels);
+    tools::interleave(&channels[0], &interleaved[0], num_frames, num_channels);
+    result.insert(result.end(), planar.begin(), planar.begin() + num_frames * num_channels);
+    result.insert(result.end(), interleaved.begin(), interleaved.begin() + num_frames * num_channels);
+
+    // Encoding and decoding.
+    for (int f = SAC_FORMAT_DD4A; f <= SAC_FORMAT_DD8A; ++f) {
+      sac_packed_data_t *packed = sac_encode(num_frames, num_channels, 48000, static_cast<sac_encoding_t>(f), &channels[0]);
+      if (!packed) {
+        result.clear();
+        return result;
+      }
+      sac_decode_interleaved(&interleaved[0], packed, 0, num_frames);
+      sac_free(packed);
+      result.insert(result.end(), interleaved.begin(), interleaved.begin() + num_frames * num_channels);
+    }
+  }
+  return result;
+}
+
+/// @brief Check that all supported CPU levels give bit-identical results.
+/// @returns true if all levels match the generic (non-SIMD) level.
+bool verify_cpu_levels() {
+  // An odd number of frames exercises the non-SIMD tails of the kernels.
+  const int kNumFrames = 100003;
+  std::vector<int16_t> signal(kNumFrames * 8);
+  make_signal(&signal[0], static_cast<int>(signal.size()), 1234);
+
+  const sac_cpu_level_t detected = sac_get_detected_cpu_level();
+  sac_set_cpu_level(SAC_CPU_GENERIC);
+  const std::vector<int16_t> reference = run_dispatched_paths(signal, kNumFrames);
+  bool ok = !reference.empty();
+  for (int level = SAC_CPU_GENERIC + 1; level <= detected; ++level) {
+    sac_set_cpu_level(static_cast<sac_cpu_level_t>(level));
+    const bool match = run_dispatched_paths(signal, kNumFrames) == reference;
+    std::printf("%-8s %s\n", kCpuLevelNames[level], match ? "OK" : "MISMATCH");
+    ok = ok && match;
+  }
+  sac_set_cpu_level(SAC_CPU_DETECT);
+  return ok;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    if (std::strcmp(argv[1], "--verify") == 0) {
+      // Check that the SIMD code paths of all CPU levels match.
+      const bool ok = verify_cpu_levels();
+      std::printf("%s\n", ok ? "All CPU levels match." : "CPU level mismatch!");
+      return ok ? 0 : 1;
+    }
+    std::printf("Usage: %s [--verify]\n", argv[0]);
+    std::printf("  --verify  Check that all CPU levels give bit-identical results\n");
+    std::printf("The CPU level can be lowered with LIBSAC_CPU_LEVEL (e.g. LIBSAC_CPU_LEVEL=sse2).\n");
+    return 1;
+  }
+
+  cycle_timer_t timer;
+
+  // Memory bandwidth baseline (large working set, i.e. DRAM bound).
+  double memcpy_seconds_per_byte;
+  {
+    memcpy_kernel_t baseline("memcpy", 2 * kNumSamples);
+    memcpy_seconds_per_byte = measure(baseline, timer) / baseline.num_bytes();
+  }
+
+  std::vector<kernel_t*> kernels;
+  kernels.push_back(new memcpy_kernel_t("memcpy (L1)", 8192));
+  kernels.push_back(new memcpy_kernel_t("memcpy (DRAM)", 2 * kNumSamples));
+  kernels.push_back(new decode_kernel_t("dd4a::decode_block p0 full", SAC_FORMAT_DD4A, 0, false));
+  kernels.push_back(new decode_kernel_t("dd4a::decode_block p1 full", SAC_FORMAT_DD4A, 1, false));
+  kernels.push_back(new decode_kernel_t("dd4a::decode_block p0 partial", SAC_FORMAT_DD4A, 0, true));
+  kernels.push_back(new decode_kernel_t("dd4a::decode_block p1 partial", SAC_FORMAT_DD4A, 1, true));
+  kernels.push_back(new decode_kernel_t("dd8a::decode_block p0 full", SAC_FORMAT_DD8A, 0, false));
+  kernels.push_back(new decode_kernel_t("dd8a::decode_block p1 full", SAC_FORMAT_DD8A, 1, false));
+  kernels.push_back(new decode_kernel_t("dd8a::decode_block p0 partial", SAC_FORMAT_DD8A, 0, true));
+  kernels.push_back(new decode_kernel_t("dd8a::decode_block p1 partial", SAC_FORMAT_DD8A, 1, true));
+  kernels.push_back(new decode_kernel_t("dd4a::decode_block p0 full clamp-free", SAC_FORMAT_DD4A, 0, false, 0, true));
+  kernels.push_back(new decode_kernel_t("dd4a::decode_block p1 full clamp-free", SAC_FORMAT_DD4A, 1, false, 0, true));
+  kernels.push_back(new decode_kernel_t("dd8a::decode_block p0 full clamp-free", SAC_FORMAT_DD8A, 0, false, 0, true));
+  kernels.push_back(new decode_kernel_t("dd8a::decode_block p1 full clamp-free", SAC_FORMAT_DD8A, 1, false, 0, true));
+  kernels.push_back(new decode_kernel_t("dd4a::decode_block p1 full 128", SAC_FORMAT_DD4A, 1, false, 128));
+  kernels.push_back(new decode_kernel_t("dd8a::decode_block p1 full 128", SAC_FORMAT_DD8A, 1, false, 128));
+  kernels.push_back(new encode_kernel_t("dd4a::encode_block", SAC_FORMAT_DD4A));
+  kernels.push_back(new encode_kernel_t("dd8a::encode_block", SAC_FORMAT_DD8A));
+  kernels.push_back(new analyze_kernel_t("analyze_block (32)", 32));
+  kernels.push_back(new analyze_kernel_t("analyze_block (16)", 16));
+  kernels.push_back(new encode_delta_kernel_t<16>("map_t<16>::encode_delta", sac::dd4a::kQuantLut[40]));
+  kernels.push_back(new encode_delta_kernel_t<256>("map_t<256>::encode_delta", sac::dd8a::kQuantLut[4]));
+  const int kChannelCounts[] = {1, 2, 8};
+  for (int i = 0; i < 3; ++i) {
+    char name[64];
+    std::sprintf(name, "deinterleave (%d ch)", kChannelCounts[i]);
+    kernels.push_back(new interleave_kernel_t(name, kChannelCounts[i], true));
+    std::sprintf(name, "interleave (%d ch)", kChannelCounts[i]);
+    kernels.push_back(new interleave_kernel_t(name, kChannelCounts[i], false));
+  }
+
+  const double cycles_per_second = timer.cycles_per_second();
+  if (cycles_per_second > 0.0) {
+    std::printf("Time stamp counter: %.0f MHz\n\n", cycles_per_second * 1e-6);
+  } else {
+    std::printf("Time stamp counter: n/a (cycle counts are not available)\n\n");
+  }
+  std::printf("CPU level: %s (detected: %s)\n\n", kCpuLevelNames[sac_get_cpu_level()], kCpuLevelNames[sac_get_detected_cpu_level()]);
+  std::printf("%-40s %10s %10s %10s %10s %8s\n", "kernel", "ns/sample", "cyc/sample", "B/sample", "memcpy cyc", "ratio");
+  for (size_t i = 0; i < kernels.size(); ++i) {
+    kernel_t &kernel = *kernels[i];
+    const double seconds = measure(kernel, timer);
+    const double num_samples = static_cast<double>(kernel.num_samples());
+    const double bytes_per_sample = kernel.num_bytes() / num_samples;
+    const double seconds_per_sample = seconds / num_samples;
+    const double memcpy_seconds_per_sample = memcpy_seconds_per_byte * bytes_per_sample;
+    std::printf("%-40s %10.3f %10.2f %10.2f %10.2f %8.1f\n",
+                kernel.name().c_str(),
+                seconds_per_sample * 1e9,
+                seconds_per_sample * cycles_per_second,
+                bytes_per_sample,
+                memcpy_seconds_per_sample * cycles_per_second,
+                seconds_per_sample / memcpy_seconds_per_sample);
+    delete kernels[i];
+  }
+
+  std::printf("\nratio = kernel time / memcpy time for the same number of bytes "
+              "(>> 1: compute-bound, ~1: memory-bound)\n");
+
+  return 0;
+}
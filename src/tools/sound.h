@@ -30,24 +30,53 @@
 
 namespace tools {
 
-/// @brief 16-bit PCM sound container.
+/// @brief Sample formats of a sound.
+enum sample_format_t {
+  SAMPLE_INT16,   ///< 16-bit integer.
+  SAMPLE_INT32,   ///< 32-bit integer (full scale is the full 32-bit range).
+  SAMPLE_FLOAT    ///< 32-bit floating point (full scale is [-1.0, 1.0)).
+};
+
+/// @brief PCM sound container.
+/// The samples are stored in the sample format of the source, so that e.g.
+/// 24-bit or floating point WAVE input can be encoded without first making a
+/// 16-bit copy of the sound.
 class sound_t {
   public:
-    sound_t(int num_samples, int num_channels, int sample_rate) :
+    sound_t(int num_samples, int num_channels, int sample_rate, sample_format_t format = SAMPLE_INT16) :
         m_num_samples(num_samples),
-        m_sample_rate(sample_rate) {
+        m_num_channels(num_channels),
+        m_sample_rate(sample_rate),
+        m_format(format) {
       for (int i = 0; i < num_channels; ++i) {
-        m_channels.push_back(new int16_t[num_samples]);
+        switch (format) {
+          case SAMPLE_INT16:
+            m_channels.push_back(static_cast<int16_t*>(sac_mem_alloc(num_samples * sizeof(int16_t))));
+            break;
+          case SAMPLE_INT32:
+            m_channels_int32.push_back(static_cast<int32_t*>(sac_mem_alloc(num_samples * sizeof(int32_t))));
+            break;
+          case SAMPLE_FLOAT:
+            m_channels_float.push_back(static_cast<float*>(sac_mem_alloc(num_samples * sizeof(float))));
+            break;
+        }
       }
     }
 
     ~sound_t() {
-      std::vector<int16_t*>::iterator it;
-      for (it = m_channels.begin(); it != m_channels.end(); it++) {
-        delete[] *it;
+      for (size_t i = 0; i < m_channels.size(); ++i) {
+        sac_mem_free(m_channels[i]);
+      }
+      for (size_t i = 0; i < m_channels_int32.size(); ++i) {
+        sac_mem_free(m_channels_int32[i]);
+      }
+      for (size_t i = 0; i < m_channels_float.size(); ++i) {
+        sac_mem_free(m_channels_float[i]);
       }
     }
 
+    /// @returns The 16-bit samples of the given channel, or 0 if the sound
+    /// is not a 16-bit sound.
     int16_t *channel(int channel) const {
       if (channel < 0 || channel >= static_cast<int>(m_channels.size())) {
         return 0;
@@ -57,7 +86,29 @@ class sound_t {
 
     int16_t **channels() const {
       // TODO(m): Fix constness...
-      return const_cast<int16_t **>(&m_channels[0]);
+      return m_channels.empty() ? 0 : const_cast<int16_t **>(&m_channels[0]);
+    }
+
+    int32_t *channel_int32(int channel) const {
+      if (channel < 0 || channel >= static_cast<int>(m_channels_int32.size())) {
+        return 0;
+      }
+      return m_channels_int32[channel];
+    }
+
+    const int32_t *const *channels_int32() const {
+      return m_channels_int32.empty() ? 0 : &m_channels_int32[0];
+    }
+
+    float *channel_float(int channel) const {
+      if (channel < 0 || channel >= static_cast<int>(m_channels_float.size())) {
+        return 0;
+      }
+      return m_channels_float[channel];
+    }
+
+    const float *const *channels_float() const {
+      return m_channels_float.empty() ? 0 : &m_channels_float[0];
     }
 
     int num_samples() const {
@@ -65,17 +116,25 @@ class sound_t {
     }
 
     int num_channels() const {
-      return static_cast<int>(m_channels.size());
+      return m_num_channels;
     }
 
     int sample_rate() const {
       return m_sample_rate;
     }
 
+    sample_format_t format() const {
+      return m_format;
+    }
+
   private:
     std::vector<int16_t*> m_channels;
+    std::vector<int32_t*> m_channels_int32;
+    std::vector<float*> m_channels_float;
     int m_num_samples;
+    int m_num_channels;
     int m_sample_rate;
+    sample_format_t m_format;
 };
 
 } // namespace tools
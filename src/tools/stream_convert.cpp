@@ -0,0 +1,383 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+// Streaming WAVE <-> SAC conversion.
+//
+// Samples are passed through fixed size slices, so the memory usage does not
+// depend on the length of the input. When the length of a WAVE input is not
+// known (e.g. WAVE streams from a pipe often have zero or 0xffffffff size
+// fields), the data is read until the end of the stream, and the size fields
+// of the output are patched at the end (which requires a seekable output).
+//-----------------------------------------------------------------------------
+
+#include "stream_convert.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#  include <fcntl.h>
+#  include <io.h>
+#endif
+
+#include "file_io.h"
+#include "interleave.h"
+
+namespace tools {
+
+namespace {
+
+// Number of frames to convert per slice.
+const int kFramesPerSlice = 16384;
+
+uint16_t get_uint16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0]) |
+      (static_cast<uint16_t>(p[1]) << 8);
+}
+
+uint32_t get_uint32(const uint8_t *p) {
+  return static_cast<uint32_t>(p[0]) |
+      (static_cast<uint32_t>(p[1]) << 8) |
+      (static_cast<uint32_t>(p[2]) << 16) |
+      (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/// @brief A stdio file or a standard stream.
+class file_t {
+  public:
+    file_t(const std::string &file_name, bool write) : m_file(0), m_owned(false), m_peek_pos(0) {
+      if (file_name == "-") {
+        m_file = write ? stdout : stdin;
+#ifdef _WIN32
+        _setmode(_fileno(m_file), _O_BINARY);
+#endif
+      } else {
+        m_file = std::fopen(file_name.c_str(), write ? "wb" : "rb");
+        m_owned = true;
+      }
+    }
+
+    ~file_t() {
+      close();
+    }
+
+    void close() {
+      if (m_file && m_owned) {
+        std::fclose(m_file);
+      } else if (m_file) {
+        std::fflush(m_file);
+      }
+      m_file = 0;
+    }
+
+    bool is_open() const {
+      return m_file != 0;
+    }
+
+    /// @brief Read the first bytes of the stream, without consuming them.
+    bool peek(uint8_t *buf, int size) {
+      m_peek.resize(size);
+      const int n = static_cast<int>(std::fread(&m_peek[0], 1, size, m_file));
+      m_peek.resize(n);
+      std::copy(m_peek.begin(), m_peek.end(), buf);
+      return n == size;
+    }
+
+    /// @returns The number of bytes that were read.
+    int read(void *buf, int size) {
+      uint8_t *dst = static_cast<uint8_t*>(buf);
+      int n = 0;
+      while (n < size && m_peek_pos < static_cast<int>(m_peek.size())) {
+        dst[n++] = m_peek[m_peek_pos++];
+      }
+      return n + static_cast<int>(std::fread(dst + n, 1, size - n, m_file));
+    }
+
+    bool read_all(void *buf, int size) {
+      return read(buf, size) == size;
+    }
+
+    bool skip(uint32_t size) {
+      uint8_t buf[1024];
+      while (size > 0) {
+        const int n = static_cast<int>(std::min(size, static_cast<uint32_t>(sizeof(buf))));
+        if (!read_all(buf, n)) {
+          return false;
+        }
+        size -= n;
+      }
+      return true;
+    }
+
+    bool write(const void *buf, int size) {
+      return std::fwrite(buf, 1, size, m_file) == static_cast<size_t>(size);
+    }
+
+    /// @returns true if the file supports seeking (i.e. it is not a pipe).
+    bool is_seekable() {
+#ifdef _WIN32
+      return _fseeki64(m_file, 0, SEEK_CUR) == 0;
+#else
+      return fseeko(m_file, 0, SEEK_CUR) == 0;
+#endif
+    }
+
+    bool seek(int64_t pos) {
+#ifdef _WIN32
+      return _fseeki64(m_file, pos, SEEK_SET) == 0;
+#else
+      return fseeko(m_file, static_cast<off_t>(pos), SEEK_SET) == 0;
+#endif
+    }
+
+    // Callbacks for the libsac stream API.
+    static int read_fn(void *buf, int size, void *user) {
+      return static_cast<file_t*>(user)->read(buf, size);
+    }
+
+    static int write_fn(const void *buf, int size, void *user) {
+      return static_cast<file_t*>(user)->write(buf, size) ? 1 : 0;
+    }
+
+    static int seek_fn(int64_t pos, void *user) {
+      return static_cast<file_t*>(user)->seek(pos) ? 1 : 0;
+    }
+
+  private:
+    FILE *m_file;
+    bool m_owned;
+    std::vector<uint8_t> m_peek;
+    int m_peek_pos;
+};
+
+/// @brief Per channel sample buffers for one slice.
+class slice_t {
+  public:
+    slice_t(int num_channels) : m_buffers(num_channels, std::vector<int16_t>(kFramesPerSlice)),
+                                m_channels(num_channels) {
+      for (int ch = 0; ch < num_channels; ++ch) {
+        m_channels[ch] = &m_buffers[ch][0];
+      }
+    }
+
+    int16_t **channels() {
+      return &m_channels[0];
+    }
+
+  private:
+    std::vector<std::vector<int16_t> > m_buffers;
+    std::vector<int16_t*> m_channels;
+};
+
+bool wave_to_sac(file_t &in, file_t &out, const sac_encode_options_t &options) {
+  uint8_t buf[16];
+
+  // Read header (the "RIFF" ID has already been checked).
+  if (!in.read_all(buf, 12) || get_uint32(buf + 8) != 0x45564157) {
+    return false;
+  }
+
+  // Read chunks until we reach the data chunk.
+  int num_channels = 0, sample_rate = 0;
+  uint32_t data_size = 0;
+  while (true) {
+    if (!in.read_all(buf, 8)) {
+      return false;
+    }
+    const uint32_t chunk_id = get_uint32(buf);
+    const uint32_t chunk_size = get_uint32(buf + 4);
+    if (chunk_id == 0x20746d66) {
+      // "fmt "
+      if (chunk_size < 16 || !in.read_all(buf, 16) || !in.skip(chunk_size - 16 + (chunk_size & 1))) {
+        return false;
+      }
+      if (get_uint16(buf) != 1 || get_uint16(buf + 14) != 16) {
+        // We only support 16-bit PCM.
+        return false;
+      }
+      num_channels = get_uint16(buf + 2);
+      sample_rate = static_cast<int>(get_uint32(buf + 4));
+    } else if (chunk_id == 0x61746164) {
+      // "data"
+      data_size = chunk_size;
+      break;
+    } else if (!in.skip(chunk_size + (chunk_size & 1))) {
+      return false;
+    }
+  }
+  if (num_channels < 1) {
+    return false;
+  }
+
+  // Streamed WAVE files often lack a proper data size.
+  const int frame_size = num_channels * 2;
+  const bool known_size = data_size != 0 && data_size != 0xffffffff;
+  const int num_samples = known_size ? static_cast<int>(data_size / frame_size) : -1;
+
+  const bool seekable = out.is_seekable();
+  sac_stream_writer_t *writer = sac_stream_writer_open(num_samples, num_channels, sample_rate, &options,
+                                                       file_t::write_fn, seekable ? file_t::seek_fn : 0, &out);
+  if (!writer) {
+    return false;
+  }
+
+  // Convert one slice at a time.
+  std::vector<int16_t> interleaved(kFramesPerSlice * num_channels);
+  slice_t slice(num_channels);
+  bool ok = true;
+  int frames_left = known_size ? num_samples : 0x7fffffff;
+  while (ok && frames_left > 0) {
+    const int max_frames = std::min(kFramesPerSlice, frames_left);
+    const int frames = in.read(&interleaved[0], max_frames * frame_size) / frame_size;
+    if (frames == 0) {
+      break;
+    }
+    deinterleave(&interleaved[0], slice.channels(), frames, num_channels);
+    ok = sac_stream_writer_write(writer, slice.channels(), frames) != 0;
+    frames_left -= frames;
+  }
+
+  return sac_stream_writer_close(writer) != 0 && ok;
+}
+
+/// @brief Decode a SAC stream (the reader is closed).
+bool sac_to_wave(sac_stream_reader_t *reader, file_t &out) {
+  const int num_samples = sac_stream_reader_get_num_samples(reader);
+  const int num_channels = sac_stream_reader_get_num_channels(reader);
+  const int sample_rate = sac_stream_reader_get_sample_rate(reader);
+
+  // Write header.
+  uint8_t header[kWaveHeaderSize];
+  make_wave_header(header, num_samples, num_channels, sample_rate);
+  bool ok = out.write(header, kWaveHeaderSize);
+
+  // Convert one slice at a time.
+  std::vector<int16_t> interleaved(kFramesPerSlice * num_channels);
+  slice_t slice(num_channels);
+  int num_written = 0;
+  while (ok) {
+    const int frames = sac_stream_reader_read(reader, slice.channels(), kFramesPerSlice);
+    if (frames <= 0) {
+      ok = frames == 0;
+      break;
+    }
+    interleave(slice.channels(), &interleaved[0], frames, num_channels);
+    ok = out.write(&interleaved[0], frames * num_channels * 2);
+    num_written += frames;
+  }
+  sac_stream_reader_close(reader);
+
+  // If the input was truncated, try to make the output consistent.
+  if (num_written != num_samples && out.is_seekable() && out.seek(0)) {
+    make_wave_header(header, num_written, num_channels, sample_rate);
+    out.write(header, kWaveHeaderSize);
+  }
+
+  return ok && num_written == num_samples;
+}
+
+/// @returns true if the file exists and is a regular file (e.g. not a device
+/// or a named pipe).
+bool is_regular_file(const std::string &file_name) {
+  struct stat info;
+  return stat(file_name.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG;
+}
+
+} // anonymous namespace
+
+bool can_stream(const std::string &in_file) {
+  file_t in(in_file, false);
+  uint8_t id[4];
+  if (!in.is_open() || !in.peek(id, 4) || get_uint32(id) != 0x01434153) {
+    return true;
+  }
+  sac_stream_reader_t *reader = sac_stream_reader_open(file_t::read_fn, &in);
+  if (!reader) {
+    return false;
+  }
+  sac_stream_reader_close(reader);
+  return true;
+}
+
+bool stream_convert(const std::string &in_file, const std::string &out_file, const sac_encode_options_t &options) {
+  file_t in(in_file, false);
+  if (!in.is_open()) {
+    std::cerr << "Unable to open " << in_file << std::endl;
+    return false;
+  }
+
+  // Detect the input type.
+  uint8_t id[4];
+  if (!in.peek(id, 4)) {
+    std::cerr << "Unable to read " << in_file << std::endl;
+    return false;
+  }
+  const uint32_t chunk_id = get_uint32(id);
+  if (chunk_id != 0x46464952 && chunk_id != 0x01434153) {
+    std::cerr << "Unsupported input file format" << std::endl;
+    return false;
+  }
+
+  // The SAC header is read before the output is created, so that the output
+  // is not touched if the input can not be streamed.
+  sac_stream_reader_t *reader = 0;
+  if (chunk_id == 0x01434153) {
+    reader = sac_stream_reader_open(file_t::read_fn, &in);
+    if (!reader) {
+      std::cerr << "Unable to stream " << in_file << " (planar, sparse and deduplicated layouts are not supported)" << std::endl;
+      return false;
+    }
+  }
+
+  file_t out(out_file, true);
+  if (!out.is_open()) {
+    std::cerr << "Unable to create " << out_file << std::endl;
+    if (reader) {
+      sac_stream_reader_close(reader);
+    }
+    return false;
+  }
+
+  bool ok;
+  if (reader) {
+    ok = sac_to_wave(reader, out);
+  } else {
+    ok = wave_to_sac(in, out, options);
+  }
+  if (!ok) {
+    std::cerr << "Stream conversion failed" << std::endl;
+
+    // Don't leave a truncated output file behind.
+    out.close();
+    if (out_file != "-" && is_regular_file(out_file)) {
+      std::remove(out_file.c_str());
+    }
+  }
+  return ok;
+}
+
+} // namespace tools
@@ -0,0 +1,51 @@
+// -*- Mode: c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+//-----------------------------------------------------------------------------
+// Copyright (c) 2014 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#ifndef TOOLS_STREAM_CONVERT_H_
+#define TOOLS_STREAM_CONVERT_H_
+
+#include <string>
+
+#include <libsac.h>
+
+namespace tools {
+
+/// @brief Convert between WAVE and SAC with bounded memory usage.
+/// The input type is detected from the stream contents. The conversion is
+/// done incrementally, so either file may be a pipe.
+/// @param in_file The input file, or "-" for stdin.
+/// @param out_file The output file, or "-" for stdout.
+/// @param options The encoding options (for SAC output).
+/// @returns true on success.
+bool stream_convert(const std::string &in_file, const std::string &out_file, const sac_encode_options_t &options);
+
+/// @brief Check if an input file can be converted with stream_convert.
+/// @param in_file The input file.
+/// @returns false if the input is a SAC file with a layout that can not be
+/// streamed (e.g. the planar layout).
+bool can_stream(const std::string &in_file);
+
+} // namespace tools
+
+#endif // TOOLS_STREAM_CONVERT_H_